@@ -0,0 +1,327 @@
+// src/base64.c
+
+#include "base64.h"
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+static const char enc_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static int8_t dec_table[256]; // 6-bit value, -1 outside the alphabet
+
+// ========================================================
+// Kernels: whole groups only, the caller does tails and padding
+// ========================================================
+// encode: bytes consumed (a multiple of 3), out gets 4 characters per 3
+// decode: bytes written; stops at the first group holding a character
+//         outside the alphabet, *used is the characters consumed
+typedef struct
+{
+    const char *name;
+    size_t (*encode)(const unsigned char *in, size_t len, char *out);
+    size_t (*decode)(const unsigned char *in, size_t len, unsigned char *out, size_t room, size_t *used);
+} b64_kernel_t;
+
+static size_t encode_scalar(const unsigned char *in, size_t len, char *out)
+{
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3, out += 4)
+    {
+        uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+        out[0] = enc_table[v >> 18];
+        out[1] = enc_table[(v >> 12) & 63];
+        out[2] = enc_table[(v >> 6) & 63];
+        out[3] = enc_table[v & 63];
+    }
+    return i;
+}
+
+static size_t decode_scalar(const unsigned char *in, size_t len, unsigned char *out, size_t room, size_t *used)
+{
+    size_t i = 0, o = 0;
+    for (; i + 4 <= len && o + 3 <= room; i += 4, o += 3)
+    {
+        int32_t a = dec_table[in[i]], b = dec_table[in[i + 1]], c = dec_table[in[i + 2]], d = dec_table[in[i + 3]];
+        if ((a | b | c | d) < 0)
+            break;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+        out[o] = v >> 16;
+        out[o + 1] = v >> 8;
+        out[o + 2] = v;
+    }
+    *used = i;
+    return o;
+}
+
+#ifdef BASE64_X86
+// 12 bytes -> 16 characters per 128-bit lane (Mula/Lemire): spread each
+// 3-byte group over a 32-bit word, cut out the four 6-bit fields with two
+// multiplies, then map values to ASCII with a 16-entry offset table indexed
+// by the value's range.
+__attribute__((target("ssse3"))) static size_t encode_ssse3(const unsigned char *in, size_t len, char *out)
+{
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 12, out += 16) // reads 16, uses 12
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i)), spread);
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+
+        __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i *)out, _mm_add_epi8(idx, _mm_shuffle_epi8(offsets, range)));
+    }
+    return i + encode_scalar(in + i, len - i, out);
+}
+
+// 16 characters -> 12 bytes: validate with two nibble-indexed bit tables,
+// map ASCII to 6-bit values by high nibble ('/' shares one with '+'), then
+// merge pairs with multiply-adds and pack the 3-byte groups.
+__attribute__((target("ssse3"))) static size_t decode_ssse3(const unsigned char *in, size_t len, unsigned char *out,
+                                                             size_t room, size_t *used)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                         0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0, o = 0;
+    for (; i + 16 <= len && o + 16 <= room; i += 16, o += 12) // writes 16, keeps 12
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi_nib = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+        __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(v, nibble)),
+                                    _mm_shuffle_epi8(lut_hi, hi_nib));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF)
+            break;
+
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')), hi_nib));
+        v = _mm_maddubs_epi16(_mm_add_epi8(v, roll), _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)(out + o), _mm_shuffle_epi8(v, pack));
+    }
+    size_t rest;
+    o += decode_scalar(in + i, len - i, out + o, room - o, &rest);
+    *used = i + rest;
+    return o;
+}
+
+// Same steps on both 128-bit lanes, 24 bytes <-> 32 characters
+__attribute__((target("avx2"))) static size_t encode_avx2(const unsigned char *in, size_t len, char *out)
+{
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    for (; i + 28 <= len; i += 24, out += 32) // reads 28, uses 24
+    {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                                            _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(hi, lo);
+
+        __m256i range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx),
+                                                        _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets, range)));
+    }
+    return i + encode_ssse3(in + i, len - i, out);
+}
+
+__attribute__((target("avx2"))) static size_t decode_avx2(const unsigned char *in, size_t len, unsigned char *out,
+                                                           size_t room, size_t *used)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0, o = 0;
+    for (; i + 32 <= len && o + 32 <= room; i += 32, o += 24) // writes 32, keeps 24
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi_nib = _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, nibble));
+        if (!_mm256_testz_si256(lo, _mm256_shuffle_epi8(lut_hi, hi_nib)))
+            break;
+
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+                                           _mm256_add_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')), hi_nib));
+        v = _mm256_maddubs_epi16(_mm256_add_epi8(v, roll), _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), lanes);
+        _mm256_storeu_si256((__m256i *)(out + o), v);
+    }
+    size_t rest;
+    o += decode_ssse3(in + i, len - i, out + o, room - o, &rest);
+    *used = i + rest;
+    return o;
+}
+#endif
+
+static const b64_kernel_t kernels[] = {
+#ifdef BASE64_X86
+    {"avx2", encode_avx2, decode_avx2},
+    {"ssse3", encode_ssse3, decode_ssse3},
+#endif
+    {"scalar", encode_scalar, decode_scalar},
+};
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const b64_kernel_t *kernel;
+static pthread_once_t b64_once = PTHREAD_ONCE_INIT;
+
+static int kernel_supported(const b64_kernel_t *k)
+{
+#ifdef BASE64_X86
+    __builtin_cpu_init();
+    if (!strcmp(k->name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(k->name, "ssse3"))
+        return __builtin_cpu_supports("ssse3");
+#endif
+    return 1;
+}
+
+static void b64_init(void)
+{
+    memset(dec_table, -1, sizeof(dec_table));
+    for (int i = 0; i < 64; i++)
+        dec_table[(unsigned char)enc_table[i]] = i;
+
+    // fastest first; scalar always qualifies
+    for (size_t i = 0; i < NKERNELS && !kernel; i++)
+        if (kernel_supported(&kernels[i]))
+            kernel = &kernels[i];
+}
+
+const char *base64_kernel(void)
+{
+    pthread_once(&b64_once, b64_init);
+    return kernel->name;
+}
+
+int base64_use_kernel(const char *name)
+{
+    pthread_once(&b64_once, b64_init);
+    for (size_t i = 0; i < NKERNELS; i++)
+        if (!strcmp(kernels[i].name, name) && kernel_supported(&kernels[i]))
+        {
+            kernel = &kernels[i];
+            return 0;
+        }
+    return -1;
+}
+
+// ========================================================
+// Encode / decode
+// ========================================================
+size_t base64_encode(const void *in, size_t len, char *out, size_t out_size)
+{
+    pthread_once(&b64_once, b64_init);
+    if (out_size == 0)
+        return 0;
+    size_t fits = (out_size - 1) / 4 * 3; // input bytes whose groups fit
+    if (len > fits)
+        len = fits;
+
+    const unsigned char *p = in;
+    size_t done = kernel->encode(p, len, out);
+    size_t n = done / 3 * 4;
+    if (len > done) // 1 or 2 bytes left: one padded group
+    {
+        uint32_t v = (uint32_t)p[done] << 16 | (len - done > 1 ? (uint32_t)p[done + 1] << 8 : 0);
+        out[n] = enc_table[v >> 18];
+        out[n + 1] = enc_table[(v >> 12) & 63];
+        out[n + 2] = len - done > 1 ? enc_table[(v >> 6) & 63] : '=';
+        out[n + 3] = '=';
+        n += 4;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Stops once out_size bytes are out; the stream state is then meaningless
+static size_t decode(base64_stream_t *s, const unsigned char *p, size_t len, unsigned char *out, size_t out_size)
+{
+    uint32_t val = s->val;
+    int bits = s->bits;
+    size_t i = 0, o = 0;
+    while (i < len)
+    {
+        // between groups: let the kernel run until it meets a character
+        // outside the alphabet, the input runs short or out fills up
+        if (bits == 0)
+        {
+            size_t used;
+            o += kernel->decode(p + i, len - i, out + o, out_size - o, &used);
+            i += used;
+            if (i == len)
+                break;
+        }
+
+        // one character at a time until the next group starts on a valid
+        // character, skipping the ones outside the alphabet
+        do
+        {
+            int d = dec_table[p[i++]];
+            if (d < 0)
+                continue;
+            val = val << 6 | (uint32_t)d;
+            bits += 6;
+            if (bits >= 8)
+            {
+                if (o >= out_size)
+                    return o;
+                bits -= 8;
+                out[o++] = (unsigned char)(val >> bits);
+            }
+        } while (i < len && (bits != 0 || dec_table[p[i]] < 0));
+    }
+    s->val = val;
+    s->bits = bits;
+    return o;
+}
+
+size_t base64_decode(const char *in, size_t len, unsigned char *out, size_t out_size)
+{
+    pthread_once(&b64_once, b64_init);
+    base64_stream_t s = {0, 0};
+    return decode(&s, (const unsigned char *)in, len, out, out_size);
+}
+
+void base64_stream_init(base64_stream_t *s)
+{
+    s->val = 0;
+    s->bits = 0;
+}
+
+size_t base64_stream_decode(base64_stream_t *s, const char *in, size_t len, unsigned char *out)
+{
+    pthread_once(&b64_once, b64_init);
+    return decode(s, (const unsigned char *)in, len, out, BASE64_DECODED_MAX(len));
+}
@@ -0,0 +1,52 @@
+// src/base64.h
+
+// ---------------------------------------------------------------------------
+// Base64 (RFC 4648, '+' '/' alphabet, '=' padding) for the text protocol's
+// legacy UPLOAD bodies and DOWNLOAD replies, shared by the server and the
+// test clients. Bulk work runs in an AVX2 or SSSE3 kernel when the CPU has
+// one (picked once at first use), otherwise in a scalar kernel; short tails
+// and anything outside the alphabet go through a per-character path.
+// ---------------------------------------------------------------------------
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+
+// Encoded length of n bytes, padding included, NUL not included
+#define BASE64_ENCODED_LEN(n) (((size_t)(n) + 2) / 3 * 4)
+
+// Most bytes n more characters can complete in a stream (up to three
+// characters of an unfinished group may be pending from earlier input)
+#define BASE64_DECODED_MAX(n) (((size_t)(n) + 3) / 4 * 3)
+
+// Encodes len bytes into out and NUL-terminates it. Only whole 4-character
+// groups that fit in out_size (NUL included) are written, so pass
+// BASE64_ENCODED_LEN(len) + 1 to encode everything. Returns the length.
+size_t base64_encode(const void *in, size_t len, char *out, size_t out_size);
+
+// Decodes len characters into out, at most out_size bytes. Characters outside
+// the alphabet ('=', whitespace, line breaks) are skipped. Returns the number
+// of bytes written.
+size_t base64_decode(const char *in, size_t len, unsigned char *out, size_t out_size);
+
+// Incremental decoding of input that arrives in pieces split anywhere:
+// the bits of an unfinished group carry over to the next call. out must
+// have room for BASE64_DECODED_MAX(len) bytes; returns the bytes written.
+typedef struct
+{
+    unsigned int val;
+    int bits; // decoded bits not yet written
+} base64_stream_t;
+
+void base64_stream_init(base64_stream_t *s);
+size_t base64_stream_decode(base64_stream_t *s, const char *in, size_t len, unsigned char *out);
+
+// Name of the kernel in use: "avx2", "ssse3" or "scalar"
+const char *base64_kernel(void);
+
+// Switches to the named kernel (tests and benchmarks); -1 if this CPU or
+// build doesn't have it. Not safe while other threads are coding.
+int base64_use_kernel(const char *name);
+
+#endif
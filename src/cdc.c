@@ -0,0 +1,48 @@
+// src/cdc.c
+
+#include "cdc.h"
+#include <pthread.h>
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void gear_init(void)
+{
+    uint64_t x = CDC_GEAR_SEED;
+    for (int i = 0; i < 256; i++)
+    {
+        // splitmix64
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+size_t cdc_cut(const unsigned char *p, size_t len)
+{
+    pthread_once(&gear_once, gear_init);
+
+    if (len <= CDC_MIN_SIZE)
+        return len;
+    size_t max = len < CDC_MAX_SIZE ? len : CDC_MAX_SIZE;
+    size_t normal = CDC_AVG_SIZE < max ? CDC_AVG_SIZE : max;
+
+    // the first CDC_MIN_SIZE bytes are skipped, not hashed: at most 64 of
+    // them could have reached the top bit anyway
+    uint64_t h = 0;
+    size_t i = CDC_MIN_SIZE;
+    for (; i < normal; i++)
+    {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & CDC_MASK_S))
+            return i + 1;
+    }
+    for (; i < max; i++)
+    {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & CDC_MASK_L))
+            return i + 1;
+    }
+    return max;
+}
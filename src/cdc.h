@@ -0,0 +1,32 @@
+// src/cdc.h
+
+// ---------------------------------------------------------------------------
+// Content-defined chunking (FastCDC-style, normalized). A Gear rolling hash
+// runs over the bytes and a cut is made where its top bits are all zero, so
+// cut points follow the content: inserting or removing a byte moves only the
+// chunks around the edit and every other chunk keeps its hash. Clients run
+// the same function to find which chunks of a modified file the server
+// already has (PROTO_OP_CHUNKS / PROTO_OP_UPLOAD_DELTA in protocol.h).
+//
+// The Gear table is 256 consecutive outputs of splitmix64 seeded with
+// CDC_GEAR_SEED; a client must reproduce it bit for bit.
+// ---------------------------------------------------------------------------
+
+#ifndef CDC_H
+#define CDC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CDC_MIN_SIZE (16 * 1024)  // no cut before this many bytes
+#define CDC_AVG_SIZE (64 * 1024)  // stricter mask before, looser after
+#define CDC_MAX_SIZE (256 * 1024) // forced cut
+#define CDC_MASK_S 0xFFFFC00000000000ULL // top 18 bits: hard to hit below the average
+#define CDC_MASK_L 0xFFFC000000000000ULL // top 14 bits: easy to hit above it
+#define CDC_GEAR_SEED 0x44425F4344435F31ULL // "DB_CDC_1"
+
+// Length of the chunk starting at p. 'len' is what is available; pass at
+// least CDC_MAX_SIZE bytes unless the data ends within them.
+size_t cdc_cut(const unsigned char *p, size_t len);
+
+#endif
@@ -1,7 +1,10 @@
 // src/commands.c
 // ---------------------------------------------------------------------------
 // Handles client commands: signup, login, upload, download, delete, list.
-// Uses condition variables (no busy wait) for worker completion signaling.
+// Runs on the event-loop thread that owns the connection: logout and argument
+// errors are answered inline; signup, login (password hashing, a durable
+// log write) and file commands become tasks whose replies come back through
+// the reactor once a worker finishes them.
 // ---------------------------------------------------------------------------
 
 #include <stdio.h>
@@ -10,194 +13,179 @@
 #include <unistd.h>
 #include <pthread.h>
 #include "commands.h"
+#include "reactor.h"
+#include "protocol.h"
 #include "file_io.h"
 #include "task.h"
+#include "task_pool.h"
 
-// ================= BASE64 DECODE =================
-static int base64_decode(const char *in, unsigned char *out, int out_size)
+// Replies starting with "***" are errors; in binary mode that becomes the
+// frame status and the text travels as the body
+static void send_response(conn_t *c, const char *msg)
 {
-    static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    int decode_table[256];
-    memset(decode_table, -1, sizeof(decode_table));
-    for (int i = 0; i < 64; i++)
-        decode_table[(unsigned char)b64_table[i]] = i;
-
-    int val = 0, valb = -8, out_len = 0;
-    for (int i = 0; in[i]; i++)
-    {
-        unsigned char c = in[i];
-        if (decode_table[c] == -1)
-            continue;
-        val = (val << 6) + decode_table[c];
-        valb += 6;
-        if (valb >= 0)
-        {
-            if (out_len >= out_size)
-                break;
-            out[out_len++] = (val >> valb) & 0xFF;
-            valb -= 8;
-        }
-    }
-    return out_len;
-}
-
-// ================= BASE64 ENCODE =================
-static const char base64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static int base64_encode(const unsigned char *in, int len, char *out, int out_size)
-{
-    int out_len = 0;
-    for (int i = 0; i < len; i += 3)
+    if (c->binary)
     {
-        int val = (in[i] << 16) + ((i + 1 < len ? in[i + 1] : 0) << 8) + (i + 2 < len ? in[i + 2] : 0);
-        if (out_len + 4 >= out_size)
-            break;
-        out[out_len++] = base64_table[(val >> 18) & 63];
-        out[out_len++] = base64_table[(val >> 12) & 63];
-        out[out_len++] = (i + 1 < len) ? base64_table[(val >> 6) & 63] : '=';
-        out[out_len++] = (i + 2 < len) ? base64_table[val & 63] : '=';
+        uint16_t status = strncmp(msg, "***", 3) == 0 ? PROTO_ERR : PROTO_OK;
+        conn_send_frame(c, c->cur_op, status, c->cur_req_id, msg, strlen(msg));
+        return;
     }
-    out[out_len] = '\0';
-    return out_len;
-}
-
-static void send_response(int sockfd, const char *msg)
-{
-    write(sockfd, msg, strlen(msg));
+    conn_send(c, msg, strlen(msg));
 }
 
 // ========================================================
-// Helper to enqueue task and wait until worker completes
-// Now uses heap-allocated task_t so worker and client share the same object.
+// Helpers to hand a task to the workers without blocking the loop.
+// Tasks come from this loop's task_pool, travel through the scheduler and come
+// back to the reactor, which writes task->reply and recycles the task.
 // ========================================================
-static void enqueue_and_wait(queue_t *queue, task_t *local_task)
+static task_t *new_task(conn_t *c, cmd_t cmd, int priority)
 {
-    if (!queue || !local_task)
-        return;
-
-    // Allocate heap task that will be shared with worker
-    task_t *task = malloc(sizeof(task_t));
+    task_t *task = task_alloc();
     if (!task)
     {
         fprintf(stderr, "Failed to allocate task\n");
-        return;
+        send_response(c, "*** Error: Server busy\n");
+        return NULL;
     }
-    // Copy contents
-    *task = *local_task;
+    task->cmd = cmd;
+    task->priority = priority; // FOR PRIORITY IMPLEMENTATION
+    strncpy(task->username, c->session.username, sizeof(task->username) - 1);
+    return task;
+}
 
-    // Init per-task sync
-    pthread_mutex_init(&task->lock, NULL);
-    pthread_cond_init(&task->completed, NULL);
-    task->done = 0;
-    task->result = -1;
+static void submit_task(conn_t *c, task_t *task)
+{
+    task->binary = c->binary;
+    task->req_id = c->cur_req_id;
 
-    // Enqueue (queue takes ownership of 'task')
-    if (queue_enqueue(queue, task) != 0)
+    // Enqueue (the scheduler takes ownership of 'task')
+    if (conn_submit(c, task) != 0)
     {
         fprintf(stderr, "Failed to enqueue task\n");
-        pthread_mutex_destroy(&task->lock);
-        pthread_cond_destroy(&task->completed);
-        free(task);
-        return;
+        discard_upload_stage(task->stage_path);
+        free(task->body);
+        metadata_release_quota(c->loop->metadata, task->username, task->quota_reserved);
+        task_free(task);
+        send_response(c, "*** Error: Server busy\n");
     }
-
-    // Wait for worker to signal completion on same task object
-    pthread_mutex_lock(&task->lock);
-    while (!task->done)
-    {
-        pthread_cond_wait(&task->completed, &task->lock);
-    }
-    pthread_mutex_unlock(&task->lock);
-
-    // Capture result if needed (task->result)
-    // Cleanup sync resources and free task (worker may also free in some designs;
-    // here we free after waiting to ensure consistent ownership)
-    pthread_mutex_destroy(&task->lock);
-    pthread_cond_destroy(&task->completed);
-    // free the task memory (worker should not free it in this design)
-    free(task);
 }
 
 // ========================================================
 // Account management commands
 // ========================================================
-static void handle_signup(int sockfd, char *username, char *password, ClientSession *session, metadata_t *metadata)
+// The session identity is the name as given: one that doesn't fit is
+// refused, never cut short (a truncated name could be someone else's)
+static int session_name_fits(conn_t *c, const char *username)
 {
-    if (!username || !password)
-    {
-        send_response(sockfd, "*** Invalid format. Usage: signup <username> <password>\n");
+    if (strlen(username) <= SESSION_NAME_MAX)
+        return 1;
+    send_response(c, "*** Invalid format. Names are limited to 49 characters\n");
+    return 0;
+}
+
+// User and file names become paths under STORAGE_DIR; dot names are the
+// server's own (storage_name_valid)
+static int storage_name_ok(conn_t *c, const char *name)
+{
+    if (storage_name_valid(name))
+        return 1;
+    send_response(c, "*** Invalid format. Names can't start with '.' or contain '/'\n");
+    return 0;
+}
+
+// SIGNUP / LOGIN task: the worker checks or creates the account, and
+// handle_task_done() opens the session if it succeeds
+static void submit_auth_task(conn_t *c, cmd_t cmd, const char *username, const char *password, int priority)
+{
+    task_t *task = new_task(c, cmd, priority);
+    if (!task)
         return;
-    }
+    strncpy(task->username, username, sizeof(task->username) - 1);
+    strncpy(task->password, password, sizeof(task->password) - 1);
+    submit_task(c, task);
+}
 
-    int result = metadata_add_user(metadata, username, password);
-    if (result == -2)
+static void handle_signup(conn_t *c, char *username, char *password)
+{
+    if (!username || !password)
     {
-        send_response(sockfd, "*** Error: User already exists\n");
+        send_response(c, "*** Invalid format. Usage: signup <username> <password>\n");
         return;
     }
-    else if (result != 0)
+    if (!session_name_fits(c, username) || !storage_name_ok(c, username))
+        return;
+    if (strlen(password) >= sizeof(((task_t *)0)->password))
     {
-        send_response(sockfd, "*** Error: Signup failed\n");
+        send_response(c, "*** Error: Signup failed\n");
         return;
     }
 
-    session->authenticated = 1;
-    strncpy(session->username, username, sizeof(session->username) - 1);
-    session->username[sizeof(session->username) - 1] = '\0';
-    create_user_dir(username);
-    send_response(sockfd, "Signup successful. You are now logged in.\n");
+    submit_auth_task(c, SIGNUP, username, password, 1);
 }
 
-static void handle_login(int sockfd, char *username, char *password, ClientSession *session, metadata_t *metadata)
+static void handle_login(conn_t *c, char *username, char *password, ClientSession *session, metadata_t *metadata)
 {
     if (session->authenticated)
     {
         char msg[128];
         snprintf(msg, sizeof(msg), "*** Error: Already logged in as '%s'\n", session->username);
-        send_response(sockfd, msg);
+        send_response(c, msg);
         return;
     }
 
     if (!username || !password)
     {
-        send_response(sockfd, "*** Invalid format. Usage: login <username> <password>\n");
+        send_response(c, "*** Invalid format. Usage: login <username> <password>\n");
         return;
     }
-
-    if (metadata_authenticate(metadata, username, password))
-    {
-        session->authenticated = 1;
-        strncpy(session->username, username, sizeof(session->username) - 1);
-        session->username[sizeof(session->username) - 1] = '\0';
-        send_response(sockfd, "Login successful\n");
-    }
-    else
+    if (!session_name_fits(c, username))
+        return;
+    if (strlen(password) >= sizeof(((task_t *)0)->password))
     {
-        send_response(sockfd, "*** Error: Invalid credentials\n");
+        send_response(c, "*** Error: Invalid credentials\n");
+        return;
     }
+
+    // BONUS ---- Priority System Implementation ----
+    user_t *u = NULL;
+    int priority = 1; // default
+    if (metadata_get_user(metadata, username, &u) == 0)
+        priority = u->priority;
+
+    submit_auth_task(c, LOGIN, username, password, priority);
+}
+
+void handle_task_done(conn_t *c, const task_t *task)
+{
+    if ((task->cmd != SIGNUP && task->cmd != LOGIN) || task->result != 0)
+        return;
+    ClientSession *session = &c->session;
+    session->authenticated = 1;
+    strncpy(session->username, task->username, sizeof(session->username) - 1);
+    session->username[sizeof(session->username) - 1] = '\0';
 }
 
-static void handle_logout(int sockfd, ClientSession *session)
+static void handle_logout(conn_t *c, ClientSession *session)
 {
     if (!session->authenticated)
     {
-        send_response(sockfd, "*** Error: Not logged in\n");
+        send_response(c, "*** Error: Not logged in\n");
         return;
     }
     session->authenticated = 0;
     memset(session->username, 0, sizeof(session->username));
-    send_response(sockfd, "Logged out successfully\n");
+    send_response(c, "Logged out successfully\n");
 }
 
 // ========================================================
 // File operation handlers
 // ========================================================
-static void handle_upload(int sockfd, char *filename, ClientSession *session, queue_t *task_queue, metadata_t *metadata)
+// UPLOAD <filename>         -> one base64 line (legacy), decoded while it streams
+// UPLOAD <filename> <size>  -> exactly <size> raw bytes, streamed to disk
+static void handle_upload(conn_t *c, char *filename, char *size_arg, ClientSession *session, metadata_t *metadata)
 {
     if (!session->authenticated)
     {
-        send_response(sockfd, "*** Error: Please login first\n");
+        send_response(c, "*** Error: Please login first\n");
         return;
     }
 
@@ -212,38 +200,106 @@ static void handle_upload(int sockfd, char *filename, ClientSession *session, qu
 
     if (!filename)
     {
-        send_response(sockfd, "*** Invalid format. Usage: UPLOAD <filename>\n");
+        send_response(c, "*** Invalid format. Usage: UPLOAD <filename> [size]\n");
         return;
     }
+    if (!storage_name_ok(c, filename))
+        return;
 
-    send_response(sockfd, "READY_TO_RECEIVE\n");
-
-    char encoded_data[8192];
-    int bytes_read = read(sockfd, encoded_data, sizeof(encoded_data) - 1);
-    if (bytes_read <= 0)
+    if (size_arg)
     {
-        send_response(sockfd, "*** Error: Failed to receive file data\n");
+        char *end = NULL;
+        unsigned long long size = strtoull(size_arg, &end, 10);
+        if (!end || *end != '\0' || size_arg[0] == '-')
+        {
+            send_response(c, "*** Invalid format. Usage: UPLOAD <filename> [size]\n");
+            return;
+        }
+
+        // Reserve before the client sends a single byte: concurrent uploads
+        // can't all pass a check and then overrun the quota on commit
+        if (metadata_reserve_quota(metadata, session->username, (size_t)size) != 0)
+        {
+            send_response(c, "*** Error: Quota exceeded\n");
+            return;
+        }
+
+        // a body small enough for the store to take from memory is never staged
+        int fd = -1;
+        int in_memory = store->commit_buffer && size <= store->inline_max;
+        if (in_memory ? conn_stream_to_memory(c, (size_t)size) != 0
+                      : (fd = open_upload_stage(session->username, filename, c->stage_path, sizeof(c->stage_path))) < 0)
+        {
+            metadata_release_quota(metadata, session->username, (size_t)size);
+            send_response(c, "*** Error: Save failed\n");
+            return;
+        }
+        c->quota_reserved = (size_t)size;
+
+        c->pending_priority = priority; // FOR PRIORITY IMPLEMENTATION
+        strncpy(c->pending_file, filename, sizeof(c->pending_file) - 1);
+        c->pending_file[sizeof(c->pending_file) - 1] = '\0';
+        if (!in_memory)
+            conn_stream_to_file(c, fd, (size_t)size);
+        send_response(c, "READY_TO_RECEIVE\n");
         return;
     }
-    encoded_data[bytes_read] = '\0';
 
-    task_t local = {0};
-    local.cmd = UPLOAD;
-    local.priority = priority; // FOR PRIORITY IMPLEMENTATION
-    strncpy(local.username, session->username, sizeof(local.username) - 1);
-    strncpy(local.filename, filename, sizeof(local.filename) - 1);
-    strncpy(local.data, encoded_data, sizeof(local.data) - 1);
-    local.sock_fd = sockfd;
-    local.file_size = bytes_read;
+    // One base64 line follows; the reactor decodes it into the staging file
+    // (or memory, until it outgrows the store's inline_max) as it arrives and
+    // reserves quota for the decoded bytes as it goes
+    int fd = -1;
+    if (store->commit_buffer ? conn_decode_to_memory(c, store->inline_max) != 0
+                             : (fd = open_upload_stage(session->username, filename, c->stage_path,
+                                                       sizeof(c->stage_path))) < 0)
+    {
+        send_response(c, "*** Error: Save failed\n");
+        return;
+    }
+    c->pending_priority = priority; // FOR PRIORITY IMPLEMENTATION
+    strncpy(c->pending_file, filename, sizeof(c->pending_file) - 1);
+    c->pending_file[sizeof(c->pending_file) - 1] = '\0';
+    if (fd >= 0)
+        conn_decode_to_file(c, fd);
+    send_response(c, "READY_TO_RECEIVE\n");
+}
 
-    enqueue_and_wait(task_queue, &local);
+// Called by the reactor once the whole body is in the staging file or its
+// buffer (all announced bytes, or the end of the base64 line); err is the reply for a
+// body that could not be taken
+void handle_upload_streamed(conn_t *c, const char *err)
+{
+    cmd_t cmd = c->binary && c->cur_op == PROTO_OP_UPLOAD_DELTA ? UPLOAD_DELTA : UPLOAD;
+    task_t *task = !err ? new_task(c, cmd, c->pending_priority) : NULL;
+    if (!task)
+    {
+        discard_upload_stage(c->stage_path);
+        c->stage_path[0] = '\0';
+        metadata_release_quota(c->loop->metadata, c->session.username, c->quota_reserved);
+        c->quota_reserved = 0;
+        if (err)
+            send_response(c, err);
+        return;
+    }
+    strncpy(task->filename, c->pending_file, sizeof(task->filename) - 1);
+    strncpy(task->stage_path, c->stage_path, sizeof(task->stage_path) - 1);
+    task->body = c->body_buf;
+    task->file_size = c->body_size;
+    task->quota_reserved = c->quota_reserved;
+    c->stage_path[0] = '\0'; // the worker owns the body and the reservation now
+    c->body_buf = NULL;
+    c->quota_reserved = 0;
+
+    submit_task(c, task);
 }
 
-static void handle_download(int sockfd, char *filename, ClientSession *session, queue_t *task_queue, metadata_t *metadata)
+// DOWNLOAD <filename>         -> base64 text of the whole file (legacy)
+// DOWNLOAD <filename> BINARY  -> "FILE <size>\n" then <size> raw bytes (sendfile)
+static void handle_download(conn_t *c, char *filename, char *mode, ClientSession *session, metadata_t *metadata)
 {
     if (!session->authenticated)
     {
-        send_response(sockfd, "*** Error: Please login first\n");
+        send_response(c, "*** Error: Please login first\n");
         return;
     }
 
@@ -258,25 +314,31 @@ static void handle_download(int sockfd, char *filename, ClientSession *session,
 
     if (!filename)
     {
-        send_response(sockfd, "*** Invalid format. Usage: DOWNLOAD <filename>\n");
+        send_response(c, "*** Invalid format. Usage: DOWNLOAD <filename> [BINARY]\n");
         return;
     }
+    if (mode && strcmp(mode, "BINARY") != 0)
+    {
+        send_response(c, "*** Invalid format. Usage: DOWNLOAD <filename> [BINARY]\n");
+        return;
+    }
+    if (!storage_name_ok(c, filename))
+        return;
 
-    task_t local = {0};
-    local.cmd = DOWNLOAD;
-    local.priority = priority; // FOR PRIORITY IMPLEMENTATION
-    strncpy(local.username, session->username, sizeof(local.username) - 1);
-    strncpy(local.filename, filename, sizeof(local.filename) - 1);
-    local.sock_fd = sockfd;
+    task_t *task = new_task(c, DOWNLOAD, priority);
+    if (!task)
+        return;
+    task->raw = mode != NULL;
+    strncpy(task->filename, filename, sizeof(task->filename) - 1);
 
-    enqueue_and_wait(task_queue, &local);
+    submit_task(c, task);
 }
 
-static void handle_delete(int sockfd, char *filename, ClientSession *session, queue_t *task_queue, metadata_t *metadata)
+static void handle_delete(conn_t *c, char *filename, ClientSession *session, metadata_t *metadata)
 {
     if (!session->authenticated)
     {
-        send_response(sockfd, "*** Error: Please login first\n");
+        send_response(c, "*** Error: Please login first\n");
         return;
     }
 
@@ -291,25 +353,25 @@ static void handle_delete(int sockfd, char *filename, ClientSession *session, qu
 
     if (!filename)
     {
-        send_response(sockfd, "*** Invalid format. Usage: DELETE <filename>\n");
+        send_response(c, "*** Invalid format. Usage: DELETE <filename>\n");
         return;
     }
+    if (!storage_name_ok(c, filename))
+        return;
 
-    task_t local = {0};
-    local.cmd = DELETE;
-    local.priority = priority; // FOR PRIORITY IMPLEMENTATION
-    strncpy(local.username, session->username, sizeof(local.username) - 1);
-    strncpy(local.filename, filename, sizeof(local.filename) - 1);
-    local.sock_fd = sockfd;
+    task_t *task = new_task(c, DELETE, priority);
+    if (!task)
+        return;
+    strncpy(task->filename, filename, sizeof(task->filename) - 1);
 
-    enqueue_and_wait(task_queue, &local);
+    submit_task(c, task);
 }
 
-static void handle_list(int sockfd, ClientSession *session, queue_t *task_queue, metadata_t *metadata)
+static void handle_list(conn_t *c, ClientSession *session, metadata_t *metadata)
 {
     if (!session->authenticated)
     {
-        send_response(sockfd, "*** Error: Please login first\n");
+        send_response(c, "*** Error: Please login first\n");
         return;
     }
     // BONUS ---- Priority System Implementation ----
@@ -321,170 +383,255 @@ static void handle_list(int sockfd, ClientSession *session, queue_t *task_queue,
         priority = u->priority;
     }
 
-    task_t local = {0};
-    local.cmd = LIST;
-    local.priority = priority; // FOR PRIORITY IMPLEMENTATION
-    strncpy(local.username, session->username, sizeof(local.username) - 1);
-    local.sock_fd = sockfd;
-
-    enqueue_and_wait(task_queue, &local);
+    task_t *task = new_task(c, LIST, priority);
+    if (task)
+        submit_task(c, task);
 }
 
 // ========================================================
 // Dispatcher
 // ========================================================
-// void handle_commands(int sockfd, const char *buffer, ClientSession *session,
-//                      queue_t *task_queue, metadata_t *metadata)
-// {
-//     char command[10], arg1[50], arg2[50];
-//     int args = sscanf(buffer, "%9s %49s %49s", command, arg1, arg2);
-
-//     if (args < 1)
-//     {
-//         send_response(sockfd, "*** Invalid command\n");
-//         return;
-//     }
-
-//     if (strcmp(command, "signup") == 0)
-//     {
-//         handle_signup(sockfd, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
-//     }
-//     else if (strcmp(command, "login") == 0)
-//     {
-//         handle_login(sockfd, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
-//     }
-//     else if (strcmp(command, "logout") == 0)
-//     {
-//         handle_logout(sockfd, session);
-//     }
-//     else if (strcmp(command, "UPLOAD") == 0)
-//     {
-//         handle_upload(sockfd, args >= 2 ? arg1 : NULL, session, task_queue,metadata);
-//     }
-//     else if (strcmp(command, "DOWNLOAD") == 0)
-//     {
-//         handle_download(sockfd, args >= 2 ? arg1 : NULL, session, task_queue,metadata);
-//     }
-//     else if (strcmp(command, "DELETE") == 0)
-//     {
-//         handle_delete(sockfd, args >= 2 ? arg1 : NULL, session, task_queue,metadata);
-//     }
-//     else if (strcmp(command, "LIST") == 0)
-//     {
-//         handle_list(sockfd, session, task_queue,metadata);
-//     }
-//     else
-//     {
-//         send_response(sockfd, "*** Unknown command\n");
-//     }
-// }
-
-void handle_commands(int sockfd, const char *buffer, ClientSession *session,
-                     queue_t *task_queue, metadata_t *metadata)
-{
-    // Copy buffer (strtok modifies it)
-    char cmd_buffer[1024];
-    strncpy(cmd_buffer, buffer, sizeof(cmd_buffer) - 1);
-    cmd_buffer[sizeof(cmd_buffer) - 1] = '\0';
+#define CMD_MAX_ARG SESSION_NAME_MAX // usernames, passwords and filenames (ClientSession)
 
-    char *line = strtok(cmd_buffer, "\n");
-    while (line != NULL)
+// Split a line on blanks in place: argv[i] point into it, NUL-terminated.
+// Returns the number of tokens stored (at most max; the rest is ignored).
+static int tokenize(char *line, char **argv, int max)
+{
+    int n = 0;
+    char *p = line;
+    while (n < max)
     {
-        // Trim trailing whitespace/newline
-        char *end = line + strlen(line) - 1;
-        while (end > line && (*end == '\r' || *end == '\n' || *end == ' ' || *end == '\t'))
-            *end-- = '\0';
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+        argv[n++] = p;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+        if (!*p)
+            break;
+        *p++ = '\0';
+    }
+    for (int i = n; i < max; i++)
+        argv[i] = NULL;
+    return n;
+}
 
-        if (strlen(line) == 0)
-        {
-            line = strtok(NULL, "\n");
-            continue;
-        }
+// Called by the reactor with one complete, NUL-terminated line
+void handle_command_line(conn_t *c, char *line)
+{
+    ClientSession *session = &c->session;
+    metadata_t *metadata = c->loop->metadata;
 
-        printf("Received line: '%s'\n", line); // Debug—remove after
+    // Trim trailing whitespace/newline
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+        line[--len] = '\0';
 
-        char command[10], arg1[50], arg2[50];
-        int args = sscanf(line, "%9s %49s %49s", command, arg1, arg2);
+    if (len == 0)
+        return;
 
-        if (args < 1)
-        {
-            send_response(sockfd, "*** Invalid command\n");
-            fflush(stdout); // Flush response
-            line = strtok(NULL, "\n");
-            continue;
-        }
+    printf("Received line: '%s'\n", line); // Debug—remove after
 
-        if (strcmp(command, "signup") == 0)
-        {
-            handle_signup(sockfd, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
-            fflush(stdout); // Flush after auth
-        }
-        else if (strcmp(command, "login") == 0)
-        {
-            handle_login(sockfd, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
-            fflush(stdout);
-        }
-        else if (strcmp(command, "logout") == 0)
-        {
-            handle_logout(sockfd, session);
-            fflush(stdout);
-        }
-        else if (strcmp(command, "UPLOAD") == 0)
-        {
-            handle_upload(sockfd, args >= 2 ? arg1 : NULL, session, task_queue, metadata);
-            fflush(stdout);
-        }
-        else if (strcmp(command, "DOWNLOAD") == 0)
-        {
-            handle_download(sockfd, args >= 2 ? arg1 : NULL, session, task_queue, metadata);
-            fflush(stdout);
-        }
-        else if (strcmp(command, "DELETE") == 0)
-        {
-            handle_delete(sockfd, args >= 2 ? arg1 : NULL, session, task_queue, metadata);
-            fflush(stdout);
-        }
-        else if (strcmp(command, "LIST") == 0)
-        {
-            handle_list(sockfd, session, task_queue, metadata);
-            fflush(stdout);
-        }
-        else
+    // Tokens point into the line itself (the connection's input ring)
+    char *argv[3];
+    int args = tokenize(line, argv, 3);
+    char *command = argv[0], *arg1 = argv[1], *arg2 = argv[2];
+
+    if (args < 1)
+    {
+        send_response(c, "*** Invalid command\n");
+        fflush(stdout); // Flush response
+        return;
+    }
+    for (int i = 1; i < args; i++)
+    {
+        if (strlen(argv[i]) > CMD_MAX_ARG)
         {
-            send_response(sockfd, "*** Unknown command\n");
+            send_response(c, "*** Invalid format. Names are limited to 49 characters\n");
             fflush(stdout);
+            return;
         }
+    }
 
-        line = strtok(NULL, "\n");
+    if (strcmp(command, "signup") == 0)
+    {
+        handle_signup(c, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL);
+        fflush(stdout); // Flush after auth
+    }
+    else if (strcmp(command, "login") == 0)
+    {
+        handle_login(c, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
+        fflush(stdout);
     }
+    else if (strcmp(command, "logout") == 0)
+    {
+        handle_logout(c, session);
+        fflush(stdout);
+    }
+    else if (strcmp(command, "BINARY") == 0)
+    {
+        // Switch this connection to length-prefixed frames (protocol.h)
+        send_response(c, "BINARY_OK\n");
+        c->binary = 1;
+    }
+    else if (strcmp(command, "UPLOAD") == 0)
+    {
+        handle_upload(c, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
+        fflush(stdout);
+    }
+    else if (strcmp(command, "DOWNLOAD") == 0)
+    {
+        handle_download(c, args >= 2 ? arg1 : NULL, args == 3 ? arg2 : NULL, session, metadata);
+        fflush(stdout);
+    }
+    else if (strcmp(command, "DELETE") == 0)
+    {
+        handle_delete(c, args >= 2 ? arg1 : NULL, session, metadata);
+        fflush(stdout);
+    }
+    else if (strcmp(command, "LIST") == 0)
+    {
+        handle_list(c, session, metadata);
+        fflush(stdout);
+    }
+    else
+    {
+        send_response(c, "*** Unknown command\n");
+        fflush(stdout);
+    }
+}
+
+int command_is_read(const char *line, size_t len)
+{
+    size_t i = 0, n = 0;
+    while (i < len && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+    while (i + n < len && line[i + n] != ' ' && line[i + n] != '\t' && line[i + n] != '\r')
+        n++;
+    return (n == 8 && memcmp(line + i, "DOWNLOAD", 8) == 0) || (n == 4 && memcmp(line + i, "LIST", 4) == 0);
 }
-void handle_client(int client_sock, queue_t *task_queue, metadata_t *metadata)
+
+// ========================================================
+// Binary protocol front end
+// ========================================================
+
+// UPLOAD / UPLOAD_DELTA frame: the body follows the header directly (no
+// READY handshake), so on early errors it still has to be drained off the
+// socket. A delta reserves its body size here like an upload; the worker
+// settles the difference once the recipe tells the file's real size.
+static void handle_upload_frame(conn_t *c, char *filename, size_t size, metadata_t *metadata)
 {
-    ClientSession session = {0};
-    char buffer[1024];
+    const char *err = NULL;
+    int fd = -1;
+    int in_memory = c->cur_op == PROTO_OP_UPLOAD && store->commit_buffer && size <= store->inline_max;
 
-    while (1)
+    user_t *u = NULL;
+    if (!c->session.authenticated)
+        err = "*** Error: Please login first\n";
+    else if (filename[0] == '\0')
+        err = "*** Invalid format. UPLOAD needs a filename\n";
+    else if (!storage_name_valid(filename))
+        err = "*** Invalid format. Names can't start with '.' or contain '/'\n";
+    else if (metadata_reserve_quota(metadata, c->session.username, size) != 0)
+        err = "*** Error: Quota exceeded\n";
+    else if (in_memory ? conn_stream_to_memory(c, size) != 0
+                       : (fd = open_upload_stage(c->session.username, filename, c->stage_path,
+                                                 sizeof(c->stage_path))) < 0)
     {
-        int n = read(client_sock, buffer, sizeof(buffer) - 1);
-        if (n <= 0)
-            break; // client disconnected
-        buffer[n] = '\0';
-        handle_commands(client_sock, buffer, &session, task_queue, metadata);
+        metadata_release_quota(metadata, c->session.username, size);
+        err = "*** Error: Save failed\n";
     }
 
-    close(client_sock);
+    if (err)
+    {
+        send_response(c, err);
+        conn_stream_to_file(c, -1, size);
+        return;
+    }
+    c->quota_reserved = size;
+
+    c->pending_priority = 1;
+    if (metadata_get_user(metadata, c->session.username, &u) == 0)
+        c->pending_priority = u->priority; // FOR PRIORITY IMPLEMENTATION
+    strncpy(c->pending_file, filename, sizeof(c->pending_file) - 1);
+    c->pending_file[sizeof(c->pending_file) - 1] = '\0';
+    if (!in_memory)
+        conn_stream_to_file(c, fd, size);
 }
 
-// multi cmd per onnection
-// void handle_client(int client_sock, queue_t *task_queue, metadata_t *metadata) {
-//     ClientSession session = {0};
-//     char buffer[1024];
-//     int n;
+// CHUNKS: the stored version's chunk list, for a client about to send a delta
+static void handle_chunks_frame(conn_t *c, char *filename, metadata_t *metadata)
+{
+    if (!c->session.authenticated)
+    {
+        send_response(c, "*** Error: Please login first\n");
+        return;
+    }
+    if (filename[0] == '\0')
+    {
+        send_response(c, "*** Invalid format. CHUNKS needs a filename\n");
+        return;
+    }
+    if (!storage_name_ok(c, filename))
+        return;
 
-//     while ((n = read(client_sock, buffer, sizeof(buffer)-1)) > 0) {  // Loop until disconnect
-//         buffer[n] = '\0';
-//         handle_commands(client_sock, buffer, &session, task_queue, metadata);
-//     }
+    user_t *u = NULL;
+    int priority = 1;
+    if (metadata_get_user(metadata, c->session.username, &u) == 0)
+        priority = u->priority; // FOR PRIORITY IMPLEMENTATION
 
-//     close(client_sock);
-// }
\ No newline at end of file
+    task_t *task = new_task(c, CHUNKS, priority);
+    if (!task)
+        return;
+    strncpy(task->filename, filename, sizeof(task->filename) - 1);
+    submit_task(c, task);
+}
+
+// Called by the reactor with one decoded frame; name and body are
+// NUL-terminated (UPLOAD / UPLOAD_DELTA bodies are streamed and not included)
+void handle_binary_frame(conn_t *c, const proto_hdr_t *hdr, char *name, char *body)
+{
+    ClientSession *session = &c->session;
+    metadata_t *metadata = c->loop->metadata;
+
+    c->cur_op = hdr->opcode;
+    c->cur_req_id = hdr->req_id;
+
+    switch (hdr->opcode)
+    {
+    case PROTO_OP_SIGNUP:
+        handle_signup(c, name[0] ? name : NULL, body[0] ? body : NULL);
+        break;
+    case PROTO_OP_LOGIN:
+        handle_login(c, name[0] ? name : NULL, body[0] ? body : NULL, session, metadata);
+        break;
+    case PROTO_OP_LOGOUT:
+        handle_logout(c, session);
+        break;
+    case PROTO_OP_UPLOAD:
+    case PROTO_OP_UPLOAD_DELTA:
+        handle_upload_frame(c, name, (size_t)hdr->body_len, metadata);
+        break;
+    case PROTO_OP_CHUNKS:
+        handle_chunks_frame(c, name, metadata);
+        break;
+    case PROTO_OP_DOWNLOAD:
+        handle_download(c, name[0] ? name : NULL, "BINARY", session, metadata);
+        break;
+    case PROTO_OP_DELETE:
+        handle_delete(c, name[0] ? name : NULL, session, metadata);
+        break;
+    case PROTO_OP_LIST:
+        handle_list(c, session, metadata);
+        break;
+    default:
+        send_response(c, "*** Unknown command\n");
+        break;
+    }
+}
+
+int frame_is_read(uint8_t opcode)
+{
+    return opcode == PROTO_OP_DOWNLOAD || opcode == PROTO_OP_LIST || opcode == PROTO_OP_CHUNKS;
+}
@@ -1,18 +1,37 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include <stddef.h>
 #include "queue.h"
 #include "metadata.h"
+#include "protocol.h"
+
+#define SESSION_NAME_MAX 49 // longest username a session can hold
 
 typedef struct {
     int authenticated;
-    char username[50];
+    char username[SESSION_NAME_MAX + 1];
 } ClientSession;
 
-void handle_commands(int sockfd, const char *buffer, ClientSession *session, 
-                     queue_t *task_queue, metadata_t *metadata);
+struct conn; // reactor.h
+
+// Entry points for the reactor: one framed command line, the end of an
+// UPLOAD body staged on disk or held in memory (length-announced, or a legacy
+// base64 line decoded as it arrived; err is NULL or the reply for a failed
+// body), or one decoded frame once the connection has switched to the binary
+// protocol.
+void handle_command_line(struct conn *c, char *line);
+void handle_upload_streamed(struct conn *c, const char *err);
+void handle_binary_frame(struct conn *c, const proto_hdr_t *hdr, char *name, char *body);
+// A task is back from the workers, its reply not yet written: a SIGNUP or
+// LOGIN that succeeded opens the session
+struct task;
+void handle_task_done(struct conn *c, const struct task *task);
 
-// ⚠️ Fix here: handle_client now takes pool objects
-void handle_client(int client_sock, queue_t *task_queue, metadata_t *metadata);
+// Commands that only read (DOWNLOAD, LIST, CHUNKS) may be pipelined behind
+// other reads still in flight; anything else waits for the connection to go
+// idle (reactor.h)
+int command_is_read(const char *line, size_t len);
+int frame_is_read(uint8_t opcode);
 
 #endif
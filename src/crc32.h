@@ -0,0 +1,18 @@
+// src/crc32.h
+
+// ---------------------------------------------------------------------------
+// CRC-32 (IEEE 802.3, reflected) for on-disk records: the metadata log and
+// snapshot (meta_log.c) and the packed small-file segments (store_pack.c).
+// crc32_update(0, data, len) is the CRC of data; pass the result back in to
+// extend it.
+// ---------------------------------------------------------------------------
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,247 @@
+// src/file_cache.c
+
+#include "file_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_MAX (64 + 1 + 256) // username/filename
+
+// FNV-1a over the key
+static unsigned int key_hash(const char *key)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+static int make_key(char *key, const char *username, const char *filename)
+{
+    int n = snprintf(key, KEY_MAX + 1, "%s/%s", username, filename);
+    return n > 0 && n <= KEY_MAX ? 0 : -1;
+}
+
+static file_cache_shard_t *shard_of(file_cache_t *c, unsigned int h)
+{
+    return &c->shards[h % FILE_CACHE_SHARDS];
+}
+
+static file_cache_entry_t **bucket_of(file_cache_shard_t *sh, unsigned int h)
+{
+    return &sh->buckets[(h / FILE_CACHE_SHARDS) & (FILE_CACHE_BUCKETS - 1)];
+}
+
+// ---- LRU list (shard lock held) ----
+
+static void lru_unlink(file_cache_shard_t *sh, file_cache_entry_t *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        sh->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        sh->lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(file_cache_shard_t *sh, file_cache_entry_t *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = sh->lru_head;
+    if (sh->lru_head)
+        sh->lru_head->lru_prev = e;
+    else
+        sh->lru_tail = e;
+    sh->lru_head = e;
+}
+
+// Lookup in the shard's chains; 'pp' gets the link pointing at the entry
+static file_cache_entry_t *shard_find(file_cache_shard_t *sh, const char *key, unsigned int h,
+                                      file_cache_entry_t ***pp)
+{
+    file_cache_entry_t **link = bucket_of(sh, h);
+    for (; *link; link = &(*link)->hash_next)
+    {
+        if ((*link)->hash == h && strcmp((*link)->key, key) == 0)
+            break;
+    }
+    if (pp)
+        *pp = link;
+    return *link;
+}
+
+// Take the entry out of the shard; the cache's reference is dropped by the
+// caller after unlocking
+static void shard_remove(file_cache_shard_t *sh, file_cache_entry_t **link)
+{
+    file_cache_entry_t *e = *link;
+    *link = e->hash_next;
+    lru_unlink(sh, e);
+    sh->bytes -= e->size;
+}
+
+void file_cache_release(file_cache_entry_t *e)
+{
+    if (e && atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) == 1)
+        free(e);
+}
+
+// ========================================================
+// API
+// ========================================================
+file_cache_t *file_cache_init(size_t capacity)
+{
+    file_cache_t *c = calloc(1, sizeof(file_cache_t));
+    if (!c)
+        return NULL;
+    for (int i = 0; i < FILE_CACHE_SHARDS; i++)
+    {
+        pthread_mutex_init(&c->shards[i].lock, NULL);
+        c->shards[i].capacity = capacity / FILE_CACHE_SHARDS;
+    }
+    return c;
+}
+
+void file_cache_destroy(file_cache_t *c)
+{
+    if (!c)
+        return;
+
+    unsigned long hits = atomic_load(&c->hits), misses = atomic_load(&c->misses);
+    printf("File cache: %lu hits, %lu misses (%.1f%% hit rate), %lu inserts, %lu evictions, %lu invalidations\n",
+           hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+           (unsigned long)atomic_load(&c->inserts), (unsigned long)atomic_load(&c->evictions),
+           (unsigned long)atomic_load(&c->invalidations));
+
+    for (int i = 0; i < FILE_CACHE_SHARDS; i++)
+    {
+        file_cache_entry_t *e = c->shards[i].lru_head;
+        while (e)
+        {
+            file_cache_entry_t *next = e->lru_next;
+            file_cache_release(e);
+            e = next;
+        }
+        pthread_mutex_destroy(&c->shards[i].lock);
+    }
+    free(c);
+}
+
+file_cache_entry_t *file_cache_get(file_cache_t *c, const char *username, const char *filename)
+{
+    char key[KEY_MAX + 1];
+    if (!c || make_key(key, username, filename) != 0)
+        return NULL;
+    unsigned int h = key_hash(key);
+    file_cache_shard_t *sh = shard_of(c, h);
+
+    pthread_mutex_lock(&sh->lock);
+    file_cache_entry_t *e = shard_find(sh, key, h, NULL);
+    if (e)
+    {
+        atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+        if (sh->lru_head != e)
+        {
+            lru_unlink(sh, e);
+            lru_push_front(sh, e);
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    atomic_fetch_add_explicit(e ? &c->hits : &c->misses, 1, memory_order_relaxed);
+    return e;
+}
+
+unsigned long file_cache_ticket(file_cache_t *c, const char *username, const char *filename)
+{
+    char key[KEY_MAX + 1];
+    if (!c || make_key(key, username, filename) != 0)
+        return 0;
+    file_cache_shard_t *sh = shard_of(c, key_hash(key));
+
+    pthread_mutex_lock(&sh->lock);
+    unsigned long ticket = sh->invalidations;
+    pthread_mutex_unlock(&sh->lock);
+    return ticket;
+}
+
+void file_cache_insert(file_cache_t *c, const char *username, const char *filename,
+                       const unsigned char *data, size_t size, unsigned long ticket)
+{
+    char key[KEY_MAX + 1];
+    if (!c || size > FILE_CACHE_MAX_ENTRY || make_key(key, username, filename) != 0)
+        return;
+    unsigned int h = key_hash(key);
+    file_cache_shard_t *sh = shard_of(c, h);
+    if (size > sh->capacity)
+        return;
+
+    // build outside the lock
+    size_t key_len = strlen(key) + 1;
+    file_cache_entry_t *e = malloc(sizeof(file_cache_entry_t) + key_len + size);
+    if (!e)
+        return;
+    memcpy(e->key, key, key_len);
+    e->data = (unsigned char *)e->key + key_len;
+    memcpy(e->data, data, size);
+    e->size = size;
+    e->hash = h;
+    atomic_init(&e->refs, 1);
+
+    file_cache_entry_t *evicted = NULL; // chained through hash_next
+    pthread_mutex_lock(&sh->lock);
+    file_cache_entry_t **link;
+    if (sh->invalidations != ticket || shard_find(sh, key, h, &link))
+    {
+        // stale read, or another worker filled it first
+        pthread_mutex_unlock(&sh->lock);
+        free(e);
+        return;
+    }
+    e->hash_next = NULL;
+    *link = e;
+    lru_push_front(sh, e);
+    sh->bytes += size;
+
+    while (sh->bytes > sh->capacity)
+    {
+        file_cache_entry_t *victim = sh->lru_tail;
+        file_cache_entry_t **vlink;
+        shard_find(sh, victim->key, victim->hash, &vlink);
+        shard_remove(sh, vlink);
+        victim->hash_next = evicted;
+        evicted = victim;
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    atomic_fetch_add_explicit(&c->inserts, 1, memory_order_relaxed);
+    while (evicted)
+    {
+        file_cache_entry_t *next = evicted->hash_next;
+        file_cache_release(evicted);
+        atomic_fetch_add_explicit(&c->evictions, 1, memory_order_relaxed);
+        evicted = next;
+    }
+}
+
+void file_cache_invalidate(file_cache_t *c, const char *username, const char *filename)
+{
+    char key[KEY_MAX + 1];
+    if (!c || make_key(key, username, filename) != 0)
+        return;
+    unsigned int h = key_hash(key);
+    file_cache_shard_t *sh = shard_of(c, h);
+
+    pthread_mutex_lock(&sh->lock);
+    sh->invalidations++;
+    file_cache_entry_t **link;
+    file_cache_entry_t *e = shard_find(sh, key, h, &link);
+    if (e)
+        shard_remove(sh, link);
+    pthread_mutex_unlock(&sh->lock);
+
+    atomic_fetch_add_explicit(&c->invalidations, 1, memory_order_relaxed);
+    file_cache_release(e);
+}
@@ -0,0 +1,67 @@
+// src/file_cache.h
+
+// ---------------------------------------------------------------------------
+// In-memory cache of small file contents for DOWNLOAD, keyed by user/file.
+// Split into shards by key hash, each with its own lock, hash chains and LRU
+// list, and each bounded to its share of the total byte budget. A hit hands
+// out a reference to an immutable entry, so the copy into the reply happens
+// outside the shard lock and eviction never pulls data from under a reader.
+// UPLOAD and DELETE invalidate the key once the change is on disk; a miss
+// takes the shard's invalidation count before reading the file and its
+// insert is dropped if an invalidation happened meanwhile, so a slow reader
+// can't put back a version that was just replaced.
+// ---------------------------------------------------------------------------
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define FILE_CACHE_BYTES (32 * 1024 * 1024) // total budget
+#define FILE_CACHE_MAX_ENTRY (64 * 1024)    // bigger files are never cached
+#define FILE_CACHE_SHARDS 16
+#define FILE_CACHE_BUCKETS 256              // hash chains per shard, power of two
+
+typedef struct file_cache_entry
+{
+    struct file_cache_entry *hash_next;
+    struct file_cache_entry *lru_prev, *lru_next; // head = most recently used
+    _Atomic int refs;                             // 1 for the cache + 1 per reader
+    unsigned int hash;
+    size_t size;
+    unsigned char *data;                          // follows the key in the same block
+    char key[];                                   // "user/file"
+} file_cache_entry_t;
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    file_cache_entry_t *buckets[FILE_CACHE_BUCKETS];
+    file_cache_entry_t *lru_head, *lru_tail;
+    size_t bytes, capacity;
+    unsigned long invalidations; // bumped by every invalidate in this shard
+} file_cache_shard_t;
+
+typedef struct
+{
+    file_cache_shard_t shards[FILE_CACHE_SHARDS];
+
+    // stats
+    _Atomic unsigned long hits, misses, inserts, evictions, invalidations;
+} file_cache_t;
+
+// API
+file_cache_t *file_cache_init(size_t capacity);
+void file_cache_destroy(file_cache_t *c); // prints the hit rate
+// Referenced entry or NULL; pass it to file_cache_release when done
+file_cache_entry_t *file_cache_get(file_cache_t *c, const char *username, const char *filename);
+void file_cache_release(file_cache_entry_t *e);
+// Miss path: take the ticket before reading the file, insert with it after
+unsigned long file_cache_ticket(file_cache_t *c, const char *username, const char *filename);
+void file_cache_insert(file_cache_t *c, const char *username, const char *filename,
+                       const unsigned char *data, size_t size, unsigned long ticket);
+void file_cache_invalidate(file_cache_t *c, const char *username, const char *filename);
+
+#endif
@@ -1,6 +1,8 @@
 // src/file_io.c
 
 #include "file_io.h"
+#include "store.h"
+#include "io_ring.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +11,13 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+// One path component of our own: dot names belong to the server
+int storage_name_valid(const char* name) {
+    return name && name[0] != '\0' && name[0] != '.' && !strchr(name, '/');
+}
 
 // User dir creation
 int create_user_dir(const char* username) {
@@ -30,53 +39,73 @@ int create_user_dir(const char* username) {
             perror("mkdir user dir");
             return -1;
         }
+        // the files published into it are only as durable as its entry
+        sync_set_t sync = {0};
+        if (sync_set_add_path(&sync, STORAGE_DIR) != 0 || storage_sync(&sync) != 0)
+            return -1;
     }
     return 0;
 }
 
-// Save file to disk
+// Save file to disk: staged and published like a streamed upload, so a
+// concurrent DOWNLOAD sees either the old or the new file, never a mix
 int save_file(const char* username, const char* filename, const unsigned char* data, size_t size) {
     if (!username || !filename || !data) return -1;
-    
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
-    
-    FILE* f = fopen(full_path, "wb");
-    if (!f) {
-        perror("fopen save");
-        return -1;
+
+    if (store->commit_buffer && size <= store->inline_max) {
+        if (commit_upload_buffer(data, size, username, filename) != 0) return -1;
+        printf("  Disk: Saved %s/%s (%zu bytes)\n", username, filename, size);
+        return 0;
     }
-    
-    size_t written = fwrite(data, 1, size, f);
-    fclose(f);
-    
+
+    char stage_path[512];
+    int fd = open_upload_stage(username, filename, stage_path, sizeof(stage_path));
+    if (fd < 0) return -1;
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write save");
+            break;
+        }
+        written += n;
+    }
+    close(fd);
+
     if (written != size) {
         fprintf(stderr, "Write incomplete: %zu/%zu bytes\n", written, size);
+        discard_upload_stage(stage_path);
         return -1;
     }
-    
-    printf("  Disk: Saved %s (%zu bytes)\n", full_path, size);
+    if (commit_upload_stage(stage_path, username, filename) != 0) {
+        discard_upload_stage(stage_path);
+        return -1;
+    }
+
+    printf("  Disk: Saved %s/%s (%zu bytes)\n", username, filename, size);
     return 0;
 }
 
 // Load file from disk
 int load_file(const char* username, const char* filename, unsigned char* data, size_t* size, size_t max_size) {
     if (!username || !filename || !data || !size) return -1;
-    
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
-    
-    FILE* f = fopen(full_path, "rb");
-    if (!f) {
-        perror("fopen load");
+
+    store_file_t f;
+    if (store->open(username, filename, &f) != 0) {
+        fprintf(stderr, "Load failed: %s/%s\n", username, filename);
         return -1;
     }
-    
-    size_t read_size = fread(data, 1, max_size, f);
-    fclose(f);
-    
-    *size = read_size;
-    printf("  Disk: Loaded %s (%zu bytes)\n", full_path, read_size);
+    ssize_t read_size = store_file_read(&f, data, max_size);
+    store_file_close(&f);
+    if (read_size < 0) {
+        fprintf(stderr, "Load failed: %s/%s\n", username, filename);
+        return -1;
+    }
+
+    *size = (size_t)read_size;
+    printf("  Disk: Loaded %s/%s (%zu bytes)\n", username, filename, *size);
     return 0;
 }
 
@@ -87,7 +116,7 @@ int delete_file(const char* username, const char* filename) {
     char full_path[512];
     snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
     
-    if (unlink(full_path) == -1) {
+    if (store->remove(username, filename) == -1) {
         if (errno == ENOENT) {
             fprintf(stderr, "File not found: %s\n", full_path);
         } else {
@@ -126,12 +155,13 @@ int list_user_dir(const char* username, char* output, size_t out_size) {
     char buf[512];
     
     while ((entry = readdir(d)) != NULL) {
-        if (entry->d_type == DT_REG) {  // Files only
-            char full[512];
-            snprintf(full, sizeof(full), FULL_PATH_FORMAT, username, entry->d_name);
+        if (entry->d_type == DT_REG &&
+            strncmp(entry->d_name, STAGE_PREFIX, strlen(STAGE_PREFIX)) != 0) {  // Files only, no in-flight uploads
             struct stat st;
-            if (stat(full, &st) == 0) {
-                snprintf(buf, sizeof(buf), "%s %zu\n", entry->d_name, (size_t)st.st_size);
+            long long size;
+            if (fstatat(dirfd(d), entry->d_name, &st, 0) == 0 &&
+                (size = store->stored_size(dirfd(d), entry->d_name, (size_t)st.st_size)) >= 0) {
+                snprintf(buf, sizeof(buf), "%s %lld\n", entry->d_name, size);
                 strncat(output, buf, out_size - strlen(output) - 1);
             }
         }
@@ -147,13 +177,182 @@ int list_user_dir(const char* username, char* output, size_t out_size) {
 // Get file size
 size_t get_file_size(const char* username, const char* filename) {
     if (!username || !filename) return 0;
-    
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
-    
-    struct stat st;
-    if (stat(full_path, &st) == 0 && S_ISREG(st.st_mode)) {
-        return (size_t)st.st_size;
+
+    store_file_t f;
+    if (store->open(username, filename, &f) != 0)
+        return 0;
+    size_t size = f.size;
+    store_file_close(&f);
+    return size;
+}
+
+// Create the staging file for a streamed upload; returns an O_WRONLY fd
+int open_upload_stage(const char* username, const char* filename, char* stage_path, size_t path_size) {
+    if (!username || !filename || !stage_path) return -1;
+
+    if (create_user_dir(username) != 0) return -1;
+
+    snprintf(stage_path, path_size, USER_DIR_FORMAT "/" STAGE_PREFIX "%s.XXXXXX", username, filename);
+    int fd = mkstemp(stage_path);
+    if (fd < 0) {
+        perror("mkstemp stage");
+        return -1;
+    }
+    return fd;
+}
+
+// ---- Group-committed storage sync ----
+int sync_set_add(sync_set_t* set, int fd) {
+    if (fd < 0) return -1;
+    if (set->count == set->cap) {
+        int cap = set->cap ? set->cap * 2 : 8;
+        int* fds = realloc(set->fds, cap * sizeof(int));
+        if (fds) set->fds = fds;
+        int* res = fds ? realloc(set->res, cap * sizeof(int)) : NULL;
+        if (res) set->res = res;
+        if (!fds || !res) {
+            close(fd);
+            return -1;
+        }
+        set->cap = cap;
+    }
+    set->fds[set->count++] = fd;
+    return 0;
+}
+
+int sync_set_add_path(sync_set_t* set, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC); // files and directories alike
+    if (fd < 0) {
+        perror("open for sync");
+        return -1;
+    }
+    return sync_set_add(set, fd);
+}
+
+int sync_set_add_dup(sync_set_t* set, int fd) {
+    return sync_set_add(set, fcntl(fd, F_DUPFD_CLOEXEC, 0));
+}
+
+void sync_set_release(sync_set_t* set) {
+    for (int i = 0; i < set->count; i++)
+        close(set->fds[i]);
+    free(set->fds);
+    free(set->res);
+    memset(set, 0, sizeof(*set));
+}
+
+// Callers queue up behind the round in flight and the next leader fsyncs
+// every queued set at once, all in flight together through its io_ring:
+// N concurrent uploads cost about two rounds instead of N fsyncs one after
+// another, and only their own files and directories are flushed.
+// Each caller waits on its own record, and the round that covers its ticket
+// settles it with the results of its own fsyncs.
+typedef struct sync_waiter {
+    unsigned long ticket;
+    sync_set_t* set;
+    int settled;
+    struct sync_waiter* next;
+} sync_waiter_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    unsigned long requested; // tickets handed out
+    int running;
+    sync_waiter_t* waiters;  // tickets no round has covered yet
+    unsigned long files;     // stats
+    unsigned long rounds;
+} storage_sync_t;
+
+static storage_sync_t storage_sync_state = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, NULL, 0, 0};
+
+int storage_sync(sync_set_t* set) {
+    storage_sync_t* st = &storage_sync_state;
+    if (set->count == 0)
+        return 0;
+
+    pthread_mutex_lock(&st->lock);
+    sync_waiter_t me = {++st->requested, set, 0, st->waiters}; // our writes are complete by now
+    st->waiters = &me;
+    while (!me.settled) {
+        if (st->running) {
+            // started before our ticket: wait and lead (or join) the next one
+            pthread_cond_wait(&st->done_cond, &st->lock);
+            continue;
+        }
+        st->running = 1;
+        unsigned long upto = st->requested;
+        sync_waiter_t* round = st->waiters; // newer tickets are only pushed in front
+        pthread_mutex_unlock(&st->lock);
+
+        // the waiters' records stay put until settled below
+        unsigned long files = 0;
+        for (sync_waiter_t* w = round; w; w = w->next) {
+            if (w->ticket > upto)
+                continue;
+            for (int i = 0; i < w->set->count; i++, files++)
+                io_ring_fsync(w->set->fds[i], &w->set->res[i]);
+        }
+        io_ring_wait();
+
+        pthread_mutex_lock(&st->lock);
+        st->running = 0;
+        st->rounds++;
+        st->files += files;
+        for (sync_waiter_t** w = &st->waiters; *w;) {
+            if ((*w)->ticket <= upto) {
+                (*w)->settled = 1;
+                *w = (*w)->next;
+            } else {
+                w = &(*w)->next;
+            }
+        }
+        pthread_cond_broadcast(&st->done_cond);
     }
+    pthread_mutex_unlock(&st->lock);
+
+    int err = 0;
+    for (int i = 0; i < set->count; i++) {
+        if (set->res[i] < 0) {
+            fprintf(stderr, "fsync storage: %s\n", strerror(-set->res[i]));
+            err = -1;
+        }
+    }
+    sync_set_release(set);
+    return err;
+}
+
+void storage_sync_stats(unsigned long* requests, unsigned long* files, unsigned long* rounds) {
+    pthread_mutex_lock(&storage_sync_state.lock);
+    *requests = storage_sync_state.requested;
+    *files = storage_sync_state.files;
+    *rounds = storage_sync_state.rounds;
+    pthread_mutex_unlock(&storage_sync_state.lock);
+}
+
+// Publish a finished staging file under its real name through the store
+// backend (atomic replace). Durable on return.
+int commit_upload_stage(const char* stage_path, const char* username, const char* filename) {
+    if (!stage_path || !username || !filename) return -1;
+
+    if (store->commit(stage_path, username, filename) != 0)
+        return -1;
+    printf("  Disk: Committed %s/%s (%s)\n", username, filename, store->name);
+    return 0;
+}
+
+// Publish a body held in memory, for backends that take one (inline_max).
+// Durable on return.
+int commit_upload_buffer(const unsigned char* data, size_t size, const char* username, const char* filename) {
+    if (!data || !username || !filename || !store->commit_buffer) return -1;
+
+    if (store->commit_buffer(data, size, username, filename) != 0)
+        return -1;
+    printf("  Disk: Committed %s/%s (%s, from memory)\n", username, filename, store->name);
     return 0;
-}
\ No newline at end of file
+}
+
+void discard_upload_stage(const char* stage_path) {
+    if (stage_path && stage_path[0])
+        unlink(stage_path);
+}
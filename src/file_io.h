@@ -15,6 +15,12 @@
 #define STORAGE_DIR "./storage"
 #define USER_DIR_FORMAT STORAGE_DIR "/%s"           // e.g ./storage/kay
 #define FULL_PATH_FORMAT USER_DIR_FORMAT "/%s"     // ./storage/kay/lol.txt
+#define STAGE_PREFIX ".upload-"                     // ./storage/kay/.upload-lol.txt.Ab12Cd
+
+// Usernames and filenames are path components under STORAGE_DIR: not empty,
+// no '/', and no leading '.', which is reserved for the server's own entries
+// (upload stages, .chunks, .packs). 1 if name may be used.
+int storage_name_valid(const char* name);
 
 // API 
 int create_user_dir(const char* username);
@@ -23,5 +29,41 @@ int load_file(const char* username, const char* filename, unsigned char* data, s
 int delete_file(const char* username, const char* filename);
 int list_user_dir(const char* username, char* output, size_t out_size);
 size_t get_file_size(const char* username, const char* filename);
+// Zero-copy reads go through the store backend: store->open() (store.h)
+
+// Uploads (streamed and save_file): the body is written to a hidden staging
+// file next to the target and renamed over it once complete, so readers never
+// see a partial file. commit_upload_stage() hands the staging file to the
+// store backend (store.h) and is durable: data is synced before it becomes
+// visible and the publish after it, both group-committed (storage_sync).
+// A body the backend takes from memory (store->inline_max) skips the staging
+// file: commit_upload_buffer() publishes it just as durably.
+int open_upload_stage(const char* username, const char* filename, char* stage_path, size_t path_size);
+int commit_upload_stage(const char* stage_path, const char* username, const char* filename);
+int commit_upload_buffer(const unsigned char* data, size_t size, const char* username, const char* filename);
+void discard_upload_stage(const char* stage_path);
+
+// What one operation needs on disk before it goes on: the files it wrote
+// and the directories whose entries it changed, as fds the set owns.
+typedef struct {
+    int* fds;
+    int* res;   // per-fd fsync result, filled in by storage_sync
+    int count, cap;
+} sync_set_t;
+
+// Add an fd the set takes over (closed if this fails); 0 or -1
+int sync_set_add(sync_set_t* set, int fd);
+// Add a file or directory by path, or a copy of an fd the caller keeps
+int sync_set_add_path(sync_set_t* set, const char* path);
+int sync_set_add_dup(sync_set_t* set, int fd);
+// Close the fds and empty the set without syncing
+void sync_set_release(sync_set_t* set);
+
+// fsync everything in the set, then release it. Group-committed: callers
+// queue their sets behind the round in flight and the next leader fsyncs
+// all of them in one io_ring batch. Nothing outside the sets is flushed.
+// 0, or -1 if any of this set's fsyncs failed.
+int storage_sync(sync_set_t* set);
+void storage_sync_stats(unsigned long* requests, unsigned long* files, unsigned long* rounds);
 
 #endif
\ No newline at end of file
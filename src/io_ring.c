@@ -0,0 +1,449 @@
+// src/io_ring.c
+
+#define _GNU_SOURCE
+#include "io_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if !defined(IO_RING_BLOCKING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IO_RING_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define IO_RING_PATH 256 // longer paths are opened/unlinked in place
+
+static atomic_ulong stat_ops, stat_submits;
+
+// ========================================================
+// Blocking fallback: the request runs when it is queued
+// ========================================================
+static void count_op(void)
+{
+    atomic_fetch_add_explicit(&stat_ops, 1, memory_order_relaxed);
+}
+
+static int result_of(long rc)
+{
+    return rc < 0 ? -errno : (int)rc;
+}
+
+static void run_openat(int dirfd, const char *path, int flags, mode_t mode, int *res)
+{
+    int rc;
+    while ((rc = openat(dirfd, path, flags, mode)) < 0 && errno == EINTR)
+        ;
+    *res = result_of(rc);
+}
+
+static void run_read(int fd, void *buf, size_t len, off_t off, int *res)
+{
+    ssize_t n;
+    while ((n = pread(fd, buf, len, off)) < 0 && errno == EINTR)
+        ;
+    *res = result_of(n);
+}
+
+static void run_write(int fd, const void *buf, size_t len, off_t off, int *res)
+{
+    ssize_t n;
+    while ((n = pwrite(fd, buf, len, off)) < 0 && errno == EINTR)
+        ;
+    *res = result_of(n);
+}
+
+static void run_fsync(int fd, int *res)
+{
+    *res = result_of(fsync(fd));
+}
+
+static void run_unlinkat(int dirfd, const char *path, int flags, int *res)
+{
+    *res = result_of(unlinkat(dirfd, path, flags));
+}
+
+#ifdef IO_RING_URING
+// ========================================================
+// io_uring
+// ========================================================
+typedef struct
+{
+    int *res;
+    char path[IO_RING_PATH];
+} io_slot_t;
+
+typedef struct
+{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+
+    unsigned queued;   // SQEs written, not yet handed to the kernel
+    unsigned inflight; // submitted, completion not reaped yet
+    io_slot_t slots[IO_RING_DEPTH];
+    int free_slots[IO_RING_DEPTH];
+    int nfree;
+} io_ring_t;
+
+static __thread io_ring_t *ring;
+static __thread int ring_state; // 0 = not tried yet, 1 = ring, -1 = blocking
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_int fallback_logged;
+
+static void ring_destroy(void *arg)
+{
+    io_ring_t *r = arg;
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_size);
+    munmap(r->sq_map, r->sq_map_size);
+    close(r->fd);
+    free(r);
+}
+
+static void ring_key_init(void)
+{
+    pthread_key_create(&ring_key, ring_destroy); // closed when the worker exits
+}
+
+// Every opcode used here must be there (openat/read/write: 5.6, unlinkat: 5.11)
+static int ring_probe(int fd)
+{
+    static const int needed[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC,
+                                 IORING_OP_UNLINKAT};
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int ok = probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++)
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok ? 0 : -1;
+}
+
+static io_ring_t *ring_setup(void)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, IO_RING_DEPTH, &p);
+    if (fd < 0)
+        return NULL;
+
+    io_ring_t *r = calloc(1, sizeof(io_ring_t));
+    if (!r || ring_probe(fd) != 0)
+    {
+        free(r);
+        close(fd);
+        errno = ENOTSUP;
+        return NULL;
+    }
+    r->fd = fd;
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+        r->sq_map_size = r->cq_map_size = r->sq_map_size > r->cq_map_size ? r->sq_map_size : r->cq_map_size;
+
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                     IORING_OFF_SQ_RING);
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                              IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED)
+    {
+        int err = errno;
+        if (r->sqes != MAP_FAILED)
+            munmap(r->sqes, r->sqes_size);
+        if (r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+            munmap(r->cq_map, r->cq_map_size);
+        if (r->sq_map != MAP_FAILED)
+            munmap(r->sq_map, r->sq_map_size);
+        close(fd);
+        free(r);
+        errno = err;
+        return NULL;
+    }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // SQE i always sits at index i of the array
+    unsigned *array = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++)
+        array[i] = i;
+    for (int i = 0; i < IO_RING_DEPTH; i++)
+        r->free_slots[i] = IO_RING_DEPTH - 1 - i;
+    r->nfree = IO_RING_DEPTH;
+    return r;
+}
+
+static io_ring_t *thread_ring(void)
+{
+    if (ring_state == 0)
+    {
+        ring = ring_setup();
+        ring_state = ring ? 1 : -1;
+        if (ring)
+        {
+            pthread_once(&ring_key_once, ring_key_init);
+            pthread_setspecific(ring_key, ring);
+        }
+        else if (atomic_exchange(&fallback_logged, 1) == 0)
+        {
+            fprintf(stderr, "io_uring unavailable (%s), storage I/O stays blocking\n", strerror(errno));
+        }
+    }
+    return ring;
+}
+
+static void ring_reap(io_ring_t *r)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        int slot = (int)cqe->user_data;
+        *r->slots[slot].res = cqe->res;
+        r->slots[slot].res = NULL;
+        r->free_slots[r->nfree++] = slot;
+        r->inflight--;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Hand queued SQEs to the kernel and reap completions, until a slot is free
+// (all = 0) or nothing is queued or in flight (all = 1)
+static void ring_run(io_ring_t *r, int all)
+{
+    while (all ? r->queued || r->inflight : r->nfree == 0)
+    {
+        // a full ring waits for half of it back, not one entry at a time
+        unsigned wait = all ? r->queued + r->inflight : (r->queued + r->inflight + 1) / 2;
+        int n = (int)syscall(__NR_io_uring_enter, r->fd, r->queued, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+        atomic_fetch_add_explicit(&stat_submits, 1, memory_order_relaxed);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            // Can't happen short of a bug; anything submitted may still
+            // land in its buffer, so keep the ring (and stop using it)
+            perror("io_uring_enter");
+            for (int i = 0; i < IO_RING_DEPTH; i++)
+                if (r->slots[i].res)
+                    *r->slots[i].res = -EIO;
+            ring_state = -1;
+            ring = NULL;
+            return;
+        }
+        if (n > 0)
+        {
+            r->queued -= n;
+            r->inflight += n;
+        }
+        ring_reap(r);
+    }
+}
+
+// Next free SQE with its slot, or NULL when the thread has no ring
+static struct io_uring_sqe *ring_get(int *res, const char *path, io_ring_t **rp)
+{
+    io_ring_t *r = thread_ring();
+    if (!r || (path && strlen(path) >= IO_RING_PATH))
+        return NULL;
+    if (r->nfree == 0)
+        ring_run(r, 0);
+    if (ring_state != 1)
+        return NULL;
+
+    int slot = r->free_slots[--r->nfree];
+    r->slots[slot].res = res;
+    unsigned tail = *r->sq_tail;
+    struct io_uring_sqe *sqe = &r->sqes[tail & *r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long long)slot;
+    if (path)
+    {
+        strcpy(r->slots[slot].path, path);
+        sqe->addr = (unsigned long long)(uintptr_t)r->slots[slot].path;
+    }
+    *rp = r;
+    return sqe;
+}
+
+static void ring_put(io_ring_t *r)
+{
+    __atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+    r->queued++;
+}
+
+// One request is at most 1 GB: a CQE result is an int
+static unsigned io_len(size_t len)
+{
+    return len < (1u << 30) ? (unsigned)len : 1u << 30;
+}
+
+void io_ring_openat(int dirfd, const char *path, int flags, mode_t mode, int *res)
+{
+    count_op();
+    io_ring_t *r;
+    struct io_uring_sqe *sqe = ring_get(res, path, &r);
+    if (!sqe)
+    {
+        run_openat(dirfd, path, flags, mode, res);
+        return;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dirfd;
+    sqe->len = mode;
+    sqe->open_flags = (unsigned)flags;
+    ring_put(r);
+}
+
+void io_ring_read(int fd, void *buf, size_t len, off_t off, int *res)
+{
+    count_op();
+    io_ring_t *r;
+    struct io_uring_sqe *sqe = ring_get(res, NULL, &r);
+    if (!sqe)
+    {
+        run_read(fd, buf, len, off, res);
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)buf;
+    sqe->len = io_len(len);
+    sqe->off = (unsigned long long)off;
+    ring_put(r);
+}
+
+void io_ring_write(int fd, const void *buf, size_t len, off_t off, int *res)
+{
+    count_op();
+    io_ring_t *r;
+    struct io_uring_sqe *sqe = ring_get(res, NULL, &r);
+    if (!sqe)
+    {
+        run_write(fd, buf, len, off, res);
+        return;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)buf;
+    sqe->len = io_len(len);
+    sqe->off = (unsigned long long)off;
+    ring_put(r);
+}
+
+void io_ring_fsync(int fd, int *res)
+{
+    count_op();
+    io_ring_t *r;
+    struct io_uring_sqe *sqe = ring_get(res, NULL, &r);
+    if (!sqe)
+    {
+        run_fsync(fd, res);
+        return;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    ring_put(r);
+}
+
+void io_ring_unlinkat(int dirfd, const char *path, int flags, int *res)
+{
+    count_op();
+    io_ring_t *r;
+    struct io_uring_sqe *sqe = ring_get(res, path, &r);
+    if (!sqe)
+    {
+        run_unlinkat(dirfd, path, flags, res);
+        return;
+    }
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->fd = dirfd;
+    sqe->unlink_flags = (unsigned)flags;
+    ring_put(r);
+}
+
+void io_ring_wait(void)
+{
+    if (ring_state == 1)
+        ring_run(ring, 1);
+}
+
+const char *io_ring_backend(void)
+{
+    return thread_ring() ? "io_uring" : "blocking";
+}
+
+#else
+// ========================================================
+// Built without io_uring
+// ========================================================
+void io_ring_openat(int dirfd, const char *path, int flags, mode_t mode, int *res)
+{
+    count_op();
+    run_openat(dirfd, path, flags, mode, res);
+}
+
+void io_ring_read(int fd, void *buf, size_t len, off_t off, int *res)
+{
+    count_op();
+    run_read(fd, buf, len, off, res);
+}
+
+void io_ring_write(int fd, const void *buf, size_t len, off_t off, int *res)
+{
+    count_op();
+    run_write(fd, buf, len, off, res);
+}
+
+void io_ring_fsync(int fd, int *res)
+{
+    count_op();
+    run_fsync(fd, res);
+}
+
+void io_ring_unlinkat(int dirfd, const char *path, int flags, int *res)
+{
+    count_op();
+    run_unlinkat(dirfd, path, flags, res);
+}
+
+void io_ring_wait(void)
+{
+}
+
+const char *io_ring_backend(void)
+{
+    return "blocking";
+}
+#endif
+
+void io_ring_stats(unsigned long *ops, unsigned long *submits)
+{
+    *ops = atomic_load(&stat_ops);
+    *submits = atomic_load(&stat_submits);
+}
@@ -0,0 +1,43 @@
+// src/io_ring.h
+
+// ---------------------------------------------------------------------------
+// Batched storage I/O. A caller with many independent syscalls to make (the
+// chunk files of one download or upload, a round of fsyncs, orphans to
+// remove) queues them here and waits once: with io_uring they are all in
+// flight together, so a single worker keeps the device's queue deep instead
+// of paying one round trip per call.
+// Each thread gets its own ring (IO_RING_DEPTH entries), set up on first use
+// through the raw syscalls (no liburing). If the kernel has no io_uring, it
+// is blocked (seccomp, containers) or lacks an opcode, or the build says
+// IO_BACKEND=blocking, every call runs as a plain syscall when queued.
+//
+// Results land in the caller's int once io_ring_wait() returns, in the
+// kernel's convention: >= 0 on success (fd, bytes), -errno on failure.
+// Buffers must stay valid until then; paths are copied. Reads and writes
+// may come back short, like pread/pwrite.
+// ---------------------------------------------------------------------------
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define IO_RING_DEPTH 64 // requests in flight per thread; more queue behind them
+
+void io_ring_openat(int dirfd, const char *path, int flags, mode_t mode, int *res);
+void io_ring_read(int fd, void *buf, size_t len, off_t off, int *res);
+void io_ring_write(int fd, const void *buf, size_t len, off_t off, int *res);
+void io_ring_fsync(int fd, int *res);
+void io_ring_unlinkat(int dirfd, const char *path, int flags, int *res);
+
+// Submit what is queued and wait for everything this thread has in flight
+void io_ring_wait(void);
+
+// "io_uring" or "blocking" for the calling thread
+const char *io_ring_backend(void);
+
+// Requests issued and io_uring_enter calls made, all threads together
+void io_ring_stats(unsigned long *ops, unsigned long *submits);
+
+#endif
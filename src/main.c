@@ -6,18 +6,30 @@
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>
-#include "client_threadpool.h"
+#include "reactor.h"
 #include "worker.h"
 #include "queue.h"
+#include "scheduler.h"
 #include "metadata.h"
+#include "meta_log.h"
+#include "storage_index.h"
+#include "file_io.h"
+#include "store.h"
+#include "file_cache.h"
+#include "base64.h"
+#include "io_ring.h"
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <stdatomic.h>
 
 #define WORKER_POOL_SIZE 3
 #define SERVER_PORT 8080
 
-client_threadpool_t *global_client_pool = NULL;
+reactor_pool_t *global_reactor_pool = NULL;
 queue_t *global_task_queue = NULL;
+scheduler_t *global_scheduler = NULL;
 metadata_t *global_metadata = NULL;
+file_cache_t *global_file_cache = NULL;
 pthread_t worker_threads[WORKER_POOL_SIZE];
 pthread_t accept_thread;
 int server_fd = -1;
@@ -76,7 +88,7 @@ void signal_handler(int sig)
 
 void *accept_connections(void *arg)
 {
-    client_threadpool_t *client_pool = (client_threadpool_t *)arg;
+    reactor_pool_t *reactor_pool = (reactor_pool_t *)arg;
     struct sockaddr_in address;
     socklen_t addrlen = sizeof(address);
     int client_fd;
@@ -105,7 +117,7 @@ void *accept_connections(void *arg)
 
         printf("New client connected, socket descriptor: %d\n", client_fd);
         fflush(stdout);
-        enqueue_socket(client_pool, client_fd);
+        reactor_add_connection(reactor_pool, client_fd);
     }
 
     printf("Accept thread exiting\n");
@@ -113,14 +125,71 @@ void *accept_connections(void *arg)
     return NULL;
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // --reset-password: the operator sets a user's password (the only way
+    // into an account rebuilt from the storage tree) with the server stopped
+    int reset = argc == 4 && strcmp(argv[1], "--reset-password") == 0;
+    if (argc > 1 && !reset)
+    {
+        fprintf(stderr, "Usage: %s [--reset-password <user> <password>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN); // replies to half-closed peers: EPIPE, not death
 
     printf("=== Dropbox Clone Server Starting ===\n");
     fflush(stdout);
 
+    // a chunked DOWNLOAD in flight holds up to CHUNK_OPEN_AHEAD chunk fds
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    global_metadata = metadata_init();
+
+    // reload accounts and file records (or rebuild them from the storage
+    // tree if none were ever saved), then log every change from here on
+    mkdir(STORAGE_DIR, 0700);
+    if (store->init() != 0)
+    {
+        fprintf(stderr, "Failed to open %s store\n", store->name);
+        exit(EXIT_FAILURE);
+    }
+    // older servers kept it inside the storage tree, where a user could reach it
+    if (!meta_log_exists(META_DIR) && meta_log_exists(META_LEGACY_DIR) &&
+        rename(META_LEGACY_DIR, META_DIR) != 0)
+    {
+        perror("Failed to move " META_LEGACY_DIR " to " META_DIR);
+        exit(EXIT_FAILURE);
+    }
+    if (!meta_log_exists(META_DIR))
+        storage_index_build(global_metadata, STORAGE_DIR);
+    meta_log_t *meta_log = meta_log_open(global_metadata, META_DIR);
+    if (!meta_log)
+    {
+        fprintf(stderr, "Failed to open metadata log\n");
+        exit(EXIT_FAILURE);
+    }
+    if (reset)
+    {
+        int rc = metadata_reset_password(global_metadata, argv[2], argv[3]);
+        if (rc == 0)
+            printf("Password of %s reset\n", argv[2]);
+        else
+            fprintf(stderr, "Failed to reset the password of %s%s\n", argv[2],
+                    rc == -1 ? " (no such user, or an invalid password)" : "");
+        meta_log_close(meta_log);
+        metadata_destroy(global_metadata);
+        store->shutdown();
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
         perror("Socket creation failed");
@@ -141,29 +210,32 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 10) < 0)
+    if (listen(server_fd, SOMAXCONN) < 0)
     {
         perror("Listen failed");
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d\n", SERVER_PORT);
+    printf("Server listening on port %d (%s store, %s storage I/O, %s base64)\n", SERVER_PORT, store->name,
+           io_ring_backend(), base64_kernel());
     fflush(stdout);
 
-    global_metadata = metadata_init();
-    global_task_queue = queue_init();
-    global_client_pool = init_client_threadpool(global_task_queue, global_metadata);
+    global_file_cache = file_cache_init(FILE_CACHE_BYTES);
+    global_task_queue = queue_init(); // overflow for full worker deques
+    global_scheduler = scheduler_init(WORKER_POOL_SIZE, global_task_queue);
+    global_reactor_pool = reactor_pool_init(global_scheduler, global_metadata);
 
     worker_args_t wargs[WORKER_POOL_SIZE];
     for (int i = 0; i < WORKER_POOL_SIZE; i++)
     {
-        wargs[i].task_queue = global_task_queue;
+        wargs[i].sched = global_scheduler;
         wargs[i].metadata = global_metadata;
+        wargs[i].cache = global_file_cache;
         wargs[i].id = i + 1;
         pthread_create(&worker_threads[i], NULL, worker_func, &wargs[i]);
     }
 
-    pthread_create(&accept_thread, NULL, accept_connections, global_client_pool);
+    pthread_create(&accept_thread, NULL, accept_connections, global_reactor_pool);
 
     printf("=== Server Ready ===\n");
     fflush(stdout);
@@ -181,25 +253,13 @@ int main()
         server_fd = -1;
     }
 
-    // fix: Signal client threads to stop (with proper locking)
-    if (global_client_pool)
-    {
-        pthread_mutex_lock(&global_client_pool->client_queue.lock);
-        global_client_pool->stop = 1;
-        pthread_cond_broadcast(&global_client_pool->client_queue.not_empty);
-        pthread_mutex_unlock(&global_client_pool->client_queue.lock);
-    }
-
-    // wait for client threads to finish
-    cleanup_client_threadpool(global_client_pool);
-    global_client_pool = NULL;
+    // stop the event loops (connections stay open until workers are gone)
+    reactor_pool_stop(global_reactor_pool);
 
-    // fix: Signal worker threads to stop (with proper locking)
-    if (global_task_queue)
+    // fix: Signal worker threads to stop
+    if (global_scheduler)
     {
-        pthread_mutex_lock(&global_task_queue->lock);
-        pthread_cond_broadcast(&global_task_queue->cond);
-        pthread_mutex_unlock(&global_task_queue->lock);
+        scheduler_wake_all(global_scheduler);
     }
 
     // wait for all worker threads 
@@ -207,8 +267,21 @@ int main()
         pthread_join(worker_threads[i], NULL);
 
     // cleanup resources 
+    reactor_pool_destroy(global_reactor_pool);
+    global_reactor_pool = NULL;
+    scheduler_destroy(global_scheduler);
+
+    unsigned long sync_requests, sync_files, sync_rounds;
+    storage_sync_stats(&sync_requests, &sync_files, &sync_rounds);
+    printf("Storage sync: %lu requests, %lu files fsynced in %lu rounds\n", sync_requests, sync_files, sync_rounds);
+    unsigned long io_ops, io_submits;
+    io_ring_stats(&io_ops, &io_submits);
+    printf("Storage I/O: %lu requests in %lu ring submissions\n", io_ops, io_submits);
     queue_destroy(global_task_queue);
+    file_cache_destroy(global_file_cache);
+    meta_log_close(meta_log); // nothing mutates metadata any more
     metadata_destroy(global_metadata);
+    store->shutdown();
 
     printf("Server shutdown complete\n");
     fflush(stdout);
@@ -0,0 +1,644 @@
+// src/meta_log.c
+
+#include "meta_log.h"
+#include "crc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAP_MAGIC "DBMETA01"
+#define REC_HDR 8 // u32 body length + u32 crc32(body)
+
+// ========================================================
+// Encoding helpers
+// ========================================================
+// Sequential reader over a mapped buffer; any overrun sets 'bad'
+typedef struct
+{
+    const unsigned char *p, *end;
+    int bad;
+} cursor_t;
+
+static void get_bytes(cursor_t *c, void *out, size_t n)
+{
+    if (c->bad || (size_t)(c->end - c->p) < n)
+    {
+        c->bad = 1;
+        memset(out, 0, n);
+        return;
+    }
+    memcpy(out, c->p, n);
+    c->p += n;
+}
+
+// u16 length + bytes, copied NUL-terminated into out[out_size]
+static void get_str(cursor_t *c, char *out, size_t out_size)
+{
+    uint16_t n;
+    get_bytes(c, &n, sizeof(n));
+    if (c->bad || n >= out_size || (size_t)(c->end - c->p) < n)
+    {
+        c->bad = 1;
+        out[0] = '\0';
+        return;
+    }
+    memcpy(out, c->p, n);
+    out[n] = '\0';
+    c->p += n;
+}
+
+static size_t put_str(char *dst, const char *s)
+{
+    uint16_t n = (uint16_t)strlen(s);
+    memcpy(dst, &n, sizeof(n));
+    memcpy(dst + sizeof(n), s, n);
+    return sizeof(n) + n;
+}
+
+static void log_path(const meta_log_t *log, uint64_t gen, char *out, size_t size)
+{
+    snprintf(out, size, "%s/wal-%llu", log->dir, (unsigned long long)gen);
+}
+
+static void fsync_dir(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// ========================================================
+// Append + group commit
+// ========================================================
+uint64_t meta_log_append(meta_log_t *log, int type, const char *user, const char *arg, uint64_t size)
+{
+    if (!log)
+        return 0;
+
+    // type, user, arg, size
+    size_t body = 1 + 2 + strlen(user) + 2 + strlen(arg) + sizeof(uint64_t);
+
+    pthread_mutex_lock(&log->lock);
+    if (log->err)
+    {
+        pthread_mutex_unlock(&log->lock);
+        return META_LSN_FAILED;
+    }
+    if (log->len + REC_HDR + body > log->cap)
+    {
+        size_t cap = log->cap ? log->cap : 64 * 1024;
+        while (cap < log->len + REC_HDR + body)
+            cap *= 2;
+        char *nb = realloc(log->buf, cap);
+        if (!nb)
+        {
+            pthread_mutex_unlock(&log->lock);
+            perror("meta_log: realloc");
+            return META_LSN_FAILED;
+        }
+        log->buf = nb;
+        log->cap = cap;
+    }
+
+    char *rec = log->buf + log->len;
+    char *p = rec + REC_HDR;
+    *p++ = (char)type;
+    p += put_str(p, user);
+    p += put_str(p, arg);
+    memcpy(p, &size, sizeof(size));
+
+    uint32_t blen = (uint32_t)body;
+    uint32_t crc = crc32_update(0, rec + REC_HDR, body);
+    memcpy(rec, &blen, 4);
+    memcpy(rec + 4, &crc, 4);
+    log->len += REC_HDR + body;
+
+    uint64_t lsn = ++log->appended_lsn;
+    pthread_cond_signal(&log->work);
+    pthread_mutex_unlock(&log->lock);
+    return lsn;
+}
+
+int meta_log_wait(meta_log_t *log, uint64_t lsn)
+{
+    if (lsn == META_LSN_FAILED)
+        return -1;
+    if (!log || lsn == 0)
+        return 0;
+    pthread_mutex_lock(&log->lock);
+    while (log->durable_lsn < lsn && !log->err)
+        pthread_cond_wait(&log->durable, &log->lock);
+    int rc = log->durable_lsn >= lsn ? 0 : -1;
+    pthread_mutex_unlock(&log->lock);
+    return rc;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Start generation gen+1. Everything written to the old one was applied in
+// memory before it was appended, so a snapshot taken from now on covers it.
+static int log_next_generation(meta_log_t *log)
+{
+    char path[512];
+    log_path(log, log->gen + 1, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror("meta_log: new generation");
+        return -1;
+    }
+    fsync_dir(log->dir);
+    close(log->fd);
+    log->fd = fd;
+    log->gen++;
+    log->gen_bytes = 0;
+    return 0;
+}
+
+// ... and have the snapshot thread write one that does
+static void log_rotate(meta_log_t *log)
+{
+    if (log_next_generation(log) != 0)
+        return;
+
+    pthread_mutex_lock(&log->lock);
+    log->snap_request = log->gen;
+    pthread_cond_signal(&log->snap_cond);
+    pthread_mutex_unlock(&log->lock);
+}
+
+static void *flusher_thread(void *arg)
+{
+    meta_log_t *log = arg;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;)
+    {
+        while (log->len == 0 && !log->stop)
+            pthread_cond_wait(&log->work, &log->lock);
+        if (log->len == 0 && log->stop)
+            break;
+
+        // take the batch; appenders continue into the spare buffer
+        char *batch = log->buf;
+        size_t batch_len = log->len, batch_cap = log->cap;
+        uint64_t batch_lsn = log->appended_lsn;
+        log->buf = log->spare;
+        log->cap = log->spare_cap;
+        log->spare = batch;
+        log->spare_cap = batch_cap;
+        log->len = 0;
+        pthread_mutex_unlock(&log->lock);
+
+        // after a failed write or sync the file's tail is unknown: a record
+        // appended behind it might not replay, so nothing more is written
+        int err = 0;
+        if (!log->err && (write_all(log->fd, batch, batch_len) != 0 || fdatasync(log->fd) != 0))
+        {
+            err = errno;
+            perror("meta_log: write");
+        }
+        if (!log->err && !err)
+        {
+            log->gen_bytes += batch_len;
+            if (log->gen_bytes >= META_SNAPSHOT_BYTES)
+                log_rotate(log);
+        }
+
+        pthread_mutex_lock(&log->lock);
+        if (err)
+            log->err = err;
+        if (!log->err)
+            log->durable_lsn = batch_lsn;
+        pthread_cond_broadcast(&log->durable);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// ========================================================
+// Snapshots
+// ========================================================
+typedef struct
+{
+    FILE *fp;
+    uint32_t crc;
+} snap_writer_t;
+
+static void snap_put(snap_writer_t *w, const void *data, size_t len)
+{
+    fwrite(data, 1, len, w->fp);
+    w->crc = crc32_update(w->crc, data, len);
+}
+
+static void snap_put_str(snap_writer_t *w, const char *s)
+{
+    uint16_t n = (uint16_t)strlen(s);
+    snap_put(w, &n, sizeof(n));
+    snap_put(w, s, n);
+}
+
+// Write the whole store as of now, tagged with the first log generation that
+// must be replayed on top of it
+static int snapshot_write(meta_log_t *log, uint64_t gen)
+{
+    metadata_t *m = log->meta;
+    double start = now_ms();
+
+    // the arena only grows: collect the users that exist right now
+    pthread_mutex_lock(&m->meta_lock);
+    uint64_t num_users = m->num_users;
+    user_t **users = malloc(sizeof(user_t *) * (num_users ? num_users : 1));
+    if (!users)
+    {
+        pthread_mutex_unlock(&m->meta_lock);
+        return -1;
+    }
+    size_t n = 0;
+    for (user_chunk_t *chunk = m->user_chunks; chunk; chunk = chunk->next)
+        for (int i = 0; i < chunk->used; i++)
+            users[n++] = &chunk->users[i];
+    pthread_mutex_unlock(&m->meta_lock);
+
+    char tmp[512], path[512];
+    snprintf(tmp, sizeof(tmp), "%s/snapshot.tmp", log->dir);
+    snprintf(path, sizeof(path), "%s/snapshot", log->dir);
+    snap_writer_t w = {fopen(tmp, "w"), 0};
+    if (!w.fp)
+    {
+        perror("meta_log: snapshot");
+        free(users);
+        return -1;
+    }
+
+    uint64_t total_files = 0;
+    snap_put(&w, SNAP_MAGIC, 8);
+    snap_put(&w, &gen, sizeof(gen));
+    snap_put(&w, &num_users, sizeof(num_users));
+    for (size_t i = 0; i < n; i++)
+    {
+        user_t *u = users[i];
+        snap_put_str(&w, u->username);
+        // a password reset racing with us is in the log after this generation
+        snap_put_str(&w, atomic_load_explicit(&u->unclaimed, memory_order_acquire) ? "" : u->credential);
+
+        pthread_rwlock_rdlock(&u->user_lock);
+        uint32_t nfiles = u->num_files;
+        snap_put(&w, &nfiles, sizeof(nfiles));
+        for (file_t *f = u->first_file; f; f = f->next)
+        {
+            uint64_t size = f->size;
+            snap_put_str(&w, f->filename);
+            snap_put(&w, &size, sizeof(size));
+        }
+        pthread_rwlock_unlock(&u->user_lock);
+        total_files += nfiles;
+    }
+    uint32_t crc = w.crc;
+    fwrite(&crc, 1, sizeof(crc), w.fp);
+    free(users);
+
+    int ok = fflush(w.fp) == 0 && fsync(fileno(w.fp)) == 0;
+    ok = (fclose(w.fp) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        perror("meta_log: snapshot write");
+        unlink(tmp);
+        return -1;
+    }
+    fsync_dir(log->dir);
+
+    // generations before 'gen' are fully contained in the snapshot now
+    for (uint64_t g = log->snap_gen; g < gen; g++)
+    {
+        char old[512];
+        log_path(log, g, old, sizeof(old));
+        unlink(old);
+    }
+    log->snap_gen = gen;
+
+    printf("Metadata snapshot: %llu users, %llu files in %.1f ms (log generation %llu)\n",
+           (unsigned long long)num_users, (unsigned long long)total_files,
+           now_ms() - start, (unsigned long long)gen);
+    fflush(stdout);
+    return 0;
+}
+
+static void *snapshot_thread(void *arg)
+{
+    meta_log_t *log = arg;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;)
+    {
+        while (!log->snap_request && !log->stop)
+            pthread_cond_wait(&log->snap_cond, &log->lock);
+        if (log->stop)
+            break;
+        uint64_t gen = log->snap_request;
+        log->snap_request = 0;
+        pthread_mutex_unlock(&log->lock);
+
+        snapshot_write(log, gen);
+
+        pthread_mutex_lock(&log->lock);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// ========================================================
+// Recovery
+// ========================================================
+static void *map_file(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *p = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            p = NULL;
+        else
+            *len = st.st_size;
+    }
+    close(fd);
+    return p;
+}
+
+// Returns the generation to replay from, 0 if there is no snapshot
+static uint64_t snapshot_load(meta_log_t *log, uint64_t *files)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/snapshot", log->dir);
+    size_t len = 0;
+    const unsigned char *map = map_file(path, &len);
+    if (!map)
+        return 0;
+
+    uint32_t crc = 0;
+    if (len < 8 + 16 + sizeof(crc) || memcmp(map, SNAP_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "meta_log: %s is not a snapshot, ignoring it\n", path);
+        munmap((void *)map, len);
+        return 0;
+    }
+    memcpy(&crc, map + len - sizeof(crc), sizeof(crc));
+    if (crc32_update(0, map, len - sizeof(crc)) != crc)
+    {
+        fprintf(stderr, "meta_log: snapshot checksum mismatch, ignoring it\n");
+        munmap((void *)map, len);
+        return 0;
+    }
+
+    cursor_t c = {map + 8, map + len - sizeof(crc), 0};
+    uint64_t gen, num_users;
+    get_bytes(&c, &gen, sizeof(gen));
+    get_bytes(&c, &num_users, sizeof(num_users));
+
+    char user[64], credential[CREDENTIAL_LEN + 1], name[1024];
+    for (uint64_t i = 0; i < num_users && !c.bad; i++)
+    {
+        uint32_t nfiles;
+        get_str(&c, user, sizeof(user));
+        get_str(&c, credential, sizeof(credential));
+        get_bytes(&c, &nfiles, sizeof(nfiles));
+        if (c.bad)
+            break;
+        metadata_restore_user(log->meta, user, credential);
+        for (uint32_t k = 0; k < nfiles && !c.bad; k++)
+        {
+            uint64_t size;
+            get_str(&c, name, sizeof(name));
+            get_bytes(&c, &size, sizeof(size));
+            if (!c.bad)
+                metadata_add_file(log->meta, user, name, size);
+        }
+        *files += nfiles;
+    }
+    munmap((void *)map, len);
+    return gen;
+}
+
+// Apply one generation's records; returns the byte length of the valid prefix
+static size_t log_replay(meta_log_t *log, const unsigned char *map, size_t len, uint64_t *records)
+{
+    size_t off = 0;
+    char user[64], arg[1024];
+
+    while (len - off >= REC_HDR)
+    {
+        uint32_t blen, crc;
+        memcpy(&blen, map + off, 4);
+        memcpy(&crc, map + off + 4, 4);
+        if (blen > len - off - REC_HDR || crc32_update(0, map + off + REC_HDR, blen) != crc)
+            break; // torn or garbage tail
+
+        cursor_t c = {map + off + REC_HDR, map + off + REC_HDR + blen, 0};
+        unsigned char type;
+        uint64_t size;
+        get_bytes(&c, &type, 1);
+        get_str(&c, user, sizeof(user));
+        get_str(&c, arg, sizeof(arg));
+        get_bytes(&c, &size, sizeof(size));
+        if (c.bad)
+            break;
+
+        if (type == META_REC_SIGNUP)
+            metadata_restore_user(log->meta, user, arg);
+        else if (type == META_REC_ADD_FILE)
+            metadata_add_file(log->meta, user, arg, size);
+        else if (type == META_REC_REMOVE_FILE)
+            metadata_remove_file(log->meta, user, arg);
+
+        off += REC_HDR + blen;
+        (*records)++;
+    }
+    return off;
+}
+
+static int recover(meta_log_t *log)
+{
+    double start = now_ms();
+    uint64_t files = 0, records = 0;
+    metadata_t *m = log->meta;
+
+    m->recovering = 1; // replay what was accepted, no quota checks
+    uint64_t gen = snapshot_load(log, &files);
+    log->snap_gen = gen;
+
+    // replay wal-<gen>, wal-<gen+1>, ... ; the last one stays open for appends
+    for (;;)
+    {
+        char path[512], next[512];
+        log_path(log, gen, path, sizeof(path));
+        log_path(log, gen + 1, next, sizeof(next));
+
+        size_t len = 0, valid = 0;
+        const unsigned char *map = map_file(path, &len);
+        if (map)
+        {
+            valid = log_replay(log, map, len, &records);
+            munmap((void *)map, len);
+        }
+        if (access(next, F_OK) == 0)
+        {
+            gen++;
+            continue;
+        }
+
+        if (valid < len)
+        {
+            fprintf(stderr, "meta_log: dropping %zu torn bytes at the end of %s\n", len - valid, path);
+            if (truncate(path, valid) != 0)
+                perror("meta_log: truncate");
+        }
+        log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        log->gen = gen;
+        log->gen_bytes = valid;
+        break;
+    }
+    m->recovering = 0;
+
+    if (log->fd < 0)
+    {
+        perror("meta_log: open log");
+        return -1;
+    }
+    printf("Metadata recovered: %d users, %llu snapshot files + %llu log records in %.1f ms\n",
+           m->num_users, (unsigned long long)files, (unsigned long long)records, now_ms() - start);
+    fflush(stdout);
+    return 0;
+}
+
+// ========================================================
+// Open / close
+// ========================================================
+int meta_log_exists(const char *dir)
+{
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/snapshot", dir);
+    if (stat(path, &st) == 0)
+        return 1;
+    // without a snapshot, replay starts at generation 0
+    snprintf(path, sizeof(path), "%s/wal-0", dir);
+    return stat(path, &st) == 0 && st.st_size > 0;
+}
+
+meta_log_t *meta_log_open(metadata_t *m, const char *dir)
+{
+    meta_log_t *log = calloc(1, sizeof(meta_log_t));
+    if (!log)
+        return NULL;
+    log->meta = m;
+    log->fd = -1;
+    snprintf(log->dir, sizeof(log->dir), "%s", dir);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+    {
+        perror("meta_log: mkdir");
+        free(log);
+        return NULL;
+    }
+
+    int preloaded = m->num_users > 0; // e.g. rebuilt by the storage indexer
+    if (recover(log) != 0)
+    {
+        free(log);
+        return NULL;
+    }
+    // state that did not come from this directory is only durable once a
+    // snapshot holds it; the current generation replays on top of it.
+    // Plaintext passwords were hashed on load: a snapshot past every
+    // generation that still holds them deletes those.
+    if (m->legacy_passwords && log_next_generation(log) == 0)
+    {
+        printf("Metadata: hashed %d plaintext passwords\n", m->legacy_passwords);
+        snapshot_write(log, log->gen);
+    }
+    else if (preloaded)
+        snapshot_write(log, log->gen);
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->work, NULL);
+    pthread_cond_init(&log->durable, NULL);
+    pthread_cond_init(&log->snap_cond, NULL);
+    pthread_create(&log->flusher, NULL, flusher_thread, log);
+    pthread_create(&log->snapshotter, NULL, snapshot_thread, log);
+
+    m->log = log; // from here on every change is logged
+    return log;
+}
+
+void meta_log_close(meta_log_t *log)
+{
+    if (!log)
+        return;
+
+    pthread_mutex_lock(&log->lock);
+    log->stop = 1;
+    pthread_cond_signal(&log->work);
+    pthread_cond_signal(&log->snap_cond);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->flusher, NULL);
+    pthread_join(log->snapshotter, NULL);
+
+    // a fresh snapshot makes the next start a plain load; the old log is
+    // only deleted once the snapshot that covers it is in place
+    log->meta->log = NULL;
+    if (log->gen_bytes > 0 || log->snap_gen < log->gen)
+    {
+        uint64_t gen = log->gen + 1;
+        char path[512];
+        log_path(log, gen, path, sizeof(path));
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd >= 0)
+        {
+            close(fd);
+            snapshot_write(log, gen);
+        }
+    }
+
+    close(log->fd);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->work);
+    pthread_cond_destroy(&log->durable);
+    pthread_cond_destroy(&log->snap_cond);
+    free(log->buf);
+    free(log->spare);
+    free(log);
+}
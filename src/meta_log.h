@@ -0,0 +1,86 @@
+// src/meta_log.h
+
+// ---------------------------------------------------------------------------
+// Metadata persistence: write-ahead log + periodic snapshots.
+//
+// Every signup / file add / file remove appends one record to the current log
+// generation (META_DIR/wal-<gen>). A flusher thread writes and
+// fdatasync()s whatever has accumulated, so concurrent writers share a single
+// sync (group commit); a mutating call returns once its record is durable.
+//
+// When a log generation passes META_SNAPSHOT_BYTES the flusher starts a new
+// one and the snapshot thread writes the whole store to a temp file, fsyncs
+// it and renames it over "snapshot", then deletes the older generations.
+// Records are idempotent (set user / set file size / drop file), so replaying
+// a generation on top of a snapshot that already saw part of it is safe.
+//
+// Recovery: mmap the snapshot, load it, replay wal-<snapshot gen> onward and
+// cut a torn tail off the last log. Users already in the store when the log
+// is opened (a cold-start rebuild) are snapshotted straight away, and so are
+// plaintext passwords from before credentials were hashed, so that no
+// generation holding them survives the start.
+// ---------------------------------------------------------------------------
+
+#ifndef META_LOG_H
+#define META_LOG_H
+
+#include "metadata.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Beside STORAGE_DIR, not in it: nothing a client can name reaches it
+#define META_DIR "./metadata"
+#define META_LEGACY_DIR "./storage/.metadata" // where older servers kept it
+#ifndef META_SNAPSHOT_BYTES
+#define META_SNAPSHOT_BYTES (4 * 1024 * 1024) // log size that triggers a snapshot
+#endif
+
+enum {
+    META_REC_SIGNUP = 1, // user, credential
+    META_REC_ADD_FILE,   // user, filename, size
+    META_REC_REMOVE_FILE // user, filename
+};
+
+typedef struct meta_log
+{
+    metadata_t *meta;
+    char dir[256];
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // flusher: records pending / stop
+    pthread_cond_t durable; // writers: durable_lsn moved
+    char *buf, *spare;      // appenders fill buf; the flusher swaps and writes
+    size_t len, cap, spare_cap;
+    uint64_t appended_lsn;  // last record put in buf
+    uint64_t durable_lsn;   // last record synced to disk
+    int err;                // errno of a failed write / sync: the log takes no more
+                            // records, and those not durable by then never will be
+    int fd;                 // current log generation, flusher-owned
+    uint64_t gen;
+    size_t gen_bytes;
+    int stop;
+
+    // snapshot thread
+    pthread_cond_t snap_cond;
+    uint64_t snap_request;  // generation a snapshot should cover up to (0 = none)
+    uint64_t snap_gen;      // generation of the snapshot on disk
+
+    pthread_t flusher, snapshotter;
+} meta_log_t;
+
+// Load dir (snapshot + logs) into m, then start logging m's changes there
+meta_log_t *meta_log_open(metadata_t *m, const char *dir);
+// 1 if dir holds persisted metadata (a snapshot or a non-empty first log)
+int meta_log_exists(const char *dir);
+// Final snapshot, stop threads, detach from the metadata
+void meta_log_close(meta_log_t *log);
+
+// Used by metadata.c: append while holding the lock that ordered the change,
+// wait after dropping it. append returns the record's LSN (0 = not logged,
+// META_LSN_FAILED = could not be logged); wait returns 0 once the record is
+// durable, -1 if it never will be.
+#define META_LSN_FAILED UINT64_MAX
+uint64_t meta_log_append(meta_log_t *log, int type, const char *user, const char *arg, uint64_t size);
+int meta_log_wait(meta_log_t *log, uint64_t lsn);
+
+#endif
@@ -1,27 +1,223 @@
 // src/metadata.c
 
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np
 #include "metadata.h"
+#include "meta_log.h"
+#include "file_io.h" // storage_name_valid
 #include <stdio.h>  // snprintf
 #include <string.h> // strcmp/strncpy
 #include <stdlib.h> // malloc
+#include <sys/random.h> // getrandom
+
+#define USER_INDEX_INITIAL 256
+#define FILE_INDEX_INITIAL 8
+#define FILE_CHUNK_INITIAL 4
+#define INTERN_INITIAL 64
+
+// FNV-1a, for usernames and filenames
+static unsigned int name_hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+// ---- Filename interning ----
+// Shard by the low hash bits, bucket by the rest.
+
+static const char *intern_get(metadata_t *m, const char *str, unsigned int h)
+{
+    intern_shard_t *sh = &m->names[h % INTERN_SHARDS];
+    unsigned int bh = h / INTERN_SHARDS;
+
+    pthread_mutex_lock(&sh->lock);
+    if (sh->cap)
+    {
+        for (name_t *n = sh->buckets[bh & (sh->cap - 1)]; n; n = n->next)
+        {
+            if (n->hash == h && strcmp(n->str, str) == 0)
+            {
+                n->refs++;
+                pthread_mutex_unlock(&sh->lock);
+                return n->str;
+            }
+        }
+    }
+
+    if (sh->count >= sh->cap)
+    {
+        unsigned int cap = sh->cap ? sh->cap * 2 : INTERN_INITIAL;
+        name_t **buckets = calloc(cap, sizeof(name_t *));
+        if (!buckets)
+        {
+            pthread_mutex_unlock(&sh->lock);
+            return NULL;
+        }
+        for (unsigned int i = 0; i < sh->cap; i++)
+        {
+            name_t *n = sh->buckets[i];
+            while (n)
+            {
+                name_t *next = n->next;
+                name_t **b = &buckets[(n->hash / INTERN_SHARDS) & (cap - 1)];
+                n->next = *b;
+                *b = n;
+                n = next;
+            }
+        }
+        free(sh->buckets);
+        sh->buckets = buckets;
+        sh->cap = cap;
+    }
+
+    size_t len = strlen(str);
+    name_t *n = malloc(sizeof(name_t) + len + 1);
+    if (!n)
+    {
+        pthread_mutex_unlock(&sh->lock);
+        return NULL;
+    }
+    memcpy(n->str, str, len + 1);
+    n->hash = h;
+    n->refs = 1;
+    name_t **b = &sh->buckets[bh & (sh->cap - 1)];
+    n->next = *b;
+    *b = n;
+    sh->count++;
+    pthread_mutex_unlock(&sh->lock);
+    return n->str;
+}
+
+static void intern_put(metadata_t *m, const char *str)
+{
+    name_t *n = (name_t *)(str - offsetof(name_t, str));
+    intern_shard_t *sh = &m->names[n->hash % INTERN_SHARDS];
+
+    pthread_mutex_lock(&sh->lock);
+    if (--n->refs == 0)
+    {
+        name_t **pp = &sh->buckets[(n->hash / INTERN_SHARDS) & (sh->cap - 1)];
+        while (*pp != n)
+            pp = &(*pp)->next;
+        *pp = n->next;
+        sh->count--;
+        free(n);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+// ---- User index ----
+
+static user_index_t *user_index_new(unsigned int cap)
+{
+    user_index_t *ix = malloc(sizeof(user_index_t) + cap * sizeof(_Atomic(user_t *)));
+    if (!ix)
+        return NULL;
+    ix->retired = NULL;
+    ix->cap = cap;
+    for (unsigned int i = 0; i < cap; i++)
+        atomic_init(&ix->slots[i], NULL);
+    return ix;
+}
+
+// Lock-free: returns the user or NULL, plus the empty slot where it would go.
+// Load stays <= 1/2, so the probe always ends at an empty slot.
+static user_t *user_index_find(user_index_t *ix, const char *username, unsigned int h, unsigned int *empty_slot)
+{
+    for (unsigned int slot = h & (ix->cap - 1);; slot = (slot + 1) & (ix->cap - 1))
+    {
+        user_t *u = atomic_load_explicit(&ix->slots[slot], memory_order_acquire);
+        if (!u)
+        {
+            if (empty_slot)
+                *empty_slot = slot;
+            return NULL;
+        }
+        if (u->hash == h && strcmp(u->username, username) == 0)
+            return u;
+    }
+}
+
+// Caller holds meta_lock. The new table is filled before it is published.
+static user_index_t *user_index_grow(metadata_t *m, user_index_t *old)
+{
+    user_index_t *ix = user_index_new(old->cap * 2);
+    if (!ix)
+        return NULL;
+    for (unsigned int i = 0; i < old->cap; i++)
+    {
+        user_t *u = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+        unsigned int slot;
+        if (u && !user_index_find(ix, u->username, u->hash, &slot))
+            atomic_store_explicit(&ix->slots[slot], u, memory_order_relaxed);
+    }
+    ix->retired = old;
+    atomic_store_explicit(&m->index, ix, memory_order_release);
+    return ix;
+}
+
+static user_t *user_lookup(metadata_t *m, const char *username)
+{
+    user_index_t *ix = atomic_load_explicit(&m->index, memory_order_acquire);
+    return user_index_find(ix, username, name_hash(username), NULL);
+}
+
+// Next user_t from the arena. Caller holds meta_lock.
+static user_t *user_alloc(metadata_t *m)
+{
+    user_chunk_t *chunk = m->user_chunks;
+    if (!chunk || chunk->used == USER_ARENA_CHUNK)
+    {
+        chunk = malloc(sizeof(user_chunk_t));
+        if (!chunk)
+            return NULL;
+        chunk->used = 0;
+        chunk->next = m->user_chunks;
+        m->user_chunks = chunk;
+    }
+    return &chunk->users[chunk->used++];
+}
 
 // Metadata initialization
 metadata_t *metadata_init(void)
 {
-    metadata_t *m = malloc(sizeof(metadata_t));
+    metadata_t *m = calloc(1, sizeof(metadata_t));
     if (!m)
         return NULL;
 
+    user_index_t *ix = user_index_new(USER_INDEX_INITIAL);
+    if (!ix)
+    {
+        free(m);
+        return NULL;
+    }
+    atomic_init(&m->index, ix);
+    m->user_chunks = NULL;
     m->num_users = 0;
     pthread_mutex_init(&m->meta_lock, NULL);
+    // a steady stream of LIST/DOWNLOAD readers must not starve uploads
+    pthread_rwlockattr_init(&m->user_lock_attr);
+    pthread_rwlockattr_setkind_np(&m->user_lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    for (int i = 0; i < INTERN_SHARDS; i++)
+        pthread_mutex_init(&m->names[i].lock, NULL);
 
-    // Initialize per-user locks
-    for (int i = 0; i < MAX_USERS; i++)
+    return m;
+}
+
+static void user_release(user_t *u)
+{
+    file_chunk_t *chunk = u->file_chunks;
+    while (chunk)
     {
-        pthread_mutex_init(&m->users[i].user_lock, NULL);
+        file_chunk_t *next = chunk->next;
+        for (int i = 0; i < chunk->used; i++)
+            pthread_mutex_destroy(&chunk->files[i].file_lock);
+        free(chunk);
+        chunk = next;
     }
-
-    return m;
+    free(u->file_index);
+    pthread_rwlock_destroy(&u->user_lock);
 }
 
 // Metadata destroy
@@ -30,42 +226,194 @@ void metadata_destroy(metadata_t *m)
     if (!m)
         return;
 
-    pthread_mutex_destroy(&m->meta_lock);
-    for (int i = 0; i < MAX_USERS; i++)
+    user_chunk_t *chunk = m->user_chunks;
+    while (chunk)
     {
-        pthread_mutex_destroy(&m->users[i].user_lock);
+        user_chunk_t *next = chunk->next;
+        for (int i = 0; i < chunk->used; i++)
+            user_release(&chunk->users[i]);
+        free(chunk);
+        chunk = next;
     }
+
+    user_index_t *ix = atomic_load(&m->index);
+    while (ix)
+    {
+        user_index_t *older = ix->retired;
+        free(ix);
+        ix = older;
+    }
+
+    // interned names die with their pool, whatever their refcount
+    for (int s = 0; s < INTERN_SHARDS; s++)
+    {
+        intern_shard_t *sh = &m->names[s];
+        for (unsigned int i = 0; i < sh->cap; i++)
+        {
+            name_t *n = sh->buckets[i];
+            while (n)
+            {
+                name_t *next = n->next;
+                free(n);
+                n = next;
+            }
+        }
+        free(sh->buckets);
+        pthread_mutex_destroy(&sh->lock);
+    }
+
+    pthread_mutex_destroy(&m->meta_lock);
+    pthread_rwlockattr_destroy(&m->user_lock_attr);
     free(m);
 }
 
-// Add user with password
-int metadata_add_user(metadata_t *m, const char *username, const char *password)
+// ========================================================
+// Credentials
+// ========================================================
+static void hex_encode(const unsigned char *in, size_t len, char *out)
 {
-    if (!m || !username || !password)
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++)
+    {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 15];
+    }
+    out[2 * len] = '\0';
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// "<salt hex>$<hash hex>", lowercase
+static int credential_valid(const char *cred)
+{
+    if (strlen(cred) != CREDENTIAL_LEN || cred[2 * PASSWORD_SALT_SIZE] != '$')
+        return 0;
+    for (int i = 0; i < CREDENTIAL_LEN; i++)
+        if (i != 2 * PASSWORD_SALT_SIZE && hex_digit(cred[i]) < 0)
+            return 0;
+    return 1;
+}
+
+static void credential_build(const unsigned char salt[PASSWORD_SALT_SIZE], const char *password,
+                             char out[CREDENTIAL_LEN + 1])
+{
+    size_t len = strlen(password);
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_ctx_t ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, salt, PASSWORD_SALT_SIZE);
+    sha256_update(&ctx, password, len);
+    sha256_final(&ctx, digest);
+    for (int i = 1; i < PASSWORD_ROUNDS; i++)
+    {
+        sha256_init(&ctx);
+        sha256_update(&ctx, digest, sizeof(digest));
+        sha256_update(&ctx, salt, PASSWORD_SALT_SIZE);
+        sha256_update(&ctx, password, len);
+        sha256_final(&ctx, digest);
+    }
+
+    hex_encode(salt, PASSWORD_SALT_SIZE, out);
+    out[2 * PASSWORD_SALT_SIZE] = '$';
+    sha256_hex(digest, out + 2 * PASSWORD_SALT_SIZE + 1);
+}
+
+// New credential with a fresh salt; 0 or -1
+static int credential_make(const char *password, char out[CREDENTIAL_LEN + 1])
+{
+    unsigned char salt[PASSWORD_SALT_SIZE];
+    if (getrandom(salt, sizeof(salt), 0) != (ssize_t)sizeof(salt))
+    {
+        perror("metadata: getrandom");
         return -1;
-    if (m->num_users >= MAX_USERS || strlen(username) >= 64 || strlen(password) >= 64)
+    }
+    credential_build(salt, password, out);
+    return 0;
+}
+
+static int credential_matches(const char *cred, const char *password)
+{
+    if (!credential_valid(cred))
+        return 0;
+    unsigned char salt[PASSWORD_SALT_SIZE];
+    for (int i = 0; i < PASSWORD_SALT_SIZE; i++)
+        salt[i] = (unsigned char)(hex_digit(cred[2 * i]) << 4 | hex_digit(cred[2 * i + 1]));
+
+    char expect[CREDENTIAL_LEN + 1];
+    credential_build(salt, password, expect);
+    unsigned char diff = 0; // every byte, so the time doesn't tell where they differ
+    for (int i = 0; i < CREDENTIAL_LEN; i++)
+        diff |= (unsigned char)(expect[i] ^ cred[i]);
+    return diff == 0;
+}
+
+// ========================================================
+// Users
+// ========================================================
+// Add user with a credential ("" = unclaimed). An existing user is only
+// given the new credential when 'replace' is set: recovery replaying a later
+// record, or an operator's reset.
+static int user_add(metadata_t *m, const char *username, const char *credential, int replace)
+{
+    if (strlen(username) >= 64 || !storage_name_valid(username))
         return -1;
 
+    unsigned int h = name_hash(username);
+    unsigned int slot;
+
     pthread_mutex_lock(&m->meta_lock);
 
     // Check if user already exists
-    for (int i = 0; i < m->num_users; i++)
+    user_index_t *ix = atomic_load_explicit(&m->index, memory_order_relaxed);
+    user_t *existing = user_index_find(ix, username, h, &slot);
+    if (existing)
     {
-        if (strcmp(m->users[i].username, username) == 0)
+        if (!credential[0] || !replace)
         {
             pthread_mutex_unlock(&m->meta_lock);
             return -2; // User exists
         }
+        memcpy(existing->credential, credential, strlen(credential) + 1);
+        atomic_store_explicit(&existing->unclaimed, 0, memory_order_release);
+        uint64_t lsn = meta_log_append(m->log, META_REC_SIGNUP, username, credential, 0);
+        pthread_mutex_unlock(&m->meta_lock);
+        return meta_log_wait(m->log, lsn) == 0 ? 0 : -3;
     }
 
-    user_t *u = &m->users[m->num_users];
+    // keep the load at or under 1/2
+    if ((unsigned int)(m->num_users + 1) * 2 > ix->cap)
+    {
+        ix = user_index_grow(m, ix);
+        if (!ix)
+        {
+            pthread_mutex_unlock(&m->meta_lock);
+            return -1;
+        }
+        user_index_find(ix, username, h, &slot);
+    }
+
+    user_t *u = user_alloc(m);
+    if (!u)
+    {
+        pthread_mutex_unlock(&m->meta_lock);
+        return -1;
+    }
+    memset(u, 0, sizeof(*u));
+    u->hash = h;
     strncpy(u->username, username, 63);
     u->username[63] = '\0';
-    strncpy(u->password, password, 63);
-    u->password[63] = '\0';
-    u->num_files = 0;
-    u->quota_used = 0;
+    memcpy(u->credential, credential, strlen(credential) + 1);
     u->quota_max = DEFAULT_QUOTA;
+    atomic_init(&u->unclaimed, credential[0] == '\0');
+    pthread_rwlock_init(&u->user_lock, &m->user_lock_attr);
 
     // BONUS ---- Priority System Implementation ----
     if (strncmp(username, "admin_", 6) == 0)
@@ -83,8 +431,57 @@ int metadata_add_user(metadata_t *m, const char *username, const char *password)
 
     m->num_users++;
 
+    // publish only once every field above is written
+    atomic_store_explicit(&ix->slots[slot], u, memory_order_release);
+
+    uint64_t lsn = meta_log_append(m->log, META_REC_SIGNUP, username, credential, 0);
     pthread_mutex_unlock(&m->meta_lock);
-    return 0;
+    return meta_log_wait(m->log, lsn) == 0 ? 0 : -3;
+}
+
+// Add user with password: only its credential is kept
+int metadata_add_user(metadata_t *m, const char *username, const char *password)
+{
+    if (!m || !username || !password)
+        return -1;
+    if (strlen(password) >= 64)
+        return -1;
+
+    char credential[CREDENTIAL_LEN + 1] = "";
+    if (password[0] && credential_make(password, credential) != 0)
+        return -1;
+    return user_add(m, username, credential, 0);
+}
+
+int metadata_restore_user(metadata_t *m, const char *username, const char *credential)
+{
+    if (!m || !username || !credential)
+        return -1;
+
+    // written before passwords were hashed: hash it now, the next snapshot
+    // replaces the plaintext
+    char hashed[CREDENTIAL_LEN + 1];
+    if (credential[0] && !credential_valid(credential))
+    {
+        if (strlen(credential) >= 64 || credential_make(credential, hashed) != 0)
+            return -1;
+        credential = hashed;
+        m->legacy_passwords++;
+    }
+    return user_add(m, username, credential, 1);
+}
+
+int metadata_reset_password(metadata_t *m, const char *username, const char *password)
+{
+    if (!m || !username || !password || !password[0] || strlen(password) >= 64)
+        return -1;
+    if (!user_lookup(m, username))
+        return -1;
+
+    char credential[CREDENTIAL_LEN + 1];
+    if (credential_make(password, credential) != 0)
+        return -1;
+    return user_add(m, username, credential, 1);
 }
 
 // Get user (returns pointer to user in metadata)
@@ -93,18 +490,11 @@ int metadata_get_user(metadata_t *m, const char *username, user_t **user)
     if (!m || !username || !user)
         return -1;
 
-    pthread_mutex_lock(&m->meta_lock);
-    for (int i = 0; i < m->num_users; i++)
-    {
-        if (strcmp(m->users[i].username, username) == 0)
-        {
-            *user = &m->users[i];
-            pthread_mutex_unlock(&m->meta_lock);
-            return 0;
-        }
-    }
-    pthread_mutex_unlock(&m->meta_lock);
-    return -1;
+    user_t *u = user_lookup(m, username);
+    if (!u)
+        return -1;
+    *user = u;
+    return 0;
 }
 
 // Authenticate user
@@ -113,17 +503,11 @@ int metadata_authenticate(metadata_t *m, const char *username, const char *passw
     if (!m || !username || !password)
         return 0;
 
-    pthread_mutex_lock(&m->meta_lock);
-    for (int i = 0; i < m->num_users; i++)
-    {
-        if (strcmp(m->users[i].username, username) == 0 &&
-            strcmp(m->users[i].password, password) == 0)
-        {
-            pthread_mutex_unlock(&m->meta_lock);
-            return 1; // Success
-        }
-    }
-    pthread_mutex_unlock(&m->meta_lock);
+    // credential is immutable once the user is published and claimed
+    user_t *u = user_lookup(m, username);
+    if (u && !atomic_load_explicit(&u->unclaimed, memory_order_acquire) &&
+        credential_matches(u->credential, password))
+        return 1; // Success
     return 0; // Failed
 }
 
@@ -133,139 +517,306 @@ int metadata_check_quota(metadata_t *m, const char *username, size_t add_size)
     user_t *u;
     if (metadata_get_user(m, username, &u) != 0)
         return 0;
+    return atomic_load_explicit(&u->quota_used, memory_order_relaxed) + add_size <= u->quota_max;
+}
+
+// ---- Quota accounting ----
 
-    pthread_mutex_lock(&u->user_lock);
-    int ok = (u->quota_used + add_size <= u->quota_max) ? 1 : 0;
-    pthread_mutex_unlock(&u->user_lock);
-    return ok;
+// Add 'size' to quota_used unless that passes quota_max (recovery: always)
+static int quota_charge(metadata_t *m, user_t *u, size_t size)
+{
+    size_t used = atomic_load_explicit(&u->quota_used, memory_order_relaxed);
+    do
+    {
+        if (!m->recovering && (size > u->quota_max || used > u->quota_max - size))
+            return -2;
+    } while (!atomic_compare_exchange_weak_explicit(&u->quota_used, &used, used + size,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return 0;
 }
 
-// Add file
-int metadata_add_file(metadata_t *m, const char *username, const char *filename, size_t size)
+int metadata_reserve_quota(metadata_t *m, const char *username, size_t size)
 {
     user_t *u;
     if (metadata_get_user(m, username, &u) != 0)
         return -1;
+    return quota_charge(m, u, size);
+}
 
-    pthread_mutex_lock(&u->user_lock); // Per-user lock
+void metadata_release_quota(metadata_t *m, const char *username, size_t size)
+{
+    user_t *u;
+    if (size && metadata_get_user(m, username, &u) == 0)
+        atomic_fetch_sub_explicit(&u->quota_used, size, memory_order_relaxed);
+}
 
-    size_t old_size = 0;
-    // Check if file already exists
-    for (int i = 0; i < u->num_files; i++)
+// ---- Per-user file index (caller holds u->user_lock: read for lookups, write to change) ----
+
+// Index position holding 'filename', or the empty position where it would go
+static unsigned int file_index_pos(user_t *u, const char *filename, unsigned int h, file_t **found)
+{
+    unsigned int mask = u->file_index_cap - 1;
+    unsigned int pos = h & mask;
+    *found = NULL;
+    while (u->file_index[pos])
     {
-        if (strcmp(u->files[i].filename, filename) == 0)
+        file_t *f = u->file_index[pos];
+        if (f->hash == h && strcmp(f->filename, filename) == 0)
         {
-            old_size = u->files[i].size;
-            if (u->quota_used - old_size + size > u->quota_max)
-            { // Check delta
-                pthread_mutex_unlock(&u->user_lock);
-                return -2; // Would exceed quota
-            }
-            // Lock file for update (per-design)
-            pthread_mutex_lock(&u->files[i].file_lock);
-            u->quota_used = u->quota_used - old_size + size;
-            u->files[i].size = size;
-            pthread_mutex_unlock(&u->files[i].file_lock); // Quick unlock
-            pthread_mutex_unlock(&u->user_lock);
-            return 0;
+            *found = f;
+            return pos;
         }
+        pos = (pos + 1) & mask;
     }
+    return pos;
+}
 
-    if (u->num_files >= MAX_FILES_PER_USER)
-    {
-        pthread_mutex_unlock(&u->user_lock);
+static file_t *file_find(user_t *u, const char *filename)
+{
+    file_t *f = NULL;
+    if (u->file_index_cap)
+        file_index_pos(u, filename, name_hash(filename), &f);
+    return f;
+}
+
+// Make room for one more entry, keeping the load under 3/4
+static int file_index_reserve(user_t *u)
+{
+    if ((u->num_files + 1) * 4 <= u->file_index_cap * 3)
+        return 0;
+
+    unsigned int cap = u->file_index_cap ? u->file_index_cap * 2 : FILE_INDEX_INITIAL;
+    file_t **index = calloc(cap, sizeof(file_t *));
+    if (!index)
         return -1;
+    for (unsigned int i = 0; i < u->file_index_cap; i++)
+    {
+        file_t *f = u->file_index[i];
+        if (!f)
+            continue;
+        unsigned int pos = f->hash & (cap - 1);
+        while (index[pos])
+            pos = (pos + 1) & (cap - 1);
+        index[pos] = f;
     }
+    free(u->file_index);
+    u->file_index = index;
+    u->file_index_cap = cap;
+    return 0;
+}
 
-    if (u->quota_used + size > u->quota_max)
+// A record from the free list, or carved from the user's arena
+static file_t *file_alloc(user_t *u)
+{
+    file_t *f = u->free_file;
+    if (f)
     {
-        pthread_mutex_unlock(&u->user_lock);
-        return -2; // Quota exceeded
+        u->free_file = f->next;
+        return f;
     }
 
-    file_t *f = &u->files[u->num_files];
-    strncpy(f->filename, filename, sizeof(f->filename) - 1); // Safer
-    f->filename[sizeof(f->filename) - 1] = '\0';
-    f->size = size;
-
-    // Initializing the file lock
+    file_chunk_t *chunk = u->file_chunks;
+    if (!chunk || chunk->used == chunk->cap)
+    {
+        int cap = chunk ? chunk->cap * 2 : FILE_CHUNK_INITIAL;
+        if (cap > FILE_ARENA_MAX_CHUNK)
+            cap = FILE_ARENA_MAX_CHUNK;
+        chunk = malloc(sizeof(file_chunk_t) + cap * sizeof(file_t));
+        if (!chunk)
+            return NULL;
+        chunk->cap = cap;
+        chunk->used = 0;
+        chunk->next = u->file_chunks;
+        u->file_chunks = chunk;
+    }
+    f = &chunk->files[chunk->used++];
     pthread_mutex_init(&f->file_lock, NULL);
-    f->locked = 1;
+    return f;
+}
 
+// Create a record at the end of the listing; NULL when out of memory
+static file_t *file_insert(metadata_t *m, user_t *u, const char *filename, unsigned int h)
+{
+    if (file_index_reserve(u) != 0)
+        return NULL;
+    file_t *f = file_alloc(u);
+    if (!f)
+        return NULL;
+    f->filename = intern_get(m, filename, h);
+    if (!f->filename)
+    {
+        f->next = u->free_file;
+        u->free_file = f;
+        return NULL;
+    }
+    f->hash = h;
+    f->size = 0;
+    f->prev = u->last_file;
+    f->next = NULL;
+    if (u->last_file)
+        u->last_file->next = f;
+    else
+        u->first_file = f;
+    u->last_file = f;
+
+    file_t *dup;
+    u->file_index[file_index_pos(u, filename, h, &dup)] = f;
     u->num_files++;
-    u->quota_used += size;
+    return f;
+}
 
-    pthread_mutex_unlock(&u->user_lock);
-    return 0;
+// Drop the record at index position 'pos'. Entries after it in the probe run
+// move back into the hole unless that would put them before their home slot.
+static void file_erase(metadata_t *m, user_t *u, unsigned int pos)
+{
+    unsigned int mask = u->file_index_cap - 1;
+    file_t *f = u->file_index[pos];
+
+    unsigned int hole = pos;
+    for (unsigned int j = (pos + 1) & mask; u->file_index[j]; j = (j + 1) & mask)
+    {
+        unsigned int home = u->file_index[j]->hash & mask;
+        // j may fill the hole only if its home is not inside (hole, j]
+        int stays = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (!stays)
+        {
+            u->file_index[hole] = u->file_index[j];
+            hole = j;
+        }
+    }
+    u->file_index[hole] = NULL;
+
+    if (f->prev)
+        f->prev->next = f->next;
+    else
+        u->first_file = f->next;
+    if (f->next)
+        f->next->prev = f->prev;
+    else
+        u->last_file = f->prev;
+
+    intern_put(m, f->filename);
+    f->filename = NULL;
+    f->next = u->free_file;
+    u->free_file = f;
+    u->num_files--;
 }
 
-// Remove file
-int metadata_remove_file(metadata_t *m, const char *username, const char *filename)
+// Add file
+int metadata_add_file(metadata_t *m, const char *username, const char *filename, size_t size)
+{
+    return metadata_commit_file(m, username, filename, size, 0);
+}
+
+// Add or resize a file. The new size is owed minus what the old version held
+// and what the caller reserved up front; a positive rest is charged (and may
+// fail), a negative one is given back.
+int metadata_commit_file(metadata_t *m, const char *username, const char *filename, size_t size, size_t reserved)
 {
     user_t *u;
     if (metadata_get_user(m, username, &u) != 0)
         return -1;
 
-    pthread_mutex_lock(&u->user_lock);
+    unsigned int h = name_hash(filename);
+
+    pthread_rwlock_wrlock(&u->user_lock); // Per-user lock
+
+    file_t *f = file_find(u, filename);
+    size_t credit = reserved + (f ? f->size : 0);
+    if (size > credit && quota_charge(m, u, size - credit) != 0)
+    {
+        pthread_rwlock_unlock(&u->user_lock);
+        return -2; // Would exceed quota
+    }
 
-    // find and remove
-    for (int i = 0; i < u->num_files; i++)
+    if (!f)
     {
-        if (strcmp(u->files[i].filename, filename) == 0)
+        f = file_insert(m, u, filename, h);
+        if (!f)
         {
-            // atmomic : subtract quota *before* shitf or destroy
-            u->quota_used -= u->files[i].size;
+            if (size > credit)
+                atomic_fetch_sub_explicit(&u->quota_used, size - credit, memory_order_relaxed);
+            pthread_rwlock_unlock(&u->user_lock);
+            return -1; // out of memory
+        }
+    }
+    if (size < credit)
+        atomic_fetch_sub_explicit(&u->quota_used, credit - size, memory_order_relaxed);
 
-            if (u->files[i].locked)
-            {
-                pthread_mutex_destroy(&u->files[i].file_lock); // Destroy file lock before removal
-                u->files[i].locked = 0;
-            }
+    // Lock file for update (per-design)
+    pthread_mutex_lock(&f->file_lock);
+    f->size = size;
+    pthread_mutex_unlock(&f->file_lock); // Quick unlock
 
-            // Shift to remove (simple array delete)
-            for (int j = i; j < u->num_files - 1; j++)
-            {
-                u->files[j] = u->files[j + 1];
-            }
-            u->num_files--;
-            pthread_mutex_unlock(&u->user_lock);
-            return 0; // fatehhh
-        }
+    uint64_t lsn = meta_log_append(m->log, META_REC_ADD_FILE, username, filename, size);
+    pthread_rwlock_unlock(&u->user_lock);
+    return meta_log_wait(m->log, lsn) == 0 ? 0 : -3;
+}
+
+// Remove file
+int metadata_remove_file(metadata_t *m, const char *username, const char *filename)
+{
+    user_t *u;
+    if (metadata_get_user(m, username, &u) != 0)
+        return -1;
+
+    file_t *f = NULL;
+    unsigned int pos = 0;
+    pthread_rwlock_wrlock(&u->user_lock);
+
+    if (u->file_index_cap)
+        pos = file_index_pos(u, filename, name_hash(filename), &f);
+    if (!f)
+    {
+        pthread_rwlock_unlock(&u->user_lock);
+        return -1; // Not found
     }
 
-    pthread_mutex_unlock(&u->user_lock);
-    return -1; // Not found
+    // the record and its lock stay in place; the slot is simply reused later
+    atomic_fetch_sub_explicit(&u->quota_used, f->size, memory_order_relaxed);
+    file_erase(m, u, pos);
+
+    uint64_t lsn = meta_log_append(m->log, META_REC_REMOVE_FILE, username, filename, 0);
+    pthread_rwlock_unlock(&u->user_lock);
+    return meta_log_wait(m->log, lsn) == 0 ? 0 : -3;
 }
 
 // List files
-void metadata_list_files(metadata_t *m, const char *username, char *output, size_t out_size)
+char *metadata_list_files(metadata_t *m, const char *username, size_t *out_len)
 {
     user_t *u;
     if (metadata_get_user(m, username, &u) != 0)
+        return NULL;
+
+    pthread_rwlock_rdlock(&u->user_lock);
+
+    // size first: name + ' ' + up to 20 digits + '\n'
+    size_t cap = sizeof("No files\n");
+    for (file_t *f = u->first_file; f; f = f->next)
+        cap += strlen(f->filename) + 22;
+
+    char *output = malloc(cap);
+    if (!output)
     {
-        strncpy(output, "ERROR: User not found\n", out_size - 1);
-        output[out_size - 1] = '\0';
-        return;
+        pthread_rwlock_unlock(&u->user_lock);
+        return NULL;
     }
 
-    pthread_mutex_lock(&u->user_lock);
-
-    output[0] = '\0';
-    char buf[512];
-    if (u->num_files == 0)
+    size_t len = 0;
+    if (!u->first_file)
     {
-        strncat(output, "No files\n", out_size - strlen(output) - 1);
+        len = snprintf(output, cap, "No files\n");
     }
     else
     {
-        for (int i = 0; i < u->num_files; i++)
-        {
-            snprintf(buf, sizeof(buf), "%s %zu\n", u->files[i].filename, u->files[i].size);
-            strncat(output, buf, out_size - strlen(output) - 1);
-        }
+        for (file_t *f = u->first_file; f; f = f->next)
+            len += snprintf(output + len, cap - len, "%s %zu\n", f->filename, f->size);
     }
 
-    pthread_mutex_unlock(&u->user_lock);
+    pthread_rwlock_unlock(&u->user_lock);
+    if (out_len)
+        *out_len = len;
+    return output;
 }
 
 // Returns pointer to file if found, NULL otherwise
@@ -276,21 +827,14 @@ file_t *metadata_get_and_lock_file(metadata_t *m, const char *username, const ch
     if (metadata_get_user(m, username, &u) != 0)
         return NULL;
 
-    pthread_mutex_lock(&u->user_lock);
+    pthread_rwlock_rdlock(&u->user_lock);
 
-    for (int i = 0; i < u->num_files; i++)
-    {
-        if (strcmp(u->files[i].filename, filename) == 0)
-        {
-            file_t *f = &u->files[i];
-            pthread_mutex_lock(&f->file_lock); // Lock the file
-            pthread_mutex_unlock(&u->user_lock);
-            return f;
-        }
-    }
+    file_t *f = file_find(u, filename);
+    if (f)
+        pthread_mutex_lock(&f->file_lock); // Lock the file
 
-    pthread_mutex_unlock(&u->user_lock);
-    return NULL; // File not found
+    pthread_rwlock_unlock(&u->user_lock);
+    return f; // NULL = File not found
 }
 
 // ADD THIS to unlock a file
@@ -300,4 +844,4 @@ void metadata_unlock_file(file_t *f)
     {
         pthread_mutex_unlock(&f->file_lock);
     }
-}
\ No newline at end of file
+}
@@ -1,8 +1,17 @@
 // src/metadata.h
 
 // ---------------------------------------------------------------------------
-// Simple in-memory store for user data: username → files array + quota tracking.
-// Fixed arrays (no dynamic alloc for simplicity). Enforces per-user quotas (1MB default).
+// In-memory store for user data: username → files + quota tracking.
+// Grows on demand: users and file records are carved from arenas (stable
+// addresses, never moved), both hash indexes resize themselves, and
+// filenames are interned so a name shared by many files is stored once.
+// Enforces per-user quotas (1MB default).
+// Durable when a meta_log is attached (see meta_log.h): every change is
+// logged before the call returns. A change the log could not make durable
+// is still applied in memory and reported as -3.
+// Reads never block each other: user lookup, login and quota reservations
+// are lock-free, and LIST / file lookups share the user's rwlock; only adding
+// or removing a file takes it exclusively, and only for that user.
 // ---------------------------------------------------------------------------
 
 #ifndef METADATA_H
@@ -10,51 +19,152 @@
 
 #include <stddef.h> // size_t
 #include <pthread.h>
+#include <stdatomic.h>
+#include "sha256.h"
 
-#define MAX_USERS 100
-#define MAX_FILES_PER_USER 50
 #define DEFAULT_QUOTA (1024 * 1024) // 1MB
+#define USER_ARENA_CHUNK 256        // user_t records per arena chunk
+#define FILE_ARENA_MAX_CHUNK 256    // per-user file chunks double from 4 up to this
+#define INTERN_SHARDS 16            // filename pool shards (own mutex each)
 
-typedef struct
+// Passwords are only ever kept as a credential, "<salt hex>$<hash hex>": the
+// hash is SHA-256 iterated PASSWORD_ROUNDS times over a random salt. That is
+// what user records, the log and snapshots hold.
+#define PASSWORD_SALT_SIZE 16
+#ifndef PASSWORD_ROUNDS
+#define PASSWORD_ROUNDS 1000
+#endif
+#define CREDENTIAL_LEN (2 * PASSWORD_SALT_SIZE + 1 + 2 * SHA256_DIGEST_SIZE)
+
+// Interned filename, shared by every file record with the same name
+typedef struct name
 {
-    char filename[256];
+    struct name *next; // pool bucket chain
+    unsigned int hash;
+    unsigned int refs; // protected by the pool shard lock
+    char str[];
+} name_t;
+
+// A file record is carved from its user's arena and never moved or copied,
+// so a file_t * and its mutex stay valid while in use; removed records go on
+// the user's free list and are reused.
+typedef struct file
+{
+    const char *filename;      // interned (name_t str)
     size_t size;
     pthread_mutex_t file_lock; // so that multiple users wont update or delete file at a time (avoiding race condition)
-    int locked;                // traking if locked is initialized
+                               // initialized once with the record, destroyed with the metadata
+    unsigned int hash;         // of filename
+    struct file *prev, *next;  // listing order (insertion), or free list via next
 } file_t;
 
+typedef struct file_chunk
+{
+    struct file_chunk *next;
+    int cap, used;
+    file_t files[];
+} file_chunk_t;
+
 typedef struct
 {
     char username[64];
-    char password[64]; // For authentication
-    file_t files[MAX_FILES_PER_USER];
+    char credential[CREDENTIAL_LEN + 1]; // For authentication; "" while unclaimed
+    _Atomic int unclaimed; // found on disk by the storage indexer, no account yet:
+                           // login fails until an operator sets a password
+                           // (metadata_reset_password)
+    unsigned int hash; // of username, checked before strcmp in the index
     int num_files;
-    size_t quota_used;
+    file_t *first_file, *last_file; // listing order
+    file_t *free_file;              // recycled records
+    file_chunk_t *file_chunks;      // arena: every record ever carved for this user
+
+    // filename -> record, linear probing with backward-shift deletion: no
+    // tombstones, lookups stay short. Doubles at 3/4 load. user_lock.
+    file_t **file_index;
+    unsigned int file_index_cap; // power of two, 0 until the first file
+    // committed file sizes + outstanding upload reservations; changed with
+    // CAS so a reservation never needs user_lock
+    _Atomic size_t quota_used;
     size_t quota_max;
-    pthread_mutex_t user_lock; // Per-user lock for Phase 2
+    pthread_rwlock_t user_lock; // Per-user lock: shared for lookups/LIST, exclusive for add/remove
     // BONUS ---- Priority System Implementation ----
-    int priority; // User Priority Level 
-    
+    int priority; // User Priority Level
+
 } user_t;
 
+typedef struct user_chunk
+{
+    struct user_chunk *next;
+    int used;
+    user_t users[USER_ARENA_CHUNK];
+} user_chunk_t;
+
+// username -> user, linear probing. Users are never removed, so a slot goes
+// from NULL to a fully built user exactly once. Readers probe without the
+// lock (acquire loads vs the writer's release stores). To grow, the writer
+// builds a bigger table and publishes it; old tables stay allocated until
+// metadata_destroy since a reader may still be walking one.
+typedef struct user_index
+{
+    struct user_index *retired; // older, smaller tables
+    unsigned int cap;           // power of two
+    _Atomic(user_t *) slots[];
+} user_index_t;
+
+struct meta_log;
+
 typedef struct
 {
-    user_t users[MAX_USERS];
+    pthread_mutex_t lock;
+    name_t **buckets;
+    unsigned int cap, count;
+} intern_shard_t;
+
+typedef struct
+{
+    user_chunk_t *user_chunks; // arena, newest chunk first
     int num_users;
-    pthread_mutex_t meta_lock; // Global metadata lock
+    pthread_mutex_t meta_lock; // Global metadata lock (writers: signup)
+    pthread_rwlockattr_t user_lock_attr; // writer-preferring
+    _Atomic(user_index_t *) index;
+
+    intern_shard_t names[INTERN_SHARDS];
+
+    struct meta_log *log; // NULL = in-memory only
+    int recovering;       // replaying the log: quota is not re-checked
+    int legacy_passwords; // plaintext passwords found while recovering (hashed on load)
 } metadata_t;
 
 // API: Basic CRUD + quota + authentication
 metadata_t *metadata_init(void);
 void metadata_destroy(metadata_t *m);
+// 0 = created, -2 = exists (unclaimed users included: a signup never takes
+// over files found on disk), -1 = error (also for a name that isn't a valid
+// storage name, see storage_name_valid()), -3 = not durable.
+// An empty password creates an unclaimed user.
 int metadata_add_user(metadata_t *m, const char *username, const char *password);
+// Same with a credential as stored in the log / a snapshot ("" = unclaimed);
+// a later record for an existing user replaces its credential
+int metadata_restore_user(metadata_t *m, const char *username, const char *credential);
+// Operator only, with nothing else using the store (server --reset-password):
+// give an existing user, claimed or not, a new password. -1 = no such user.
+int metadata_reset_password(metadata_t *m, const char *username, const char *password);
 int metadata_get_user(metadata_t *m, const char *username, user_t **user);
 int metadata_authenticate(metadata_t *m, const char *username, const char *password);
 int metadata_add_file(metadata_t *m, const char *username, const char *filename, size_t size);
+// Upload quota: reserve the announced size before any byte is written, then
+// either commit the file against the reservation or release it.
+int metadata_reserve_quota(metadata_t *m, const char *username, size_t size); // 0, -2 = over, -1 = no user
+void metadata_release_quota(metadata_t *m, const char *username, size_t size);
+// add_file that consumes 'reserved' bytes of reservation on success (only the
+// difference to 'size' is charged); on error the reservation is still held,
+// except for -3, which applied the change
+int metadata_commit_file(metadata_t *m, const char *username, const char *filename, size_t size, size_t reserved);
 int metadata_remove_file(metadata_t *m, const char *username, const char *filename);
-void metadata_list_files(metadata_t *m, const char *username, char *output, size_t out_size);
+// "<name> <size>\n" per file (or "No files\n"); malloc'd, caller frees. NULL on error.
+char *metadata_list_files(metadata_t *m, const char *username, size_t *out_len);
 int metadata_check_quota(metadata_t *m, const char *username, size_t add_size); // 1=ok, 0=over
 file_t *metadata_get_and_lock_file(metadata_t *m, const char *username, const char *filename);
 void metadata_unlock_file(file_t *f);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,42 @@
+// src/protocol.c
+
+#include "protocol.h"
+
+uint64_t proto_get_be(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+void proto_put_be(unsigned char *p, uint64_t v, int n)
+{
+    for (int i = n - 1; i >= 0; i--)
+    {
+        p[i] = v & 0xFF;
+        v >>= 8;
+    }
+}
+
+int proto_decode_hdr(const unsigned char *buf, proto_hdr_t *hdr)
+{
+    if (buf[0] != PROTO_MAGIC)
+        return -1;
+    hdr->opcode = buf[1];
+    hdr->status = (uint16_t)proto_get_be(buf + 2, 2);
+    hdr->req_id = (uint32_t)proto_get_be(buf + 4, 4);
+    hdr->name_len = (uint32_t)proto_get_be(buf + 8, 4);
+    hdr->body_len = proto_get_be(buf + 12, 8);
+    return 0;
+}
+
+void proto_encode_hdr(unsigned char *buf, const proto_hdr_t *hdr)
+{
+    buf[0] = PROTO_MAGIC;
+    buf[1] = hdr->opcode;
+    proto_put_be(buf + 2, hdr->status, 2);
+    proto_put_be(buf + 4, hdr->req_id, 4);
+    proto_put_be(buf + 8, hdr->name_len, 4);
+    proto_put_be(buf + 12, hdr->body_len, 8);
+}
@@ -0,0 +1,80 @@
+// src/protocol.h
+
+// ---------------------------------------------------------------------------
+// Binary wire protocol, served on the same port as the text commands.
+// A client switches a connection over by sending the text line "BINARY"; the
+// server answers "BINARY_OK\n" and from then on both directions carry frames:
+//
+//   offset  size  field
+//        0     1  magic     0xDB
+//        1     1  opcode    PROTO_OP_*
+//        2     2  status    responses only: PROTO_OK / PROTO_ERR
+//        4     4  req_id    chosen by the client, echoed in the response
+//        8     4  name_len  bytes of name (username / filename) after header
+//       12     8  body_len  bytes of body after the name
+//
+// All integers are big-endian. Bodies are raw bytes (no base64): the password
+// for SIGNUP/LOGIN, file content for UPLOAD requests and DOWNLOAD responses,
+// the listing for LIST responses and the error text when status is PROTO_ERR.
+//
+// Delta uploads (chunk store only): a client that re-sends a modified file
+// first asks for the chunk list of the stored version, cuts its new version
+// with the same content-defined chunker (cdc.h) and sends only the chunks the
+// server lacks, plus the recipe to reassemble the file.
+//   CHUNKS response body:  count x (32-byte SHA-256, u32 len)
+//   UPLOAD_DELTA body:     "DBDR0001" | u64 size | u32 count
+//                          | count x (32-byte SHA-256, u32 len, u8 has_data)
+//                          | data of each has_data entry, in order
+// An entry without data must name a chunk of the file's current version.
+// The body is streamed like an UPLOAD; quota is charged for 'size'.
+// ---------------------------------------------------------------------------
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROTO_MAGIC 0xDB
+#define PROTO_HDR_SIZE 20
+#define PROTO_MAX_NAME 255
+#define PROTO_MAX_INLINE_BODY 4096 // non-UPLOAD bodies are buffered whole
+
+enum {
+    PROTO_OP_SIGNUP = 1,
+    PROTO_OP_LOGIN,
+    PROTO_OP_LOGOUT,
+    PROTO_OP_UPLOAD,
+    PROTO_OP_DOWNLOAD,
+    PROTO_OP_DELETE,
+    PROTO_OP_LIST,
+    PROTO_OP_CHUNKS,
+    PROTO_OP_UPLOAD_DELTA
+};
+
+#define PROTO_CHUNK_ENT_SIZE 36 // CHUNKS response entry
+#define PROTO_DELTA_MAGIC "DBDR0001"
+#define PROTO_DELTA_HDR_SIZE 20 // magic, size, count
+#define PROTO_DELTA_ENT_SIZE 37
+
+enum {
+    PROTO_OK = 0,
+    PROTO_ERR = 1
+};
+
+typedef struct {
+    uint8_t opcode;
+    uint16_t status;
+    uint32_t req_id;
+    uint32_t name_len;
+    uint64_t body_len;
+} proto_hdr_t;
+
+// Returns 0 on success, -1 if the magic byte is wrong
+int proto_decode_hdr(const unsigned char *buf, proto_hdr_t *hdr);
+void proto_encode_hdr(unsigned char *buf, const proto_hdr_t *hdr);
+// n-byte big-endian integers
+uint64_t proto_get_be(const unsigned char *p, int n);
+void proto_put_be(unsigned char *p, uint64_t v, int n);
+
+#endif
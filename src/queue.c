@@ -6,7 +6,9 @@
 queue_t *queue_init()
 {
     queue_t *q = malloc(sizeof(queue_t));
-    q->head = q->tail = NULL;
+    for (int p = 0; p < QUEUE_PRIORITY_LEVELS; p++)
+        q->buckets[p].head = q->buckets[p].tail = NULL;
+    q->nonempty = 0;
     q->size = 0;
     pthread_mutex_init(&q->lock, NULL);
     pthread_cond_init(&q->cond, NULL);
@@ -15,77 +17,61 @@ queue_t *queue_init()
 
 void queue_destroy(queue_t *q)
 {
-    node_t *cur = q->head;
-    while (cur)
-    {
-        node_t *tmp = cur;
-        cur = cur->next;
-        free(tmp);
-    }
+    // tasks still queued belong to the caller; links are inside the tasks
     pthread_mutex_destroy(&q->lock);
     pthread_cond_destroy(&q->cond);
     free(q);
 }
 
+// Out-of-range priorities are clamped rather than rejected
+static int queue_level(const task_t *task)
+{
+    if (task->priority < 0)
+        return 0;
+    if (task->priority >= QUEUE_PRIORITY_LEVELS)
+        return QUEUE_PRIORITY_LEVELS - 1;
+    return task->priority;
+}
+
 // Queue enqueue
 int queue_enqueue(queue_t *q, task_t *task)
 {
-    node_t *n = malloc(sizeof(node_t));
-    if (!n)
-        return -1;
-    n->task = task;
-    n->next = NULL;
-
-    pthread_mutex_lock(&q->lock);
+    task->queue_next = NULL;
 
     // BONUS ---- Priority System Implementation ----
+    // higher priority tasks go first, FIFO within a level : append to its bucket
+    int level = queue_level(task);
 
-    // priority insertion : higher priority tasks go first
-    if (!q->head)
-    {
-        // empty queue:
-        q->head = q->tail = n;
-    }
-    else if (task->priority > q->head->task->priority)
-    {
-        // Insert  at head (highest priority)
-        n->next = q->head;
-        q->head = n;
-    }
+    pthread_mutex_lock(&q->lock);
+    queue_bucket_t *b = &q->buckets[level];
+    if (b->tail)
+        b->tail->queue_next = task;
     else
-    {
-        // Find correct position by priority :
-        node_t *prev = q->head;
-        node_t *curr = q->head->next;
-
-        while (curr && curr->task->priority >= task->priority)
-        {
-            prev = curr;
-            curr = curr->next;
-        }
-        // Insert after prev :
-        prev->next = n ;
-        n->next = curr;
-        if (!curr)
-            q->tail = n; // Insert at tail
-
-    }
-    // if (!q->tail)
-    // {
-    //     q->head = q->tail = n;
-    // }
-    // else
-    // {
-    //     q->tail->next = n;
-    //     q->tail = n;
-    // }
-    
+        b->head = task;
+    b->tail = task;
+    q->nonempty |= 1u << level;
     q->size++;
     pthread_cond_signal(&q->cond);
     pthread_mutex_unlock(&q->lock);
     return 0;
 }
 
+// Highest non-empty level = highest set bit. Caller holds q->lock, size > 0.
+static task_t *queue_pop_locked(queue_t *q)
+{
+    int level = 31 - __builtin_clz(q->nonempty);
+    queue_bucket_t *b = &q->buckets[level];
+    task_t *task = b->head;
+    b->head = task->queue_next;
+    if (!b->head)
+    {
+        b->tail = NULL;
+        q->nonempty &= ~(1u << level);
+    }
+    q->size--;
+    return task;
+}
+
 // Queue dequeue
 int queue_dequeue(queue_t *q, task_t **task, _Atomic int *stop_flag)
 {
@@ -102,13 +88,24 @@ int queue_dequeue(queue_t *q, task_t **task, _Atomic int *stop_flag)
         return -1; // shutdown
     }
 
-    node_t *n = q->head;
-    *task = n->task;
-    q->head = n->next;
-    if (!q->head)
-        q->tail = NULL;
-    q->size--;
-    free(n);
+    *task = queue_pop_locked(q);
     pthread_mutex_unlock(&q->lock);
     return 0;
 }
+
+// Non-blocking dequeue: -1 when empty
+int queue_try_dequeue(queue_t *q, task_t **task)
+{
+    pthread_mutex_lock(&q->lock);
+    *task = q->size ? queue_pop_locked(q) : NULL;
+    pthread_mutex_unlock(&q->lock);
+    return *task ? 0 : -1;
+}
+
+// Wake every blocked consumer (shutdown)
+void queue_wake_all(queue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
@@ -2,25 +2,67 @@
 #define QUEUE_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "task.h"   // include task_t definition
 // typedef struct task task_t;
 
-typedef struct node {
+// BONUS ---- Priority System Implementation ----
+#define QUEUE_PRIORITY_LEVELS 4 // task->priority 0 (low) .. 3 (admin)
+
+#ifdef QUEUE_RING
+// ---------------------------------------------------------------------------
+// Lock-free backend (make QUEUE_BACKEND=ring): one bounded MPMC ring per
+// priority level (Vyukov sequence-numbered cells). Producers and consumers
+// only CAS their own position counter; a futex is touched only when a
+// consumer finds every ring empty and has to sleep.
+// ---------------------------------------------------------------------------
+#define QUEUE_RING_CAPACITY 4096 // per level, must be a power of two
+
+typedef struct {
+    _Atomic size_t seq;
     task_t *task;
-    struct node *next;
-} node_t;
+} queue_cell_t;
 
 typedef struct {
-    node_t *head;
-    node_t *tail;
+    _Alignas(64) _Atomic size_t enqueue_pos;
+    _Alignas(64) _Atomic size_t dequeue_pos;
+    queue_cell_t *cells;
+} queue_ring_t;
+
+typedef struct {
+    queue_ring_t rings[QUEUE_PRIORITY_LEVELS];
+    _Alignas(64) _Atomic uint32_t futex_word; // bumped on every enqueue / wake-all
+    _Atomic int sleepers;
+} queue_t;
+
+#else
+// ---------------------------------------------------------------------------
+// Default backend: one FIFO per priority level plus a bitmap of non-empty
+// levels, so both enqueue and dequeue are O(1) no matter how deep the
+// backlog gets. One mutex + condvar. Tasks are chained through their own
+// queue_next field, so enqueue never allocates (a task sits in one queue at
+// a time).
+// ---------------------------------------------------------------------------
+typedef struct {
+    task_t *head;
+    task_t *tail;
+} queue_bucket_t;
+
+typedef struct {
+    queue_bucket_t buckets[QUEUE_PRIORITY_LEVELS];
+    unsigned int nonempty; // bit p set = buckets[p] holds tasks
     int size;
     pthread_mutex_t lock;
     pthread_cond_t cond;
 } queue_t;
+#endif
 
 queue_t *queue_init();
 void queue_destroy(queue_t *q);
-int queue_enqueue(queue_t *q, task_t *task);
+int queue_enqueue(queue_t *q, task_t *task); // -1 = ring full
 int queue_dequeue(queue_t *q, task_t **task,_Atomic int *stop_flag); // stop_flag support
+int queue_try_dequeue(queue_t *q, task_t **task); // never blocks, -1 when empty
+void queue_wake_all(queue_t *q); // after setting stop_flag: release blocked consumers
 
 #endif
@@ -0,0 +1,188 @@
+// src/queue_ring.c
+
+// ---------------------------------------------------------------------------
+// Lock-free task queue backend, built with: make QUEUE_BACKEND=ring
+//
+// Each priority level is a bounded MPMC ring (Dmitry Vyukov's design): every
+// cell carries a sequence number telling producers whether it is free and
+// consumers whether it is filled, so the only shared writes are one CAS on
+// enqueue_pos or dequeue_pos. No node allocation, no mutex.
+//
+// Consumers that find every ring empty sleep on a futex. Producers bump the
+// futex word on each enqueue and only issue the wake syscall when someone is
+// actually sleeping, so a busy queue never enters the kernel.
+// ---------------------------------------------------------------------------
+
+#include "queue.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t expected)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+queue_t *queue_init()
+{
+    queue_t *q = aligned_alloc(64, sizeof(queue_t));
+    if (!q)
+        return NULL;
+    for (int p = 0; p < QUEUE_PRIORITY_LEVELS; p++)
+    {
+        queue_ring_t *r = &q->rings[p];
+        r->cells = malloc(sizeof(queue_cell_t) * QUEUE_RING_CAPACITY);
+        if (!r->cells)
+        {
+            while (--p >= 0)
+                free(q->rings[p].cells);
+            free(q);
+            return NULL;
+        }
+        for (size_t i = 0; i < QUEUE_RING_CAPACITY; i++)
+            atomic_init(&r->cells[i].seq, i);
+        atomic_init(&r->enqueue_pos, 0);
+        atomic_init(&r->dequeue_pos, 0);
+    }
+    atomic_init(&q->futex_word, 0);
+    atomic_init(&q->sleepers, 0);
+    return q;
+}
+
+void queue_destroy(queue_t *q)
+{
+    // tasks still queued belong to the caller, only the rings are ours
+    for (int p = 0; p < QUEUE_PRIORITY_LEVELS; p++)
+        free(q->rings[p].cells);
+    free(q);
+}
+
+static int queue_level(const task_t *task)
+{
+    if (task->priority < 0)
+        return 0;
+    if (task->priority >= QUEUE_PRIORITY_LEVELS)
+        return QUEUE_PRIORITY_LEVELS - 1;
+    return task->priority;
+}
+
+static int ring_push(queue_ring_t *r, task_t *task)
+{
+    size_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        queue_cell_t *cell = &r->cells[pos & (QUEUE_RING_CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&r->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                cell->task = task;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        }
+        else if (diff < 0)
+            return -1; // full
+        else
+            pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+    }
+}
+
+static task_t *ring_pop(queue_ring_t *r)
+{
+    size_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        queue_cell_t *cell = &r->cells[pos & (QUEUE_RING_CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&r->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                task_t *task = cell->task;
+                atomic_store_explicit(&cell->seq, pos + QUEUE_RING_CAPACITY, memory_order_release);
+                return task;
+            }
+        }
+        else if (diff < 0)
+            return NULL; // empty
+        else
+            pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+    }
+}
+
+// BONUS ---- Priority System Implementation ----
+// scan from the admin level down; FIFO within a level
+static task_t *queue_try_pop(queue_t *q)
+{
+    for (int p = QUEUE_PRIORITY_LEVELS - 1; p >= 0; p--)
+    {
+        task_t *task = ring_pop(&q->rings[p]);
+        if (task)
+            return task;
+    }
+    return NULL;
+}
+
+int queue_enqueue(queue_t *q, task_t *task)
+{
+    if (ring_push(&q->rings[queue_level(task)], task) != 0)
+        return -1; // ring full: caller reports the server as busy
+
+    // seq_cst pairs with the sleeper's increment + re-check in queue_dequeue:
+    // either it sees our task or we see it counted as a sleeper.
+    atomic_fetch_add(&q->futex_word, 1);
+    if (atomic_load(&q->sleepers) > 0)
+        futex_wake(&q->futex_word, 1);
+    return 0;
+}
+
+int queue_dequeue(queue_t *q, task_t **task, _Atomic int *stop_flag)
+{
+    for (;;)
+    {
+        if ((*task = queue_try_pop(q)) != NULL)
+            return 0;
+        if (*stop_flag)
+            return -1; // shutdown
+
+        uint32_t word = atomic_load(&q->futex_word);
+        atomic_fetch_add(&q->sleepers, 1);
+        // re-check after announcing ourselves, a producer may have raced us
+        if ((*task = queue_try_pop(q)) != NULL)
+        {
+            atomic_fetch_sub(&q->sleepers, 1);
+            return 0;
+        }
+        if (!*stop_flag)
+            futex_wait(&q->futex_word, word); // returns at once if word moved
+        atomic_fetch_sub(&q->sleepers, 1);
+    }
+}
+
+// Non-blocking dequeue: -1 when empty
+int queue_try_dequeue(queue_t *q, task_t **task)
+{
+    *task = queue_try_pop(q);
+    return *task ? 0 : -1;
+}
+
+// Wake every blocked consumer (shutdown)
+void queue_wake_all(queue_t *q)
+{
+    atomic_fetch_add(&q->futex_word, 1);
+    futex_wake(&q->futex_word, INT_MAX);
+}
@@ -0,0 +1,1047 @@
+// src/reactor.c
+
+// ---------------------------------------------------------------------------
+// Event loops: each thread waits on its own epoll set (edge-triggered), drains
+// readable sockets into the connection's input buffer and parses whole lines.
+// Reads are submitted back to back while earlier ones are in flight; any other
+// command (and anything past CONN_MAX_INFLIGHT) stays buffered until the
+// workers' completions arrive through the loop's eventfd.
+// ---------------------------------------------------------------------------
+
+#include "reactor.h"
+#include "file_io.h"
+#include "protocol.h"
+#include "task_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+static void conn_process(conn_t *c);
+static void out_seg_free(reactor_t *r, out_seg_t *seg);
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// ========================================================
+// Connection lifetime
+// ========================================================
+
+// The body is being kept (staged or in memory), not just drained
+static int body_kept(const conn_t *c)
+{
+    return c->body_fd >= 0 || c->body_buf;
+}
+
+// Drop an upload body that will never complete, with its staging file (or
+// buffer) and quota reservation
+static void body_abandon(conn_t *c)
+{
+    if (c->body_active && body_kept(c))
+    {
+        if (c->body_fd >= 0)
+            close(c->body_fd);
+        c->body_fd = -1;
+        free(c->body_buf);
+        c->body_buf = NULL;
+        discard_upload_stage(c->stage_path);
+        c->stage_path[0] = '\0';
+        metadata_release_quota(c->loop->metadata, c->session.username, c->quota_reserved);
+        c->quota_reserved = 0;
+    }
+    c->body_active = 0;
+    c->body_base64 = 0;
+}
+
+static void conn_free(conn_t *c)
+{
+    reactor_t *r = c->loop;
+
+    if (c->fd >= 0)
+    {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+
+    pthread_mutex_lock(&r->done_lock); // accept thread links new conns
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        r->conns = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    r->num_conns--;
+    pthread_mutex_unlock(&r->done_lock);
+
+    body_abandon(c); // peer vanished mid-upload
+
+    while (c->out_head)
+    {
+        out_seg_t *seg = c->out_head;
+        c->out_head = seg->next;
+        out_seg_free(c->loop, seg);
+    }
+    free(c);
+}
+
+// ========================================================
+// Output
+// ========================================================
+#define OUT_SEG_MIN 4096
+
+// Segments without a buffer (placeholders, file segments) are recycled
+// through the loop's spare list, so holding a pipelined reply's place costs
+// no allocation once the loop is warm
+static out_seg_t *out_seg_get(reactor_t *r)
+{
+    out_seg_t *seg = r->spare_segs;
+    if (seg)
+    {
+        r->spare_segs = seg->next;
+        r->num_spare_segs--;
+    }
+    else if (!(seg = malloc(sizeof(out_seg_t))))
+        return NULL;
+    memset(seg, 0, sizeof(*seg));
+    return seg;
+}
+
+static void out_seg_free(reactor_t *r, out_seg_t *seg)
+{
+    if (seg->is_file)
+        store_seg_close(&seg->file);
+    if (seg->cap == 0 && r->num_spare_segs < OUT_SEG_SPARE_MAX)
+    {
+        seg->next = r->spare_segs;
+        r->spare_segs = seg;
+        r->num_spare_segs++;
+        return;
+    }
+    free(seg);
+}
+
+static void out_push(conn_t *c, out_seg_t *seg)
+{
+    seg->next = NULL;
+    if (c->out_tail)
+        c->out_tail->next = seg;
+    else
+        c->out_head = seg;
+    c->out_tail = seg;
+}
+
+static void out_pop(conn_t *c)
+{
+    out_seg_t *seg = c->out_head;
+    c->out_head = seg->next;
+    if (!c->out_head)
+        c->out_tail = NULL;
+    out_seg_free(c->loop, seg);
+}
+
+static void conn_flush(conn_t *c)
+{
+    while (c->out_head)
+    {
+        out_seg_t *seg = c->out_head;
+        ssize_t n;
+
+        if (seg->task)
+            return; // the reply due next is still being produced
+        if (!seg->is_file && seg->off == seg->len)
+        {
+            out_pop(c); // a placeholder whose reply went in after it
+            continue;
+        }
+        if (seg->is_file && store_seg_open(&seg->file) != 0)
+        {
+            c->closing = 1; // chunk unreadable: the frame can't be finished
+            return;
+        }
+
+        if (!seg->is_file)
+            n = write(c->fd, seg->data + seg->off, seg->len - seg->off);
+        else
+            n = sendfile(c->fd, seg->file.fd, &seg->file.off, seg->file.len); // page cache -> socket
+
+        if (n > 0)
+        {
+            if (!seg->is_file)
+                seg->off += n;
+            else
+                seg->file.len -= n;
+            if ((!seg->is_file && seg->off < seg->len) || (seg->is_file && seg->file.len > 0))
+                continue;
+            out_pop(c);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return; // EPOLLOUT resumes the flush
+        c->closing = 1; // peer gone, or the file shrank under us (framing lost)
+        return;
+    }
+}
+
+void conn_send(conn_t *c, const char *data, size_t len)
+{
+    if (c->closing || len == 0)
+        return;
+
+    out_seg_t *tail = c->out_tail;
+    if (tail && !tail->task && !tail->is_file && tail->cap - tail->len >= len)
+    {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+    }
+    else
+    {
+        size_t cap = len > OUT_SEG_MIN ? len : OUT_SEG_MIN;
+        out_seg_t *seg = malloc(sizeof(out_seg_t) + cap);
+        if (!seg)
+        {
+            c->closing = 1;
+            return;
+        }
+        seg->task = NULL;
+        seg->is_file = 0;
+        seg->off = 0;
+        seg->cap = cap;
+        seg->len = len;
+        memcpy(seg->data, data, len);
+        out_push(c, seg);
+    }
+    conn_flush(c);
+}
+
+void conn_send_file(conn_t *c, const store_seg_t *file)
+{
+    store_seg_t own = *file;
+    if (c->closing || own.len == 0)
+    {
+        store_seg_close(&own);
+        return;
+    }
+
+    out_seg_t *seg = out_seg_get(c->loop);
+    if (!seg)
+    {
+        store_seg_close(&own);
+        c->closing = 1;
+        return;
+    }
+    seg->is_file = 1;
+    seg->file = own;
+    out_push(c, seg);
+    conn_flush(c);
+}
+
+// Hold the reply's place in the output queue
+static int out_reserve(conn_t *c, task_t *task)
+{
+    out_seg_t *seg = out_seg_get(c->loop);
+    if (!seg)
+        return -1;
+    seg->task = task;
+    out_push(c, seg);
+    return 0;
+}
+
+// ========================================================
+// Task hand-off
+// ========================================================
+static uint8_t proto_opcode(cmd_t cmd)
+{
+    switch (cmd)
+    {
+    case UPLOAD:
+        return PROTO_OP_UPLOAD;
+    case DOWNLOAD:
+        return PROTO_OP_DOWNLOAD;
+    case DELETE:
+        return PROTO_OP_DELETE;
+    case LIST:
+        return PROTO_OP_LIST;
+    case SIGNUP:
+        return PROTO_OP_SIGNUP;
+    case CHUNKS:
+        return PROTO_OP_CHUNKS;
+    case UPLOAD_DELTA:
+        return PROTO_OP_UPLOAD_DELTA;
+    default:
+        return PROTO_OP_LOGIN;
+    }
+}
+
+// Runs on a worker thread: queue the task for its loop and wake it
+static void task_done_cb(task_t *task)
+{
+    conn_t *c = task->owner;
+    reactor_t *r = c->loop;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&r->done_lock);
+    task->next_done = r->done_head;
+    r->done_head = task;
+    pthread_mutex_unlock(&r->done_lock);
+
+    if (write(r->evfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("eventfd write");
+}
+
+int conn_submit(conn_t *c, task_t *task)
+{
+    task->owner = c;
+    task->on_complete = task_done_cb;
+    task->reply_len = 0; // the buffer itself is recycled with the task
+    task->send_file.nsegs = 0;
+    task->sock_fd = c->fd;
+
+    // the completion is handled on this thread, so the placeholder can
+    // follow the submission
+    if (scheduler_submit(c->loop->sched, task) != 0)
+        return -1;
+    if (out_reserve(c, task) != 0)
+        c->closing = 1; // the reply would have nowhere to go
+    c->inflight++;
+    if (task->cmd != DOWNLOAD && task->cmd != LIST && task->cmd != CHUNKS)
+        c->barrier = 1;
+    return 0;
+}
+
+// Write a completed task's reply where its placeholder sits. The segments
+// queued behind it are unhooked meanwhile, so the flushes done by conn_send
+// can't get ahead of the reply, and rejoined afterwards.
+static void conn_reply(conn_t *c, task_t *task)
+{
+    out_seg_t *hole = c->out_head;
+    while (hole && hole->task != task)
+        hole = hole->next;
+
+    out_seg_t *rest = NULL, *rest_tail = NULL;
+    if (hole)
+    {
+        rest = hole->next;
+        rest_tail = c->out_tail;
+        hole->task = NULL; // now an empty memory segment, dropped by the flush
+        hole->next = NULL;
+        c->out_tail = hole;
+    }
+
+    if (task->binary)
+    {
+        // One frame whose body is the reply text plus the file, if any
+        size_t file_len = task->send_file.nsegs ? task->send_file.size : 0;
+        unsigned char hdr_buf[PROTO_HDR_SIZE];
+        proto_hdr_t hdr = {proto_opcode(task->cmd), task->result == 0 ? PROTO_OK : PROTO_ERR,
+                           task->req_id, 0, task->reply_len + file_len};
+        proto_encode_hdr(hdr_buf, &hdr);
+        conn_send(c, (const char *)hdr_buf, sizeof(hdr_buf));
+        conn_send(c, task->reply, task->reply_len);
+    }
+    else
+    {
+        conn_send(c, task->reply, task->reply_len);
+    }
+    // the connection takes over the segments, opening the rest as it gets there
+    for (int i = 0; i < task->send_file.nsegs; i++)
+        conn_send_file(c, &task->send_file.segs[i]);
+
+    if (rest)
+    {
+        if (c->out_tail)
+            c->out_tail->next = rest;
+        else
+            c->out_head = rest;
+        c->out_tail = rest_tail;
+    }
+    conn_flush(c);
+}
+
+static void drain_completions(reactor_t *r)
+{
+    uint64_t count;
+    while (read(r->evfd, &count, sizeof(count)) > 0)
+        ;
+
+    pthread_mutex_lock(&r->done_lock);
+    task_t *list = r->done_head;
+    r->done_head = NULL;
+    pthread_mutex_unlock(&r->done_lock);
+
+    while (list)
+    {
+        task_t *task = list;
+        list = task->next_done;
+        conn_t *c = task->owner;
+
+        c->inflight--;
+        if (c->inflight == 0)
+            c->barrier = 0;
+        handle_task_done(c, task);
+        conn_reply(c, task);
+        free(task->send_file.segs);
+        task->send_file = (store_file_t){0};
+        task_free(task);
+
+        if (c->closing && c->inflight == 0)
+            conn_free(c);
+        else if (!c->closing)
+            conn_process(c); // commands may have queued up behind the task
+    }
+}
+
+// ========================================================
+// Input
+// ========================================================
+
+// The input buffer is a ring: in_len bytes starting at in_head. Consuming a
+// command only moves in_head, and an empty ring starts over at 0, so bytes
+// are moved only when a line has to be made contiguous across the wrap.
+#define IN_MASK (CONN_INBUF_SIZE - 1)
+
+// Read until EAGAIN (edge-triggered) or until the input ring is full
+static void conn_read(conn_t *c)
+{
+    c->read_paused = 0;
+    while (!c->closing && !c->peer_eof)
+    {
+        if (c->in_len == CONN_INBUF_SIZE)
+        {
+            c->read_paused = 1;
+            return;
+        }
+        // free space: up to the end of the array, then from its start
+        size_t tail = (c->in_head + c->in_len) & IN_MASK;
+        struct iovec iov[2];
+        int iovcnt = 1;
+        iov[0].iov_base = c->inbuf + tail;
+        if (tail >= c->in_head)
+        {
+            iov[0].iov_len = CONN_INBUF_SIZE - tail;
+            iov[1].iov_base = c->inbuf;
+            iov[1].iov_len = c->in_head;
+            iovcnt = c->in_head ? 2 : 1;
+        }
+        else
+            iov[0].iov_len = c->in_head - tail;
+
+        ssize_t n = readv(c->fd, iov, iovcnt);
+        if (n > 0)
+        {
+            c->in_len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n == 0)
+            c->peer_eof = 1; // half-close: what was sent still gets answered
+        else
+            c->closing = 1;
+    }
+}
+
+static void conn_consume(conn_t *c, size_t n)
+{
+    c->in_head = (c->in_head + n) & IN_MASK;
+    c->in_len -= n;
+    c->in_scanned = c->in_scanned > n ? c->in_scanned - n : 0;
+    if (c->in_len == 0)
+        c->in_head = 0;
+}
+
+// Bytes from in_head that are contiguous in memory
+static size_t in_contig(const conn_t *c)
+{
+    size_t room = CONN_INBUF_SIZE - c->in_head;
+    return c->in_len < room ? c->in_len : room;
+}
+
+// Copy n buffered bytes starting 'off' bytes past in_head
+static void in_copy(const conn_t *c, size_t off, void *dst, size_t n)
+{
+    size_t pos = (c->in_head + off) & IN_MASK;
+    size_t first = CONN_INBUF_SIZE - pos < n ? CONN_INBUF_SIZE - pos : n;
+    memcpy(dst, c->inbuf + pos, first);
+    memcpy((char *)dst + first, c->inbuf, n - first);
+}
+
+// Rotate the ring so the buffered bytes start at offset 0 (rare: only for a
+// line that straddles the end of the array)
+static void in_linearize(conn_t *c)
+{
+    char *tmp = c->loop->scratch; // REACTOR_STREAM_CHUNK > CONN_INBUF_SIZE
+    in_copy(c, 0, tmp, c->in_len);
+    memcpy(c->inbuf, tmp, c->in_len);
+    c->in_head = 0;
+}
+
+// Next '\n' past in_scanned: its offset from in_head, or -1. The search
+// resumes where it stopped, so a line trickling in is scanned once.
+static long in_find_newline(conn_t *c)
+{
+    while (c->in_scanned < c->in_len)
+    {
+        size_t pos = (c->in_head + c->in_scanned) & IN_MASK;
+        size_t span = CONN_INBUF_SIZE - pos;
+        if (span > c->in_len - c->in_scanned)
+            span = c->in_len - c->in_scanned;
+        char *nl = memchr(c->inbuf + pos, '\n', span);
+        if (nl)
+            return (long)(c->in_scanned + (nl - (c->inbuf + pos)));
+        c->in_scanned += span;
+    }
+    return -1;
+}
+
+// ========================================================
+// Streamed upload bodies
+// ========================================================
+void conn_stream_to_file(conn_t *c, int fd, size_t size)
+{
+    c->body_active = 1;
+    c->body_fd = fd;
+    c->body_size = size;
+    c->body_remaining = size;
+    c->body_error = NULL;
+    c->body_base64 = 0;
+}
+
+void conn_decode_to_file(conn_t *c, int fd)
+{
+    conn_stream_to_file(c, fd, 0);
+    c->body_base64 = 1;
+    c->body_chars = 0;
+    base64_stream_init(&c->body_b64);
+}
+
+// Small bodies stay in memory for the store's commit_buffer (store.h)
+int conn_stream_to_memory(conn_t *c, size_t size)
+{
+    unsigned char *buf = malloc(size ? size : 1);
+    if (!buf)
+        return -1;
+    conn_stream_to_file(c, -1, size);
+    c->body_buf = buf;
+    c->body_held = 0;
+    c->body_buf_cap = size;
+    return 0;
+}
+
+int conn_decode_to_memory(conn_t *c, size_t cap)
+{
+    unsigned char *buf = malloc(cap ? cap : 1);
+    if (!buf)
+        return -1;
+    conn_decode_to_file(c, -1);
+    c->body_buf = buf;
+    c->body_held = 0;
+    c->body_buf_cap = cap;
+    return 0;
+}
+
+// Staged body: append to the staging file
+static void body_write_fd(conn_t *c, const char *data, size_t len)
+{
+    while (len > 0 && !c->body_error && c->body_fd >= 0)
+    {
+        ssize_t n = write(c->body_fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("write upload body");
+            c->body_error = "*** Error: Save failed\n"; // bytes still have to be drained off the socket
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// A base64 body outgrew memory: what is held so far goes to a staging file
+// and the rest follows it there
+static void body_spill(conn_t *c)
+{
+    int fd = open_upload_stage(c->session.username, c->pending_file, c->stage_path, sizeof(c->stage_path));
+    if (fd < 0)
+    {
+        c->body_error = "*** Error: Save failed\n"; // the buffer goes with the body
+        return;
+    }
+    unsigned char *held = c->body_buf;
+    c->body_buf = NULL;
+    c->body_fd = fd;
+    body_write_fd(c, (const char *)held, c->body_held);
+    free(held);
+}
+
+static void body_write(conn_t *c, const char *data, size_t len)
+{
+    if (c->body_buf && !c->body_error)
+    {
+        if (c->body_held + len <= c->body_buf_cap)
+        {
+            memcpy(c->body_buf + c->body_held, data, len);
+            c->body_held += len;
+            return;
+        }
+        body_spill(c);
+    }
+    body_write_fd(c, data, len);
+}
+
+static void body_finish(conn_t *c)
+{
+    c->body_active = 0;
+    c->body_base64 = 0;
+    if (!body_kept(c))
+        return; // body was only being discarded, the error is already sent
+    if (c->body_fd >= 0)
+        close(c->body_fd);
+    c->body_fd = -1;
+    handle_upload_streamed(c, c->body_error);
+    free(c->body_buf); // NULL if the task took it
+    c->body_buf = NULL;
+}
+
+// Legacy UPLOAD body: decode what the input ring holds straight into the
+// staging file (or the small-body buffer) through the loop's scratch buffer,
+// so memory stays bounded however long the line is. The size isn't announced, so quota is reserved
+// as the decoded bytes come out.
+static void body_decode(conn_t *c)
+{
+    unsigned char *out = (unsigned char *)c->loop->scratch; // > BASE64_DECODED_MAX(CONN_INBUF_SIZE)
+    int ended = 0;
+    while (c->in_len > 0 && !ended)
+    {
+        const char *p = c->inbuf + c->in_head;
+        size_t span = in_contig(c);
+        const char *nl = memchr(p, '\n', span);
+        size_t take = nl ? (size_t)(nl - p) : span;
+        ended = nl != NULL;
+
+        size_t n = base64_stream_decode(&c->body_b64, p, take, out);
+        c->body_chars += take;
+        conn_consume(c, ended ? take + 1 : take);
+        if (n > 0 && !c->body_error && body_kept(c))
+        {
+            int res = metadata_reserve_quota(c->loop->metadata, c->session.username, n);
+            if (res != 0)
+                c->body_error = res == -2 ? "*** Error: Quota exceeded\n" : "*** Error: User not found\n";
+            else
+            {
+                c->quota_reserved += n;
+                c->body_size += n;
+                body_write(c, (const char *)out, n);
+            }
+        }
+    }
+
+    // A line without its '\n' only ends when the peer shuts its side: a
+    // pause is just the rest still in flight
+    if (!ended && !c->peer_eof)
+        return;
+    if (!c->body_error && c->body_size == 0)
+        c->body_error = c->body_chars ? "*** Error: Invalid data\n" : "*** Error: Failed to receive file data\n";
+    body_finish(c);
+}
+
+// Copy body bytes straight from the socket to disk through the loop's
+// scratch buffer; the connection's input buffer is bypassed entirely.
+static void conn_stream_body(conn_t *c)
+{
+    char *buf = c->loop->scratch;
+    while (c->body_active && !c->closing)
+    {
+        if (c->body_remaining == 0)
+        {
+            body_finish(c);
+            return;
+        }
+        size_t want = c->body_remaining < REACTOR_STREAM_CHUNK ? c->body_remaining : REACTOR_STREAM_CHUNK;
+        ssize_t n = read(c->fd, buf, want);
+        if (n > 0)
+        {
+            c->body_remaining -= n;
+            body_write(c, buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n == 0)
+        {
+            // half-closed mid-body: this upload can't complete, but replies
+            // to what came before it still go out
+            body_abandon(c);
+            c->peer_eof = 1;
+            return;
+        }
+        c->closing = 1;
+    }
+}
+
+// Parsing stops while a barrier or a full pipeline is in flight
+static int conn_blocked(const conn_t *c)
+{
+    return c->inflight > 0 && (c->barrier || c->inflight >= CONN_MAX_INFLIGHT);
+}
+
+// Binary mode: decode one frame from the input buffer. UPLOAD and
+// UPLOAD_DELTA bodies are streamed like text uploads; every other body is
+// small and passed whole.
+// Returns -1 when the frame is not complete yet.
+static int conn_process_frame(conn_t *c)
+{
+    if (c->in_len < PROTO_HDR_SIZE)
+        return -1;
+
+    unsigned char hdr_buf[PROTO_HDR_SIZE];
+    in_copy(c, 0, hdr_buf, sizeof(hdr_buf));
+    proto_hdr_t hdr;
+    int bad = proto_decode_hdr(hdr_buf, &hdr) != 0;
+    int streamed = !bad && (hdr.opcode == PROTO_OP_UPLOAD || hdr.opcode == PROTO_OP_UPLOAD_DELTA);
+    if (bad ||
+        hdr.name_len > PROTO_MAX_NAME ||
+        (!streamed && hdr.body_len > PROTO_MAX_INLINE_BODY))
+    {
+        fprintf(stderr, "Bad frame on socket %d, closing\n", c->fd);
+        c->closing = 1; // framing is lost, nothing sensible to reply to
+        return -1;
+    }
+
+    if (c->inflight && !frame_is_read(hdr.opcode))
+        return -1; // barrier: wait for the reads ahead of it
+
+    size_t inline_body = streamed ? 0 : (size_t)hdr.body_len;
+    size_t need = PROTO_HDR_SIZE + hdr.name_len + inline_body;
+    if (c->in_len < need)
+        return -1;
+
+    // A SIGNUP / LOGIN name becomes the session's identity, which holds at
+    // most SESSION_NAME_MAX characters: refuse the frame, don't truncate
+    if ((hdr.opcode == PROTO_OP_SIGNUP || hdr.opcode == PROTO_OP_LOGIN) && hdr.name_len > SESSION_NAME_MAX)
+    {
+        static const char msg[] = "*** Invalid format. Names are limited to 49 characters\n";
+        conn_consume(c, need);
+        conn_send_frame(c, hdr.opcode, PROTO_ERR, hdr.req_id, msg, sizeof(msg) - 1);
+        return 0;
+    }
+
+    char name[PROTO_MAX_NAME + 1];
+    char body[PROTO_MAX_INLINE_BODY + 1];
+    in_copy(c, PROTO_HDR_SIZE, name, hdr.name_len);
+    name[hdr.name_len] = '\0';
+    in_copy(c, PROTO_HDR_SIZE + hdr.name_len, body, inline_body);
+    body[inline_body] = '\0';
+    conn_consume(c, need);
+
+    handle_binary_frame(c, &hdr, name, body);
+    return 0;
+}
+
+void conn_send_frame(conn_t *c, uint8_t opcode, uint16_t status, uint32_t req_id,
+                     const char *body, size_t body_len)
+{
+    unsigned char hdr_buf[PROTO_HDR_SIZE];
+    proto_hdr_t hdr = {opcode, status, req_id, 0, body_len};
+    proto_encode_hdr(hdr_buf, &hdr);
+    conn_send(c, (const char *)hdr_buf, sizeof(hdr_buf));
+    conn_send(c, body, body_len);
+}
+
+// Parse as many buffered commands as the connection state allows. Commands
+// and bodies may arrive split across any number of reads, with any pause
+// between them: a line is handled once its '\n' is in, or once the peer
+// shuts its side if the last line has none.
+static void conn_process(conn_t *c)
+{
+    while (!c->closing && !conn_blocked(c) && (c->in_len > 0 || c->body_active))
+    {
+        if (c->body_active && c->body_base64)
+        {
+            body_decode(c);
+            if (c->read_paused && !c->closing)
+                conn_read(c); // the ring was full, the kernel holds more
+            if (c->body_active && c->in_len == 0)
+                break; // wait for more of the line
+            continue;
+        }
+
+        if (c->body_active)
+        {
+            // Body bytes that were read along with the command line
+            size_t take;
+            while (c->body_remaining > 0 &&
+                   (take = in_contig(c) < c->body_remaining ? in_contig(c) : c->body_remaining) > 0)
+            {
+                c->body_remaining -= take;
+                body_write(c, c->inbuf + c->in_head, take);
+                conn_consume(c, take);
+            }
+            if (c->body_remaining == 0)
+                body_finish(c);
+            else
+                conn_stream_body(c);
+
+            if (c->body_active)
+                break; // wait for more of the body
+            conn_read(c); // commands may follow the body
+            continue;
+        }
+
+        if (c->binary)
+        {
+            if (conn_process_frame(c) != 0)
+                break; // incomplete frame: wait for more bytes
+            continue;
+        }
+
+        long nl = in_find_newline(c);
+        size_t line_len = nl >= 0 ? (size_t)nl : c->in_len;
+        if (nl < 0)
+        {
+            if (c->in_len == CONN_INBUF_SIZE)
+            {
+                conn_send(c, "*** Error: Command too long\n", 28);
+                conn_consume(c, c->in_len);
+                break;
+            }
+            // No '\n' yet: the rest is still in flight, unless the peer
+            // has shut its side and this is its last line
+            if (!c->peer_eof)
+                break;
+        }
+
+        if (c->in_head + line_len >= CONN_INBUF_SIZE)
+            in_linearize(c); // the line and its terminator must be contiguous
+        char *line = c->inbuf + c->in_head;
+        if (c->inflight && !command_is_read(line, line_len))
+            break; // barrier: wait for the reads ahead of it
+        line[line_len] = '\0'; // tokenized in place; the '\n' goes with it
+        conn_consume(c, nl >= 0 ? line_len + 1 : line_len);
+
+        handle_command_line(c, line);
+
+        // Room freed up: pull in what the kernel is still holding
+        if (c->read_paused && !c->closing)
+            conn_read(c);
+    }
+
+    // Half-closed and nothing left to do (a partial frame can't complete
+    // any more): close once the last reply is out. EPOLLOUT brings us back
+    // here while it is still flushing.
+    if (c->peer_eof && !c->closing && c->inflight == 0 && !c->body_active && !c->out_head)
+        c->closing = 1;
+    if (c->closing && c->inflight == 0)
+        conn_free(c);
+}
+
+// ========================================================
+// Event loop
+// ========================================================
+
+static void *reactor_loop(void *arg)
+{
+    reactor_t *r = (reactor_t *)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    printf("Event loop %d started\n", r->id);
+
+    while (!*r->stop)
+    {
+        int n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, 500);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        // Completions go last: they may free a connection that a later
+        // entry of this batch still points at
+        int completions = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                completions = 1;
+                continue;
+            }
+
+            conn_t *c = events[i].data.ptr;
+            uint32_t ev = events[i].events;
+
+            if (ev & EPOLLOUT)
+                conn_flush(c);
+            if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                if (c->body_active && !c->body_base64 && c->in_len == 0 && !c->inflight)
+                    conn_stream_body(c);
+                if (!c->body_active || c->body_base64)
+                    conn_read(c);
+                if (ev & (EPOLLHUP | EPOLLERR))
+                    c->closing = 1;
+            }
+            conn_process(c);
+        }
+        if (completions)
+            drain_completions(r);
+    }
+
+    task_pool_release();
+    printf("Event loop %d exiting\n", r->id);
+    return NULL;
+}
+
+void reactor_add_connection(reactor_pool_t *pool, int client_sock)
+{
+    if (set_nonblocking(client_sock) < 0)
+    {
+        perror("fcntl O_NONBLOCK");
+        close(client_sock);
+        return;
+    }
+
+    conn_t *c = calloc(1, sizeof(conn_t));
+    if (!c)
+    {
+        close(client_sock);
+        return;
+    }
+
+    unsigned idx = atomic_fetch_add(&pool->next_loop, 1) % pool->num_loops;
+    reactor_t *r = &pool->loops[idx];
+    c->fd = client_sock;
+    c->loop = r;
+    c->body_fd = -1;
+
+    // The list is only walked at shutdown; done_lock guards concurrent linking
+    pthread_mutex_lock(&r->done_lock);
+    c->next = r->conns;
+    if (r->conns)
+        r->conns->prev = c;
+    r->conns = c;
+    r->num_conns++;
+    pthread_mutex_unlock(&r->done_lock);
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, client_sock, &ev) < 0)
+    {
+        perror("epoll_ctl add");
+        conn_free(c);
+    }
+}
+
+reactor_pool_t *reactor_pool_init(scheduler_t *sched, metadata_t *metadata)
+{
+    reactor_pool_t *pool = calloc(1, sizeof(reactor_pool_t));
+    if (!pool)
+        return NULL;
+
+    pool->num_loops = REACTOR_THREADS;
+    pool->stop = 0;
+    pool->next_loop = 0;
+    pool->sched = sched;
+    pool->metadata = metadata;
+
+    for (int i = 0; i < pool->num_loops; i++)
+    {
+        reactor_t *r = &pool->loops[i];
+        r->id = i + 1;
+        r->sched = sched;
+        r->metadata = metadata;
+        r->stop = &pool->stop;
+        pthread_mutex_init(&r->done_lock, NULL);
+        r->scratch = malloc(REACTOR_STREAM_CHUNK);
+
+        r->epfd = epoll_create1(EPOLL_CLOEXEC);
+        r->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (r->epfd < 0 || r->evfd < 0)
+        {
+            perror("epoll/eventfd");
+            exit(EXIT_FAILURE);
+        }
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL; // marks the completion eventfd
+        epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->evfd, &ev);
+
+        pthread_create(&r->thread, NULL, reactor_loop, r);
+    }
+    return pool;
+}
+
+void reactor_pool_stop(reactor_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    pool->stop = 1;
+    for (int i = 0; i < pool->num_loops; i++)
+    {
+        uint64_t one = 1;
+        write(pool->loops[i].evfd, &one, sizeof(one)); // cut epoll_wait short
+    }
+    for (int i = 0; i < pool->num_loops; i++)
+        pthread_join(pool->loops[i].thread, NULL);
+}
+
+void reactor_pool_destroy(reactor_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    for (int i = 0; i < pool->num_loops; i++)
+    {
+        reactor_t *r = &pool->loops[i];
+
+        // Completions that arrived after the loop stopped
+        task_t *t = r->done_head;
+        while (t)
+        {
+            task_t *next = t->next_done;
+            ((conn_t *)t->owner)->inflight--;
+            store_file_close(&t->send_file);
+            task_free(t);
+            t = next;
+        }
+        r->done_head = NULL;
+
+        while (r->conns)
+            conn_free(r->conns);
+
+        close(r->epfd);
+        close(r->evfd);
+        free(r->scratch);
+        while (r->spare_segs)
+        {
+            out_seg_t *seg = r->spare_segs;
+            r->spare_segs = seg->next;
+            free(seg);
+        }
+        pthread_mutex_destroy(&r->done_lock);
+    }
+    free(pool);
+    task_pool_release(); // the leftovers above were recycled on this thread
+}
@@ -0,0 +1,153 @@
+// src/reactor.h
+
+// ---------------------------------------------------------------------------
+// Edge-triggered epoll connection engine (replaces the 5-thread client pool).
+// A handful of event-loop threads own every client socket: they read bytes as
+// they arrive, frame commands, answer the trivial ones inline and hand the
+// rest (auth included: password hashing, durable signups) to the worker
+// queue. Workers never touch the socket; they post finished tasks back to
+// the owning loop through an eventfd and the loop writes the reply, so an
+// idle client costs one conn_t and no thread.
+// Requests are pipelined: up to CONN_MAX_INFLIGHT reads (DOWNLOAD, LIST,
+// CHUNKS) of one connection run on the workers at once, each holding its
+// place in the output queue so replies still go out in request order. Any
+// other command is a barrier: it waits for the reads ahead of it to finish
+// and nothing behind it starts until it has.
+// ---------------------------------------------------------------------------
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "scheduler.h"
+#include "metadata.h"
+#include "commands.h"
+#include "base64.h"
+#include "store.h"
+
+#define REACTOR_THREADS 2
+#define REACTOR_MAX_EVENTS 64
+#define CONN_INBUF_SIZE 16384 // input ring, a power of two
+#define REACTOR_STREAM_CHUNK (256 * 1024) // per-loop scratch for upload bodies
+#define CONN_MAX_INFLIGHT 32              // pipelined tasks per connection
+#define OUT_SEG_SPARE_MAX 256             // per loop; beyond this out segments really free
+
+typedef struct reactor reactor_t;
+
+// Output is a FIFO of segments so file bodies (sent with sendfile) stay in
+// order with the text written around them. A task in flight holds a
+// placeholder segment that stops the flush until its reply is filled in.
+typedef struct out_seg
+{
+    struct out_seg *next;
+    struct task *task;    // placeholder for this task's reply, else NULL
+    int is_file;          // 0 = memory segment, else 'file' sent with sendfile
+    store_seg_t file;     // off/len: what is left to send; opened when reached
+    size_t len;           // memory: bytes stored
+    size_t off, cap;      // memory: bytes already written / allocated
+    char data[];
+} out_seg_t;
+
+typedef struct conn
+{
+    int fd;
+    reactor_t *loop;
+    ClientSession session;
+
+    // Input: ring of bytes read but not yet parsed, in_len of them from in_head
+    char inbuf[CONN_INBUF_SIZE];
+    size_t in_head, in_len;
+    size_t in_scanned;       // bytes from in_head already searched for '\n'
+    int read_paused;         // inbuf filled up before EAGAIN, more may be in the kernel
+
+    // Output: segments queued for the socket, flushed on EPOLLOUT
+    out_seg_t *out_head, *out_tail;
+
+    int binary;  // switched to framed protocol (protocol.h) by "BINARY"
+    uint8_t cur_op;       // binary: frame being handled, echoed in replies
+    uint32_t cur_req_id;
+
+    int inflight; // tasks submitted and not completed yet
+    int barrier;  // the task in flight is not a read: parse nothing until it completes
+    int closing;  // peer gone or fatal error, free once no task is in flight
+    int peer_eof; // peer shut its side: finish the buffered commands and the
+                  // tasks in flight, flush the replies, then close
+
+    // UPLOAD waits for its body before the task is submitted
+    char pending_file[256];
+    int pending_priority;
+
+    // Length-announced UPLOAD: body is copied to body_fd as it arrives.
+    // Legacy UPLOAD: one base64 line, decoded into body_fd as it arrives.
+    // A body the store takes from memory (store.h inline_max) goes to
+    // body_buf instead; a base64 one that outgrows it moves to a staging file.
+    int body_active;
+    int body_fd;             // -1 = discard the body (request already failed), unless body_buf
+    unsigned char *body_buf; // small body held in memory, NULL = none
+    size_t body_held, body_buf_cap;
+    size_t body_remaining;   // length-announced only
+    size_t body_size;        // announced, or decoded so far for base64
+    const char *body_error;  // reply once drained (write failed, quota), NULL = fine
+    int body_base64;         // ends at '\n', or when the peer shuts its side
+    size_t body_chars;       // base64 characters taken so far
+    base64_stream_t body_b64;
+    char stage_path[512];
+    size_t quota_reserved;   // held for the body being staged, 0 = none
+
+    struct conn *prev, *next; // loop's connection list (for shutdown)
+} conn_t;
+
+struct reactor
+{
+    int epfd;
+    int evfd;                  // workers bump this after posting a completion
+    pthread_t thread;
+    int id;
+
+    pthread_mutex_t done_lock; // protects done_head
+    task_t *done_head;         // completed tasks waiting for the loop
+
+    conn_t *conns;             // all connections owned by this loop
+    int num_conns;
+
+    char *scratch;             // REACTOR_STREAM_CHUNK bytes, socket -> file copies
+    out_seg_t *spare_segs;     // recycled placeholder and file segments
+    int num_spare_segs;
+
+    scheduler_t *sched;
+    metadata_t *metadata;
+    _Atomic int *stop;
+};
+
+typedef struct
+{
+    reactor_t loops[REACTOR_THREADS];
+    int num_loops;
+    _Atomic unsigned next_loop; // round-robin placement of new sockets
+    _Atomic int stop;
+
+    scheduler_t *sched;
+    metadata_t *metadata;
+} reactor_pool_t;
+
+// API
+reactor_pool_t *reactor_pool_init(scheduler_t *sched, metadata_t *metadata);
+void reactor_add_connection(reactor_pool_t *pool, int client_sock);
+void reactor_pool_stop(reactor_pool_t *pool);    // join loop threads
+void reactor_pool_destroy(reactor_pool_t *pool); // after workers are joined
+
+// Used by commands.c (loop thread only)
+void conn_send(conn_t *c, const char *data, size_t len);
+void conn_send_file(conn_t *c, const store_seg_t *seg); // takes the segment
+int conn_submit(conn_t *c, task_t *task);
+void conn_stream_to_file(conn_t *c, int fd, size_t size); // hands fd to the conn, -1 = discard
+void conn_decode_to_file(conn_t *c, int fd);              // same for a base64 line of any length
+int conn_stream_to_memory(conn_t *c, size_t size);        // body kept in memory; 0 or -1
+int conn_decode_to_memory(conn_t *c, size_t cap);         // base64, staged past cap bytes; 0 or -1
+void conn_send_frame(conn_t *c, uint8_t opcode, uint16_t status, uint32_t req_id,
+                     const char *body, size_t body_len);
+
+#endif
@@ -0,0 +1,232 @@
+// src/scheduler.c
+
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+scheduler_t *scheduler_init(int num_workers, queue_t *overflow)
+{
+    scheduler_t *s = calloc(1, sizeof(scheduler_t));
+    if (!s)
+        return NULL;
+    s->workers = aligned_alloc(64, sizeof(sched_worker_t) * num_workers);
+    if (!s->workers)
+    {
+        free(s);
+        return NULL;
+    }
+    for (int i = 0; i < num_workers; i++)
+    {
+        sched_worker_t *w = &s->workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        for (int p = 0; p < QUEUE_PRIORITY_LEVELS; p++)
+            w->deques[p].head = w->deques[p].tail = 0;
+        atomic_init(&w->nonempty, 0);
+        pthread_cond_init(&w->wake, NULL);
+        w->sleeping = 0;
+        atomic_init(&w->executed, 0);
+        atomic_init(&w->stolen, 0);
+    }
+    s->num_workers = num_workers;
+    s->overflow = overflow;
+    pthread_mutex_init(&s->idle_lock, NULL);
+    return s;
+}
+
+void scheduler_destroy(scheduler_t *s)
+{
+    if (!s)
+        return;
+    for (int i = 0; i < s->num_workers; i++)
+    {
+        sched_worker_t *w = &s->workers[i];
+        printf("Worker %d: executed %lu tasks (%lu stolen)\n", i + 1,
+               (unsigned long)w->executed, (unsigned long)w->stolen);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->wake);
+    }
+    pthread_mutex_destroy(&s->idle_lock);
+    free(s->workers);
+    free(s);
+}
+
+static int sched_level(const task_t *task)
+{
+    if (task->priority < 0)
+        return 0;
+    if (task->priority >= QUEUE_PRIORITY_LEVELS)
+        return QUEUE_PRIORITY_LEVELS - 1;
+    return task->priority;
+}
+
+// FNV-1a over the username: same user -> same home worker
+static int sched_home(const scheduler_t *s, const task_t *task)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)task->username; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h % s->num_workers;
+}
+
+static int highest_level(unsigned int bits)
+{
+    return bits ? 31 - __builtin_clz(bits) : -1;
+}
+
+// ---- Deque operations, caller holds w->lock ----
+static int deque_push(sched_worker_t *w, int level, task_t *task)
+{
+    sched_deque_t *d = &w->deques[level];
+    if (d->tail - d->head == SCHED_DEQUE_CAPACITY)
+        return -1;
+    d->slots[d->tail++ & (SCHED_DEQUE_CAPACITY - 1)] = task;
+    atomic_fetch_or(&w->nonempty, 1u << level);
+    return 0;
+}
+
+static task_t *deque_take(sched_worker_t *w, int from_back)
+{
+    int level = highest_level(atomic_load(&w->nonempty));
+    if (level < 0)
+        return NULL;
+    sched_deque_t *d = &w->deques[level];
+    task_t *task = from_back ? d->slots[--d->tail & (SCHED_DEQUE_CAPACITY - 1)]
+                             : d->slots[d->head++ & (SCHED_DEQUE_CAPACITY - 1)];
+    if (d->head == d->tail)
+        atomic_fetch_and(&w->nonempty, ~(1u << level));
+    return task;
+}
+
+static task_t *worker_take(sched_worker_t *w, int from_back)
+{
+    pthread_mutex_lock(&w->lock);
+    task_t *task = deque_take(w, from_back);
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+// Prefer waking the home worker so the task runs where its user's state is
+// warm; otherwise any sleeper, which will steal it. Caller holds idle_lock.
+static void sched_wake_one(scheduler_t *s, int home)
+{
+    for (int i = 0; i < s->num_workers; i++)
+    {
+        sched_worker_t *w = &s->workers[(home + i) % s->num_workers];
+        if (w->sleeping)
+        {
+            w->sleeping = 0;
+            pthread_cond_signal(&w->wake);
+            return;
+        }
+    }
+}
+
+int scheduler_submit(scheduler_t *s, task_t *task)
+{
+    int home = sched_home(s, task);
+    sched_worker_t *w = &s->workers[home];
+
+    // counted before it is visible, so pending never drops below zero;
+    // pairs with the sleeper's re-check in scheduler_next
+    atomic_fetch_add(&s->pending, 1);
+
+    pthread_mutex_lock(&w->lock);
+    int ret = deque_push(w, sched_level(task), task);
+    pthread_mutex_unlock(&w->lock);
+
+    if (ret != 0 && queue_enqueue(s->overflow, task) != 0)
+    {
+        atomic_fetch_sub(&s->pending, 1);
+        return -1;
+    }
+
+    if (atomic_load(&s->sleepers) > 0)
+    {
+        pthread_mutex_lock(&s->idle_lock);
+        sched_wake_one(s, home);
+        pthread_mutex_unlock(&s->idle_lock);
+    }
+    return 0;
+}
+
+// One pass over everything this worker may run. Priorities are honored
+// across workers: a peer's higher level beats our own lower one.
+static task_t *sched_find(scheduler_t *s, int self)
+{
+    sched_worker_t *me = &s->workers[self];
+    int local = highest_level(atomic_load(&me->nonempty));
+
+    // best peer, scanning from our neighbour so thieves spread out
+    int victim = -1, victim_level = -1;
+    for (int i = 1; i < s->num_workers; i++)
+    {
+        int v = (self + i) % s->num_workers;
+        int level = highest_level(atomic_load(&s->workers[v].nonempty));
+        if (level > victim_level)
+        {
+            victim = v;
+            victim_level = level;
+        }
+    }
+
+    task_t *task = NULL;
+    if (local >= 0 && local >= victim_level && (task = worker_take(me, 0)))
+        return task;
+
+    if (local < 0 && queue_try_dequeue(s->overflow, &task) == 0)
+        return task;
+
+    if (victim >= 0 && (task = worker_take(&s->workers[victim], 1)))
+    {
+        atomic_fetch_add(&me->stolen, 1);
+        return task;
+    }
+
+    // the peer was drained under us; our own work is still fine
+    return worker_take(me, 0);
+}
+
+int scheduler_next(scheduler_t *s, int worker, task_t **task, _Atomic int *stop_flag)
+{
+    for (;;)
+    {
+        if ((*task = sched_find(s, worker)) != NULL)
+        {
+            atomic_fetch_sub(&s->pending, 1);
+            atomic_fetch_add(&s->workers[worker].executed, 1);
+            return 0;
+        }
+        if (*stop_flag)
+            return -1; // shutdown
+
+        if (atomic_load(&s->pending) > 0)
+        {
+            // a submit is still publishing its task: let that thread finish
+            sched_yield();
+            continue;
+        }
+
+        sched_worker_t *me = &s->workers[worker];
+        pthread_mutex_lock(&s->idle_lock);
+        atomic_fetch_add(&s->sleepers, 1);
+        me->sleeping = 1;
+        while (me->sleeping && atomic_load(&s->pending) == 0 && !*stop_flag)
+            pthread_cond_wait(&me->wake, &s->idle_lock);
+        me->sleeping = 0;
+        atomic_fetch_sub(&s->sleepers, 1);
+        pthread_mutex_unlock(&s->idle_lock);
+    }
+}
+
+// Wake every sleeping worker (shutdown)
+void scheduler_wake_all(scheduler_t *s)
+{
+    pthread_mutex_lock(&s->idle_lock);
+    for (int i = 0; i < s->num_workers; i++)
+    {
+        s->workers[i].sleeping = 0;
+        pthread_cond_signal(&s->workers[i].wake);
+    }
+    pthread_mutex_unlock(&s->idle_lock);
+}
@@ -0,0 +1,64 @@
+// src/scheduler.h
+
+// ---------------------------------------------------------------------------
+// Work-stealing scheduler in front of the worker pool.
+// Every worker owns one deque per priority level. A submitted task goes to its
+// user's "home" worker (hash of the username), so the same worker keeps
+// touching the same user's metadata and directory. A worker serves its own
+// deques first, oldest task first; when it runs dry, or a peer holds work of a
+// strictly higher priority, it steals from the back of that peer's deque.
+// The global queue_t is kept as the overflow queue for a full home deque.
+// Usage: scheduler_submit() from the reactor, scheduler_next() in worker_func.
+// ---------------------------------------------------------------------------
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "queue.h"
+#include "task.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define SCHED_DEQUE_CAPACITY 256 // per worker and priority level, power of two
+
+typedef struct
+{
+    task_t *slots[SCHED_DEQUE_CAPACITY];
+    unsigned int head; // oldest task: owner pops here
+    unsigned int tail; // next free slot: thieves take tail - 1
+} sched_deque_t;
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock; // owner, submitters and thieves
+    sched_deque_t deques[QUEUE_PRIORITY_LEVELS];
+    _Atomic unsigned int nonempty;     // bit p = deques[p] has tasks, read without lock
+
+    pthread_cond_t wake;               // waited on with scheduler idle_lock held
+    int sleeping;                      // protected by idle_lock
+
+    // stats
+    _Atomic unsigned long executed;
+    _Atomic unsigned long stolen;
+} sched_worker_t;
+
+typedef struct
+{
+    sched_worker_t *workers;
+    int num_workers;
+    queue_t *overflow;      // not owned
+
+    _Atomic int pending;    // tasks queued anywhere (deques + overflow)
+    _Atomic int sleepers;
+    pthread_mutex_t idle_lock;
+} scheduler_t;
+
+// API
+scheduler_t *scheduler_init(int num_workers, queue_t *overflow);
+void scheduler_destroy(scheduler_t *s);
+int scheduler_submit(scheduler_t *s, task_t *task); // -1 = everything full
+// Blocks until a task is available; -1 once stop_flag is set and no work is left
+int scheduler_next(scheduler_t *s, int worker, task_t **task, _Atomic int *stop_flag);
+void scheduler_wake_all(scheduler_t *s); // after setting stop_flag
+
+#endif
@@ -0,0 +1,32 @@
+// src/sha256.h
+
+// ---------------------------------------------------------------------------
+// SHA-256 (FIPS 180-4), used to name chunks in the content-addressed store.
+// Incremental: init, update any number of times, final.
+// ---------------------------------------------------------------------------
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t bytes;         // total length so far
+    unsigned char block[64];
+    size_t block_len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_ctx_t *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+// One-shot
+void sha256(const void *data, size_t len, unsigned char digest[SHA256_DIGEST_SIZE]);
+// 64 lowercase hex chars + NUL
+void sha256_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char out[2 * SHA256_DIGEST_SIZE + 1]);
+
+#endif
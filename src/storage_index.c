@@ -0,0 +1,226 @@
+// src/storage_index.c
+
+#define _GNU_SOURCE // statx
+#include "storage_index.h"
+#include "file_io.h"
+#include "store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define DENTS_BUF_SIZE (64 * 1024) // one getdents64 call returns ~1000 entries
+
+struct linux_dirent64
+{
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct
+{
+    metadata_t *m;
+    int root_fd;
+    char **dirs;
+    int num_dirs;
+    _Atomic int next; // next directory to claim
+    _Atomic long files;
+    _Atomic long long bytes;
+} index_job_t;
+
+// Calls fn(entry, arg) for every entry of the directory behind fd
+static int for_each_entry(int fd, char *buf, void (*fn)(struct linux_dirent64 *, void *), void *arg)
+{
+    for (;;)
+    {
+        long n = syscall(SYS_getdents64, fd, buf, DENTS_BUF_SIZE);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            return 0;
+        for (long off = 0; off < n;)
+        {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            fn(d, arg);
+            off += d->d_reclen;
+        }
+    }
+}
+
+typedef struct
+{
+    index_job_t *job;
+    int dir_fd;
+    const char *username;
+} user_scan_t;
+
+static void index_file(struct linux_dirent64 *d, void *arg)
+{
+    user_scan_t *scan = arg;
+    if (d->d_name[0] == '.' && (!d->d_name[1] || !strcmp(d->d_name, "..")))
+        return;
+    if (strncmp(d->d_name, STAGE_PREFIX, strlen(STAGE_PREFIX)) == 0)
+        return; // upload that never committed
+    if (d->d_type != DT_REG && d->d_type != DT_UNKNOWN)
+        return;
+
+    struct statx stx;
+    if (statx(scan->dir_fd, d->d_name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+              STATX_TYPE | STATX_SIZE, &stx) != 0 || !S_ISREG(stx.stx_mode))
+        return;
+
+    // a chunk-store manifest records the logical size
+    long long size = store->stored_size(scan->dir_fd, d->d_name, stx.stx_size);
+    if (size < 0)
+        return;
+
+    if (metadata_add_file(scan->job->m, scan->username, d->d_name, (size_t)size) == 0)
+    {
+        atomic_fetch_add_explicit(&scan->job->files, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&scan->job->bytes, (size_t)size, memory_order_relaxed);
+    }
+}
+
+static void *index_thread(void *arg)
+{
+    index_job_t *job = arg;
+    char *buf = malloc(DENTS_BUF_SIZE);
+    if (!buf)
+        return NULL;
+
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->num_dirs)
+    {
+        const char *username = job->dirs[i];
+        int fd = openat(job->root_fd, username, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        // an empty password makes the user unclaimed
+        if (metadata_add_user(job->m, username, "") == 0)
+        {
+            user_scan_t scan = {job, fd, username};
+            if (for_each_entry(fd, buf, index_file, &scan) != 0)
+                perror("storage index: getdents64");
+        }
+        close(fd);
+    }
+    free(buf);
+    return NULL;
+}
+
+// Files the store keeps outside the user directories (store.h scan)
+static void index_stored_file(const char *username, const char *filename, size_t size, void *arg)
+{
+    index_job_t *job = arg;
+    if (metadata_add_user(job->m, username, "") == -1)
+        return;
+    if (metadata_add_file(job->m, username, filename, size) == 0)
+    {
+        atomic_fetch_add_explicit(&job->files, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&job->bytes, size, memory_order_relaxed);
+    }
+}
+
+typedef struct
+{
+    int root_fd;
+    char **dirs;
+    int num_dirs, cap;
+} dir_list_t;
+
+static void collect_dir(struct linux_dirent64 *d, void *arg)
+{
+    dir_list_t *list = arg;
+    if (!storage_name_valid(d->d_name)) // ".", "..", .chunks, .packs: not users
+        return;
+    if (strlen(d->d_name) >= sizeof(((user_t *)0)->username))
+        return;
+    if (d->d_type == DT_UNKNOWN)
+    {
+        struct statx stx;
+        if (statx(list->root_fd, d->d_name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE, &stx) != 0 ||
+            !S_ISDIR(stx.stx_mode))
+            return;
+    }
+    else if (d->d_type != DT_DIR)
+        return;
+
+    if (list->num_dirs == list->cap)
+    {
+        int cap = list->cap ? list->cap * 2 : 64;
+        char **dirs = realloc(list->dirs, cap * sizeof(char *));
+        if (!dirs)
+            return;
+        list->dirs = dirs;
+        list->cap = cap;
+    }
+    char *name = strdup(d->d_name);
+    if (name)
+        list->dirs[list->num_dirs++] = name;
+}
+
+int storage_index_build(metadata_t *m, const char *root)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+        return -1;
+
+    dir_list_t list = {root_fd, NULL, 0, 0};
+    char *buf = malloc(DENTS_BUF_SIZE);
+    if (!buf || for_each_entry(root_fd, buf, collect_dir, &list) != 0)
+    {
+        perror("storage index");
+        free(buf);
+        close(root_fd);
+        return -1;
+    }
+    free(buf);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = cpus > 0 ? (int)cpus : 1;
+    if (num_threads > STORAGE_INDEX_MAX_THREADS)
+        num_threads = STORAGE_INDEX_MAX_THREADS;
+    if (num_threads > list.num_dirs)
+        num_threads = list.num_dirs;
+
+    index_job_t job = {.m = m, .root_fd = root_fd, .dirs = list.dirs, .num_dirs = list.num_dirs};
+    atomic_init(&job.next, 0);
+    atomic_init(&job.files, 0);
+    atomic_init(&job.bytes, 0);
+
+    // what is on disk is taken as is, even past the quota
+    m->recovering = 1;
+    pthread_t threads[STORAGE_INDEX_MAX_THREADS];
+    for (int i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, index_thread, &job);
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    if (store->scan)
+        store->scan(index_stored_file, &job);
+    m->recovering = 0;
+
+    for (int i = 0; i < list.num_dirs; i++)
+        free(list.dirs[i]);
+    free(list.dirs);
+    close(root_fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Storage index: %d users, %ld files, %lld bytes in %.1f ms (%d threads)\n",
+           list.num_dirs, (long)atomic_load(&job.files), (long long)atomic_load(&job.bytes),
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6, num_threads);
+    fflush(stdout);
+    return list.num_dirs;
+}
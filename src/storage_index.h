@@ -0,0 +1,26 @@
+// src/storage_index.h
+
+// ---------------------------------------------------------------------------
+// Cold-start rebuild of the metadata from the storage tree.
+// Used when STORAGE_DIR has user directories but no persisted metadata: every
+// user directory becomes an unclaimed user (see metadata.h) holding its files
+// and their sizes, quota included. Directories are spread over a few threads;
+// each lists its directory with getdents64() into a large buffer and sizes the
+// entries with statx() relative to the directory fd, so there is no opendir /
+// path building / stat() per file as in list_user_dir. Only files whose size
+// could be a chunk manifest's are opened, to read the logical size from the
+// header (store.h stored_size).
+// Skips dot entries at the top level (.chunks, .packs) and in-flight upload stages.
+// ---------------------------------------------------------------------------
+
+#ifndef STORAGE_INDEX_H
+#define STORAGE_INDEX_H
+
+#include "metadata.h"
+
+#define STORAGE_INDEX_MAX_THREADS 8
+
+// Returns the number of users indexed, -1 if root can't be read
+int storage_index_build(metadata_t *m, const char *root);
+
+#endif
@@ -0,0 +1,235 @@
+// src/store.c
+
+#include "store.h"
+#include "store_chunk.h"
+#include "file_io.h"
+#include "protocol.h"
+#include "io_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(STORE_PLAIN)
+const store_ops_t *store = &store_plain_ops;
+#elif defined(STORE_PACK)
+const store_ops_t *store = &store_pack_ops;
+#else
+const store_ops_t *store = &store_chunk_ops;
+#endif
+
+// ========================================================
+// Stored file helpers
+// ========================================================
+static int store_file_push(store_file_t *f, const store_seg_t *seg)
+{
+    // grow in powers of two
+    if ((f->nsegs & (f->nsegs - 1)) == 0)
+    {
+        store_seg_t *segs = realloc(f->segs, (f->nsegs ? f->nsegs * 2 : 1) * sizeof(store_seg_t));
+        if (!segs)
+            return -1;
+        f->segs = segs;
+    }
+    f->segs[f->nsegs++] = *seg;
+    return 0;
+}
+
+int store_file_add(store_file_t *f, int fd, off_t off, size_t len)
+{
+    store_seg_t seg = {.fd = fd, .off = off, .len = len};
+    if (store_file_push(f, &seg) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+int store_file_add_pinned(store_file_t *f, const unsigned char *hash, size_t len)
+{
+    store_seg_t seg = {.fd = -1, .off = 0, .len = len};
+    memcpy(seg.hash, hash, SHA256_DIGEST_SIZE);
+    if (store_file_push(f, &seg) != 0)
+    {
+        store_chunk_unpin(hash);
+        return -1;
+    }
+    return 0;
+}
+
+int store_seg_open(store_seg_t *seg)
+{
+    if (seg->fd >= 0)
+        return 0;
+    seg->fd = store_chunk_open_pinned(seg->hash);
+    return seg->fd >= 0 ? 0 : -1;
+}
+
+void store_seg_close(store_seg_t *seg)
+{
+    if (seg->fd >= 0)
+        close(seg->fd);
+    else
+        store_chunk_unpin(seg->hash);
+    seg->fd = -1;
+    seg->len = 0;
+}
+
+void store_file_close(store_file_t *f)
+{
+    for (int i = 0; i < f->nsegs; i++)
+        store_seg_close(&f->segs[i]);
+    free(f->segs);
+    f->segs = NULL;
+    f->nsegs = 0;
+    f->size = 0;
+}
+
+// Every segment's read is queued at once (IO_RING_DEPTH at a time), so a
+// chunked file keeps the device busy instead of waiting on each chunk.
+// Segments not opened yet are opened as their batch comes up.
+ssize_t store_file_read(store_file_t *f, void *buf, size_t cap)
+{
+    size_t got = 0;
+    for (int base = 0; base < f->nsegs && got < cap; base += IO_RING_DEPTH)
+    {
+        int res[IO_RING_DEPTH];
+        size_t at[IO_RING_DEPTH], want[IO_RING_DEPTH];
+        int n = 0;
+        for (int i = base; i < f->nsegs && i < base + IO_RING_DEPTH && got < cap; i++, n++)
+        {
+            if (store_seg_open(&f->segs[i]) != 0)
+            {
+                io_ring_wait(); // the reads queued so far still land in buf
+                return -1;
+            }
+            at[n] = got;
+            want[n] = f->segs[i].len < cap - got ? f->segs[i].len : cap - got;
+            io_ring_read(f->segs[i].fd, (char *)buf + got, want[n], f->segs[i].off, &res[n]);
+            got += want[n];
+        }
+        io_ring_wait();
+
+        // short reads are finished in place
+        for (int k = 0; k < n; k++)
+        {
+            const store_seg_t *seg = &f->segs[base + k];
+            size_t done = res[k] > 0 ? (size_t)res[k] : 0;
+            if (res[k] < 0 && res[k] != -EINTR)
+                return -1;
+            while (done < want[k])
+            {
+                ssize_t r = pread(seg->fd, (char *)buf + at[k] + done, want[k] - done, seg->off + done);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0)
+                    return -1; // truncated underneath us
+                done += r;
+            }
+        }
+    }
+    return got;
+}
+
+int store_delta_size(const char *stage_path, size_t *size)
+{
+    unsigned char hdr[PROTO_DELTA_HDR_SIZE];
+    int fd = open(stage_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, hdr, sizeof(hdr), 0);
+    close(fd);
+    if (n != (ssize_t)sizeof(hdr) || memcmp(hdr, PROTO_DELTA_MAGIC, 8) != 0)
+        return -1;
+    *size = (size_t)proto_get_be(hdr + 8, 8);
+    return 0;
+}
+
+// ========================================================
+// Plain backend: the staging file is renamed over the target
+// ========================================================
+static int plain_init(void)
+{
+    return 0;
+}
+
+static void plain_shutdown(void)
+{
+}
+
+static int plain_commit(const char *stage_path, const char *username, const char *filename)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+
+    char user_dir[512];
+    snprintf(user_dir, sizeof(user_dir), USER_DIR_FORMAT, username);
+    sync_set_t sync = {0};
+
+    // never rename a file whose data isn't on disk
+    if (sync_set_add_path(&sync, stage_path) != 0 || storage_sync(&sync) != 0)
+        return -1;
+    if (rename(stage_path, full_path) == -1)
+    {
+        perror("rename stage");
+        return -1;
+    }
+    if (sync_set_add_path(&sync, user_dir) != 0)
+        return -1;
+    return storage_sync(&sync);
+}
+
+static int plain_open(const char *username, const char *filename, store_file_t *f)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+
+    memset(f, 0, sizeof(*f));
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+    f->size = (size_t)st.st_size;
+    return store_file_add(f, fd, 0, f->size);
+}
+
+static int plain_remove(const char *username, const char *filename)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+    return unlink(full_path);
+}
+
+static long long plain_stored_size(int dir_fd, const char *name, size_t disk_size)
+{
+    (void)dir_fd;
+    (void)name;
+    return (long long)disk_size;
+}
+
+// Whole files only: no chunk list to diff against
+static int plain_list_chunks(const char *username, const char *filename, store_chunk_ref_t **refs, uint32_t *count)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+
+static int plain_commit_delta(const char *stage_path, const char *username, const char *filename)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+
+const store_ops_t store_plain_ops = {
+    "plain", plain_init, plain_shutdown, plain_commit, plain_open, plain_remove, plain_stored_size,
+    plain_list_chunks, plain_commit_delta, NULL, 0, NULL,
+};
@@ -0,0 +1,103 @@
+// src/store.h
+
+// ---------------------------------------------------------------------------
+// Where file bodies live. Uploads land in a staging file first (file_io.h),
+// or stay in memory if the backend takes small bodies whole (inline_max); a
+// store backend decides what "commit" turns that into and how a stored file
+// is read back, as a list of (fd, offset, length) segments the
+// reactor can sendfile() one after the other. A segment may be left unopened
+// (a chunk pinned by the chunk store) and opened only when a reader reaches
+// it, so a file of thousands of chunks doesn't hold thousands of fds.
+//   store_plain_ops: one file per user file, committed by rename
+//   store_chunk_ops: content-addressed chunks shared across users, the user
+//                    file is a manifest listing them (store_chunk.c)
+//   store_pack_ops:  small files appended to shared segment files, bigger
+//                    ones handed to the chunk store (store_pack.c)
+// The backend is picked at build time (STORE_BACKEND in the Makefile) and
+// reached through the 'store' pointer.
+// ---------------------------------------------------------------------------
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "sha256.h"
+
+typedef struct store_seg
+{
+    int fd;     // owned by the store_file_t; -1 = not opened yet
+    off_t off;
+    size_t len;
+    unsigned char hash[SHA256_DIGEST_SIZE]; // fd -1: the pinned chunk
+} store_seg_t;
+
+// An opened stored file: the segments pin this version even if it is
+// replaced or deleted meanwhile
+typedef struct
+{
+    size_t size;
+    int nsegs;
+    store_seg_t *segs;
+} store_file_t;
+
+// One entry of a stored file's chunk list
+typedef struct
+{
+    unsigned char hash[SHA256_DIGEST_SIZE];
+    uint32_t len;
+} store_chunk_ref_t;
+
+typedef struct store_ops
+{
+    const char *name;
+    int (*init)(void);      // startup, after the storage dir exists
+    void (*shutdown)(void);
+    // Publish a finished staging file as username/filename, durably (the
+    // staging file is consumed on success)
+    int (*commit)(const char *stage_path, const char *username, const char *filename);
+    int (*open)(const char *username, const char *filename, store_file_t *f);
+    int (*remove)(const char *username, const char *filename);
+    // Logical size of the directory entry 'name' (dir_fd = user dir) whose
+    // on-disk size is disk_size; -1 if it is not a stored file
+    long long (*stored_size)(int dir_fd, const char *name, size_t disk_size);
+    // Delta uploads (protocol.h); -1 with errno ENOTSUP if the backend has no
+    // chunks. list_chunks returns a malloc'd array.
+    int (*list_chunks)(const char *username, const char *filename, store_chunk_ref_t **refs, uint32_t *count);
+    // Publish a staged UPLOAD_DELTA body like commit(); -1 with errno EINVAL
+    // if the recipe is malformed or names a chunk the file doesn't have
+    int (*commit_delta)(const char *stage_path, const char *username, const char *filename);
+    // Files kept outside the user directories, for the startup index: calls
+    // fn for each of them. NULL if the backend has none.
+    void (*scan)(void (*fn)(const char *username, const char *filename, size_t size, void *arg), void *arg);
+    // Bodies up to inline_max bytes are kept in memory by the reactor and
+    // published from there by commit_buffer, like commit(). 0 / NULL if the
+    // backend stages everything.
+    size_t inline_max;
+    int (*commit_buffer)(const unsigned char *data, size_t len, const char *username, const char *filename);
+} store_ops_t;
+
+extern const store_ops_t store_plain_ops;
+extern const store_ops_t store_chunk_ops;
+extern const store_ops_t store_pack_ops;
+extern const store_ops_t *store; // the configured backend
+
+// Helpers shared by the backends and their users
+void store_file_close(store_file_t *f);
+// Copy up to cap bytes from the start of the file; bytes read or -1
+ssize_t store_file_read(store_file_t *f, void *buf, size_t cap);
+// Add one segment (takes ownership of fd); 0 or -1
+int store_file_add(store_file_t *f, int fd, off_t off, size_t len);
+// Add an unopened segment: the whole chunk 'hash', pinned by the caller (the
+// pin is taken over, and dropped if this fails); 0 or -1
+int store_file_add_pinned(store_file_t *f, const unsigned char *hash, size_t len);
+// Give a segment its fd before reading it; 0 or -1 (the segment stays valid
+// for store_seg_close either way)
+int store_seg_open(store_seg_t *seg);
+// Close the segment's fd, or unpin its chunk if it was never opened
+void store_seg_close(store_seg_t *seg);
+// Logical size announced by a staged UPLOAD_DELTA body; 0 or -1
+int store_delta_size(const char *stage_path, size_t *size);
+
+#endif
@@ -0,0 +1,1229 @@
+// src/store_chunk.c
+
+#include "store_chunk.h"
+#include "protocol.h"
+#include "io_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define MANIFEST_HDR 24 // magic, u64 size, u32 count, u32 reserved
+#define MANIFEST_ENT (SHA256_DIGEST_SIZE + 4)
+
+typedef struct chunk_ent
+{
+    struct chunk_ent *next;
+    unsigned char hash[SHA256_DIGEST_SIZE];
+    uint32_t len;
+    uint32_t refs;
+    uint32_t pins; // opened files that haven't reached this chunk yet
+    int synced;    // fsynced by a commit that referenced it (or found at startup)
+} chunk_ent_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    chunk_ent_t **buckets;
+    unsigned int cap, count;
+} chunk_shard_t;
+
+typedef store_chunk_ref_t manifest_ent_t; // what list_chunks hands out
+
+typedef struct
+{
+    size_t size;
+    uint32_t count, cap;
+    manifest_ent_t *ents;
+} manifest_t;
+
+static chunk_shard_t shards[CHUNK_SHARDS];
+static pthread_mutex_t stripes[CHUNK_FILE_STRIPES];
+
+// ========================================================
+// Chunk index
+// ========================================================
+
+// The digest is uniform: shard by the first byte, bucket by the next four
+static chunk_shard_t *shard_of(const unsigned char *hash)
+{
+    return &shards[hash[0] % CHUNK_SHARDS];
+}
+
+static unsigned int bucket_hash(const unsigned char *hash)
+{
+    uint32_t h;
+    memcpy(&h, hash + 1, sizeof(h));
+    return h;
+}
+
+// Caller holds the shard lock; 'link' gets the pointer to the entry (or the
+// chain end)
+static chunk_ent_t *shard_find(chunk_shard_t *sh, const unsigned char *hash, chunk_ent_t ***link)
+{
+    if (!sh->cap)
+    {
+        if (link)
+            *link = NULL;
+        return NULL;
+    }
+    chunk_ent_t **pp = &sh->buckets[bucket_hash(hash) & (sh->cap - 1)];
+    while (*pp && memcmp((*pp)->hash, hash, SHA256_DIGEST_SIZE) != 0)
+        pp = &(*pp)->next;
+    if (link)
+        *link = pp;
+    return *pp;
+}
+
+static chunk_ent_t *shard_insert(chunk_shard_t *sh, const unsigned char *hash, uint32_t len)
+{
+    if (sh->count >= sh->cap)
+    {
+        unsigned int cap = sh->cap ? sh->cap * 2 : 256;
+        chunk_ent_t **buckets = calloc(cap, sizeof(chunk_ent_t *));
+        if (!buckets)
+            return NULL;
+        for (unsigned int i = 0; i < sh->cap; i++)
+        {
+            chunk_ent_t *e = sh->buckets[i];
+            while (e)
+            {
+                chunk_ent_t *next = e->next;
+                chunk_ent_t **b = &buckets[bucket_hash(e->hash) & (cap - 1)];
+                e->next = *b;
+                *b = e;
+                e = next;
+            }
+        }
+        free(sh->buckets);
+        sh->buckets = buckets;
+        sh->cap = cap;
+    }
+
+    chunk_ent_t *e = malloc(sizeof(chunk_ent_t));
+    if (!e)
+        return NULL;
+    memcpy(e->hash, hash, SHA256_DIGEST_SIZE);
+    e->len = len;
+    e->refs = e->pins = 0;
+    e->synced = 0;
+    chunk_ent_t **b = &sh->buckets[bucket_hash(hash) & (sh->cap - 1)];
+    e->next = *b;
+    *b = e;
+    sh->count++;
+    return e;
+}
+
+static void chunk_path(const unsigned char *hash, char *out, size_t size)
+{
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    sha256_hex(hash, hex);
+    snprintf(out, size, CHUNK_DIR "/%.2s/%s", hex, hex);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// What one commit must fsync before its manifest goes in (file_io.h): the
+// chunks it wrote, the ones it references that nobody has synced yet, their
+// directories, and the manifest itself
+typedef struct
+{
+    sync_set_t sync;
+    unsigned char dirs[256 / 8]; // CHUNK_DIR/<first byte> already in 'sync'
+} chunk_sync_t;
+
+// Add a chunk (fd, or -1 to open it by path) and, once, its directory
+static int chunk_sync_add(chunk_sync_t *cs, const unsigned char *hash, int fd)
+{
+    char path[512];
+    chunk_path(hash, path, sizeof(path));
+    if ((fd < 0 ? sync_set_add_path(&cs->sync, path) : sync_set_add(&cs->sync, fd)) != 0)
+        return -1;
+    if (!(cs->dirs[hash[0] / 8] & (1u << (hash[0] % 8))))
+    {
+        snprintf(path, sizeof(path), CHUNK_DIR "/%02x", hash[0]);
+        if (sync_set_add_path(&cs->sync, path) != 0)
+            return -1;
+        cs->dirs[hash[0] / 8] |= (unsigned char)(1u << (hash[0] % 8));
+    }
+    return 0;
+}
+
+// The commit's sync went through: its chunks are on disk
+static void chunk_mark_synced(const manifest_t *m)
+{
+    for (uint32_t i = 0; i < m->count; i++)
+    {
+        chunk_shard_t *sh = shard_of(m->ents[i].hash);
+        pthread_mutex_lock(&sh->lock);
+        chunk_ent_t *e = shard_find(sh, m->ents[i].hash, NULL);
+        if (e)
+            e->synced = 1;
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+// Take one more reference on a chunk that must already be stored
+static int chunk_ref_existing(const unsigned char *hash, uint32_t len)
+{
+    chunk_shard_t *sh = shard_of(hash);
+    pthread_mutex_lock(&sh->lock);
+    chunk_ent_t *e = shard_find(sh, hash, NULL);
+    if (e && e->len == len)
+        e->refs++;
+    pthread_mutex_unlock(&sh->lock);
+    return e && e->len == len ? 0 : -1;
+}
+
+// 1 if every entry names a chunk in the index with that length: a file that
+// merely starts like a manifest (a plain file from before the chunk store)
+// must not be able to name someone else's chunks
+static int manifest_known(const manifest_t *m)
+{
+    for (uint32_t i = 0; i < m->count; i++)
+    {
+        chunk_shard_t *sh = shard_of(m->ents[i].hash);
+        pthread_mutex_lock(&sh->lock);
+        chunk_ent_t *e = shard_find(sh, m->ents[i].hash, NULL);
+        int ok = e && e->len == m->ents[i].len;
+        pthread_mutex_unlock(&sh->lock);
+        if (!ok)
+            return 0;
+    }
+    return 1;
+}
+
+// Drop one reference (pin: one pin); the chunk goes once it has neither
+static void chunk_release(const unsigned char *hash, int pin)
+{
+    chunk_shard_t *sh = shard_of(hash);
+    chunk_ent_t **link;
+    pthread_mutex_lock(&sh->lock);
+    chunk_ent_t *e = shard_find(sh, hash, &link);
+    if (e && (pin ? --e->pins : --e->refs) == 0 && e->refs == 0 && e->pins == 0)
+    {
+        char path[512];
+        chunk_path(hash, path, sizeof(path));
+        unlink(path);
+        *link = e->next;
+        sh->count--;
+        free(e);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static void chunk_unref(const unsigned char *hash)
+{
+    chunk_release(hash, 0);
+}
+
+// Keep a chunk on disk for an opened file that will read it later. Pins
+// aren't references: they don't count as stored data of anyone's.
+static int chunk_pin(const unsigned char *hash, uint32_t len)
+{
+    chunk_shard_t *sh = shard_of(hash);
+    pthread_mutex_lock(&sh->lock);
+    chunk_ent_t *e = shard_find(sh, hash, NULL);
+    if (e && e->len == len)
+        e->pins++;
+    pthread_mutex_unlock(&sh->lock);
+    return e && e->len == len ? 0 : -1;
+}
+
+int store_chunk_open_pinned(const unsigned char *hash)
+{
+    char path[512];
+    chunk_path(hash, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+        chunk_release(hash, 1); // the fd keeps the data now
+    return fd;
+}
+
+void store_chunk_unpin(const unsigned char *hash)
+{
+    chunk_release(hash, 1);
+}
+
+static void manifest_unref(const manifest_t *m)
+{
+    for (uint32_t i = 0; i < m->count; i++)
+        chunk_unref(m->ents[i].hash);
+}
+
+// ========================================================
+// Manifests
+// ========================================================
+static int manifest_add(manifest_t *m, const unsigned char *hash, uint32_t len)
+{
+    if (m->count == m->cap)
+    {
+        uint32_t cap = m->cap ? m->cap * 2 : 16;
+        manifest_ent_t *ents = realloc(m->ents, cap * sizeof(manifest_ent_t));
+        if (!ents)
+            return -1;
+        m->ents = ents;
+        m->cap = cap;
+    }
+    memcpy(m->ents[m->count].hash, hash, SHA256_DIGEST_SIZE);
+    m->ents[m->count].len = len;
+    m->count++;
+    m->size += len;
+    return 0;
+}
+
+static void manifest_free(manifest_t *m)
+{
+    free(m->ents);
+    memset(m, 0, sizeof(*m));
+}
+
+// 1 = manifest read into m, 0 = not a manifest (a plain file), -1 = error
+static int manifest_read(int fd, manifest_t *m)
+{
+    unsigned char hdr[MANIFEST_HDR];
+    memset(m, 0, sizeof(*m));
+    ssize_t n = pread(fd, hdr, sizeof(hdr), 0);
+    if (n < 0)
+        return -1;
+    if (n < (ssize_t)sizeof(hdr) || memcmp(hdr, MANIFEST_MAGIC, 8) != 0)
+        return 0;
+
+    uint64_t size;
+    uint32_t count;
+    memcpy(&size, hdr + 8, sizeof(size));
+    memcpy(&count, hdr + 16, sizeof(count));
+
+    size_t body = (size_t)count * MANIFEST_ENT;
+    unsigned char *buf = malloc(body ? body : 1);
+    if (!buf || pread(fd, buf, body, MANIFEST_HDR) != (ssize_t)body)
+    {
+        free(buf);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t len;
+        memcpy(&len, buf + i * MANIFEST_ENT + SHA256_DIGEST_SIZE, sizeof(len));
+        if (manifest_add(m, buf + i * MANIFEST_ENT, len) != 0)
+        {
+            free(buf);
+            manifest_free(m);
+            return -1;
+        }
+    }
+    free(buf);
+    if (m->size != size)
+    {
+        manifest_free(m);
+        return -1;
+    }
+    return 1;
+}
+
+static int manifest_write(int fd, const manifest_t *m)
+{
+    size_t len = MANIFEST_HDR + (size_t)m->count * MANIFEST_ENT;
+    unsigned char *buf = calloc(1, len);
+    if (!buf)
+        return -1;
+    uint64_t size = m->size;
+    memcpy(buf, MANIFEST_MAGIC, 8);
+    memcpy(buf + 8, &size, sizeof(size));
+    memcpy(buf + 16, &m->count, sizeof(m->count));
+    for (uint32_t i = 0; i < m->count; i++)
+    {
+        memcpy(buf + MANIFEST_HDR + i * MANIFEST_ENT, m->ents[i].hash, SHA256_DIGEST_SIZE);
+        memcpy(buf + MANIFEST_HDR + i * MANIFEST_ENT + SHA256_DIGEST_SIZE, &m->ents[i].len, 4);
+    }
+    int rc = write_all(fd, buf, len);
+    free(buf);
+    return rc;
+}
+
+// Manifest at 'path', if it is one; 0 when missing or a plain file
+static int manifest_load(const char *path, manifest_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    int rc = manifest_read(fd, m);
+    close(fd);
+    return rc;
+}
+
+static pthread_mutex_t *stripe_of(const char *username, const char *filename)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    h = (h ^ '/') * 16777619u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return &stripes[h % CHUNK_FILE_STRIPES];
+}
+
+// ========================================================
+// Chunk writes
+// ========================================================
+// New chunks of one commit, written a batch at a time: every file of the
+// batch is created, then every body written, each step all in flight through
+// the worker's io_ring. The data stays in the caller's buffer until flushed.
+typedef struct
+{
+    unsigned char hash[SHA256_DIGEST_SIZE];
+    const unsigned char *data;
+    uint32_t len;
+    unsigned long tmp_no; // 0: no file of ours
+    int fd, res, held;
+} chunk_slot_t;
+
+typedef struct
+{
+    chunk_slot_t slots[IO_RING_DEPTH];
+    int count;
+} chunk_batch_t;
+
+static atomic_ulong next_tmp_no;
+
+// Staging name of a new chunk: unique per writer, since two commits can write
+// the same chunk at once and only the first to finish publishes it
+static void chunk_tmp_path(const chunk_slot_t *s, char *out, size_t size)
+{
+    char path[512];
+    chunk_path(s->hash, path, sizeof(path));
+    snprintf(out, size, "%s.%lu.tmp", path, s->tmp_no);
+}
+
+// Reference the chunk under the shard lock if it is in the index (adding it
+// to the commit's sync while nobody has synced it); 1 = referenced
+static int chunk_ref_indexed(chunk_shard_t *sh, const unsigned char *hash, chunk_sync_t *cs, int *err)
+{
+    chunk_ent_t *e = shard_find(sh, hash, NULL);
+    if (!e)
+        return 0;
+    if (!e->synced && chunk_sync_add(cs, hash, -1) != 0)
+        *err = -1;
+    else
+        e->refs++;
+    return 1;
+}
+
+static void chunk_batch_add(chunk_batch_t *b, const unsigned char *hash, const unsigned char *data, uint32_t len)
+{
+    chunk_slot_t *s = &b->slots[b->count++];
+    memcpy(s->hash, hash, SHA256_DIGEST_SIZE);
+    s->data = data;
+    s->len = len;
+}
+
+// Take a reference on every chunk of the batch, writing the ones nobody has
+// yet, and append them to 'held' in batch order. A chunk is renamed into
+// place and inserted under its shard lock, so one in the index is always on
+// disk (pending the committer's sync); a commit that finds it there first
+// drops its own copy. On failure nothing of the batch is held. The batch is
+// empty afterwards.
+static int chunk_batch_flush(chunk_batch_t *b, manifest_t *held, chunk_sync_t *cs)
+{
+    char tmp[600], path[512];
+    int err = 0;
+
+    // ---- known chunks: just a reference; the rest get a staging file ----
+    for (int i = 0; i < b->count; i++)
+    {
+        chunk_slot_t *s = &b->slots[i];
+        chunk_shard_t *sh = shard_of(s->hash);
+        s->fd = -1;
+        s->tmp_no = 0;
+        pthread_mutex_lock(&sh->lock);
+        int found = !err && chunk_ref_indexed(sh, s->hash, cs, &err);
+        pthread_mutex_unlock(&sh->lock);
+        s->held = found && !err;
+        if (!err && !found)
+        {
+            s->tmp_no = atomic_fetch_add(&next_tmp_no, 1) + 1;
+            chunk_tmp_path(s, tmp, sizeof(tmp));
+            io_ring_openat(AT_FDCWD, tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600, &s->res);
+        }
+    }
+    io_ring_wait();
+
+    // ---- write the new ones ----
+    for (int i = 0; i < b->count; i++)
+    {
+        chunk_slot_t *s = &b->slots[i];
+        if (!s->tmp_no)
+            continue;
+        if (s->res < 0)
+        {
+            s->tmp_no = 0; // nothing was created
+            err = -1;
+            continue;
+        }
+        s->fd = s->res;
+        if (!err)
+            io_ring_write(s->fd, s->data, s->len, 0, &s->res);
+    }
+    io_ring_wait();
+
+    // ---- publish them ----
+    for (int i = 0; i < b->count; i++)
+    {
+        chunk_slot_t *s = &b->slots[i];
+        if (!s->tmp_no)
+            continue;
+        chunk_tmp_path(s, tmp, sizeof(tmp));
+        if (!err && s->res >= 0 && (uint32_t)s->res < s->len) // short write: finish it
+            s->res = lseek(s->fd, s->res, SEEK_SET) == s->res && write_all(s->fd, s->data + s->res, s->len - s->res) == 0
+                         ? (int)s->len
+                         : -1;
+        if (err || s->res < 0)
+        {
+            if (!err)
+                perror("chunk write");
+            err = -1;
+            close(s->fd);
+            unlink(tmp);
+            continue;
+        }
+
+        chunk_shard_t *sh = shard_of(s->hash);
+        pthread_mutex_lock(&sh->lock);
+        if (chunk_ref_indexed(sh, s->hash, cs, &err))
+        {
+            // another commit published it meanwhile
+            s->held = !err;
+            close(s->fd);
+            unlink(tmp);
+        }
+        else
+        {
+            chunk_path(s->hash, path, sizeof(path));
+            chunk_ent_t *e = NULL;
+            if (rename(tmp, path) != 0)
+            {
+                perror("chunk rename");
+                close(s->fd);
+                unlink(tmp);
+                err = -1;
+            }
+            else if (chunk_sync_add(cs, s->hash, s->fd) != 0 || !(e = shard_insert(sh, s->hash, s->len)))
+            {
+                unlink(path);
+                err = -1;
+            }
+            else
+            {
+                e->refs++;
+                s->held = 1;
+            }
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+
+    for (int i = 0; i < b->count; i++)
+    {
+        chunk_slot_t *s = &b->slots[i];
+        if (!s->held)
+            continue;
+        if (err || manifest_add(held, s->hash, s->len) != 0)
+        {
+            err = -1;
+            chunk_unref(s->hash);
+        }
+    }
+    b->count = 0;
+    return err;
+}
+
+// ========================================================
+// Backend ops
+// ========================================================
+// Write the manifest for username/filename and swap it in, durably. Takes
+// over the references held by 'm' (released on failure) and the chunks
+// queued in 'cs'; the replaced version's chunks are released once the new
+// manifest is on disk.
+static int publish_manifest(manifest_t *m, const char *username, const char *filename, chunk_sync_t *cs)
+{
+    char full_path[512], user_dir[512], tmp[600];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+    snprintf(user_dir, sizeof(user_dir), USER_DIR_FORMAT, username);
+
+    // the manifest is staged next to the target like any upload
+    int err = 0;
+    snprintf(tmp, sizeof(tmp), USER_DIR_FORMAT "/" STAGE_PREFIX "%s.manifest.XXXXXX", username, filename);
+    int mfd = mkstemp(tmp);
+    if (mfd < 0 || manifest_write(mfd, m) != 0)
+    {
+        if (mfd >= 0)
+            close(mfd);
+        err = -1;
+    }
+    else if (sync_set_add(&cs->sync, mfd) != 0)
+        err = -1;
+    if (err)
+        sync_set_release(&cs->sync);
+    else if (storage_sync(&cs->sync) != 0) // chunks + manifest durable
+        err = -1;
+    else
+        chunk_mark_synced(m);
+    if (err)
+    {
+        if (mfd >= 0)
+            unlink(tmp);
+        manifest_unref(m);
+        manifest_free(m);
+        return -1;
+    }
+
+    // swap manifests; readers open under the same stripe
+    pthread_mutex_t *stripe = stripe_of(username, filename);
+    manifest_t old;
+    pthread_mutex_lock(stripe);
+    int had_old = manifest_load(full_path, &old) == 1;
+    if (rename(tmp, full_path) != 0)
+    {
+        pthread_mutex_unlock(stripe);
+        perror("rename manifest");
+        unlink(tmp);
+        if (had_old)
+            manifest_free(&old);
+        manifest_unref(m);
+        manifest_free(m);
+        return -1;
+    }
+    pthread_mutex_unlock(stripe);
+    manifest_free(m);
+
+    int rc = sync_set_add_path(&cs->sync, user_dir);
+    if (rc == 0)
+        rc = storage_sync(&cs->sync);
+    else
+        sync_set_release(&cs->sync);
+    // the old chunks may go once nothing durable points at them
+    if (had_old)
+    {
+        if (rc == 0)
+            manifest_unref(&old);
+        manifest_free(&old);
+    }
+    return rc;
+}
+
+static int chunk_commit(const char *stage_path, const char *username, const char *filename)
+{
+    int fd = open(stage_path, O_RDONLY | O_CLOEXEC);
+    unsigned char *buf = malloc(CHUNK_BATCH_BYTES);
+    if (fd < 0 || !buf)
+    {
+        if (fd >= 0)
+            close(fd);
+        free(buf);
+        return -1;
+    }
+
+    // cut and name every chunk; the chunker needs a full window of
+    // CDC_MAX_SIZE bytes (or the end of the file) to pick each cut. The
+    // batch points into the buffer, so it is flushed before the buffer moves.
+    manifest_t m = {0};
+    chunk_sync_t cs = {0};
+    chunk_batch_t batch = {0};
+    int err = 0, eof = 0;
+    size_t filled = 0, pos = 0;
+    for (;;)
+    {
+        if (!eof && filled - pos < CDC_MAX_SIZE)
+        {
+            if (chunk_batch_flush(&batch, &m, &cs) != 0)
+            {
+                err = -1;
+                break;
+            }
+            memmove(buf, buf + pos, filled - pos);
+            filled -= pos;
+            pos = 0;
+        }
+        while (!eof && filled < CHUNK_BATCH_BYTES)
+        {
+            ssize_t n = read(fd, buf + filled, CHUNK_BATCH_BYTES - filled);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                err = -1;
+            if (n <= 0)
+                eof = 1;
+            else
+                filled += n;
+        }
+        if (err || filled == pos)
+            break;
+
+        size_t len = cdc_cut(buf + pos, filled - pos);
+        unsigned char hash[SHA256_DIGEST_SIZE];
+        sha256(buf + pos, len, hash);
+        if (batch.count == IO_RING_DEPTH && chunk_batch_flush(&batch, &m, &cs) != 0)
+        {
+            err = -1;
+            break;
+        }
+        chunk_batch_add(&batch, hash, buf + pos, (uint32_t)len);
+        pos += len;
+    }
+    if (!err && chunk_batch_flush(&batch, &m, &cs) != 0) // the chunks in 'm' are referenced
+        err = -1;
+    close(fd);
+    free(buf);
+
+    if (err)
+    {
+        sync_set_release(&cs.sync);
+        manifest_unref(&m);
+        manifest_free(&m);
+        return -1;
+    }
+    if (publish_manifest(&m, username, filename, &cs) != 0)
+        return -1;
+    unlink(stage_path);
+    return 0;
+}
+
+static int chunk_list_chunks(const char *username, const char *filename, store_chunk_ref_t **refs, uint32_t *count)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+
+    pthread_mutex_t *stripe = stripe_of(username, filename);
+    manifest_t m;
+    pthread_mutex_lock(stripe);
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    int rc = fd < 0 ? -1 : manifest_read(fd, &m);
+    if (rc == 1 && !manifest_known(&m))
+    {
+        manifest_free(&m);
+        rc = -1;
+    }
+    pthread_mutex_unlock(stripe);
+    if (fd >= 0)
+        close(fd);
+    if (rc < 0)
+        return -1;
+
+    // a plain file has no chunks to share: the client sends everything
+    *refs = rc == 1 ? m.ents : NULL;
+    *count = rc == 1 ? m.count : 0;
+    return 0;
+}
+
+static int manifest_has(const manifest_t *m, const unsigned char *hash, uint32_t len)
+{
+    for (uint32_t i = 0; i < m->count; i++)
+        if (m->ents[i].len == len && memcmp(m->ents[i].hash, hash, SHA256_DIGEST_SIZE) == 0)
+            return 1;
+    return 0;
+}
+
+static int chunk_commit_delta(const char *stage_path, const char *username, const char *filename)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+
+    int fd = open(stage_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // ---- recipe header and entries ----
+    struct stat st;
+    unsigned char hdr[PROTO_DELTA_HDR_SIZE];
+    unsigned char *ents = NULL, *buf = NULL;
+    uint64_t size = 0, sum = 0, data = 0;
+    uint32_t count = 0;
+    int err = fstat(fd, &st) != 0 || pread(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+              memcmp(hdr, PROTO_DELTA_MAGIC, 8) != 0;
+    if (!err)
+    {
+        size = proto_get_be(hdr + 8, 8);
+        count = (uint32_t)proto_get_be(hdr + 16, 4);
+        err = PROTO_DELTA_HDR_SIZE + (uint64_t)count * PROTO_DELTA_ENT_SIZE > (uint64_t)st.st_size;
+    }
+    size_t ents_len = (size_t)count * PROTO_DELTA_ENT_SIZE;
+    if (!err)
+        err = !(ents = malloc(ents_len ? ents_len : 1)) ||
+              pread(fd, ents, ents_len, PROTO_DELTA_HDR_SIZE) != (ssize_t)ents_len;
+    for (uint32_t i = 0; !err && i < count; i++)
+    {
+        const unsigned char *e = ents + (size_t)i * PROTO_DELTA_ENT_SIZE;
+        uint32_t len = (uint32_t)proto_get_be(e + SHA256_DIGEST_SIZE, 4);
+        err = len == 0 || len > CDC_MAX_SIZE;
+        sum += len;
+        if (e[SHA256_DIGEST_SIZE + 4])
+            data += len;
+    }
+    // the body holds exactly the announced chunks and adds up to 'size'
+    if (!err)
+        err = sum != size || PROTO_DELTA_HDR_SIZE + ents_len + data != (uint64_t)st.st_size;
+    if (err)
+    {
+        free(ents);
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // ---- pass 1: chunks taken from the current version ----
+    // Referenced under the stripe so that version can't release them first.
+    // Only the file's own chunks count: naming a hash proves nothing about
+    // owning its content.
+    pthread_mutex_t *stripe = stripe_of(username, filename);
+    manifest_t cur;
+    uint32_t taken = 0;
+    pthread_mutex_lock(stripe);
+    int have_cur = manifest_load(full_path, &cur) == 1;
+    for (; taken < count; taken++)
+    {
+        const unsigned char *e = ents + (size_t)taken * PROTO_DELTA_ENT_SIZE;
+        uint32_t len = (uint32_t)proto_get_be(e + SHA256_DIGEST_SIZE, 4);
+        if (e[SHA256_DIGEST_SIZE + 4])
+            continue;
+        if (!have_cur || !manifest_has(&cur, e, len) || chunk_ref_existing(e, len) != 0)
+            break;
+    }
+    pthread_mutex_unlock(stripe);
+    if (have_cur)
+        manifest_free(&cur);
+
+    // ---- pass 2: store the carried chunks, build the manifest in order ----
+    // Carried chunks are read into the buffer and written a batch at a time;
+    // 'got' holds the references the batches took, pass 1 the others.
+    manifest_t m = {0}, got = {0};
+    chunk_sync_t cs = {0};
+    chunk_batch_t batch = {0};
+    size_t pos = 0;
+    off_t off = PROTO_DELTA_HDR_SIZE + ents_len;
+    err = 0;
+    if (taken < count)
+        err = EINVAL;
+    else if (!(buf = malloc(CHUNK_BATCH_BYTES)))
+        err = -1;
+    for (uint32_t i = 0; !err && i < count; i++)
+    {
+        const unsigned char *e = ents + (size_t)i * PROTO_DELTA_ENT_SIZE;
+        uint32_t len = (uint32_t)proto_get_be(e + SHA256_DIGEST_SIZE, 4);
+        if (e[SHA256_DIGEST_SIZE + 4])
+        {
+            unsigned char hash[SHA256_DIGEST_SIZE];
+            if (batch.count == IO_RING_DEPTH || pos + len > CHUNK_BATCH_BYTES)
+            {
+                if (chunk_batch_flush(&batch, &got, &cs) != 0)
+                {
+                    err = -1;
+                    break;
+                }
+                pos = 0;
+            }
+            if (pread(fd, buf + pos, len, off) != (ssize_t)len)
+            {
+                err = -1;
+                break;
+            }
+            off += len;
+            sha256(buf + pos, len, hash);
+            if (memcmp(hash, e, SHA256_DIGEST_SIZE) != 0)
+            {
+                err = EINVAL;
+                break;
+            }
+            chunk_batch_add(&batch, hash, buf + pos, len);
+            pos += len;
+        }
+        if (manifest_add(&m, e, len) != 0)
+            err = -1;
+    }
+    if (!err && chunk_batch_flush(&batch, &got, &cs) != 0)
+        err = -1;
+    close(fd);
+    free(buf);
+
+    if (err)
+    {
+        // give back what pass 1 took and the batches got
+        uint32_t end = taken < count ? taken : count;
+        for (uint32_t j = 0; j < end; j++)
+        {
+            const unsigned char *e = ents + (size_t)j * PROTO_DELTA_ENT_SIZE;
+            if (!e[SHA256_DIGEST_SIZE + 4])
+                chunk_unref(e);
+        }
+        free(ents);
+        sync_set_release(&cs.sync);
+        manifest_unref(&got);
+        manifest_free(&got);
+        manifest_free(&m);
+        errno = err == -1 ? EIO : EINVAL;
+        return -1;
+    }
+    free(ents);
+    manifest_free(&got); // its references are the carried entries of 'm' now
+
+    if (publish_manifest(&m, username, filename, &cs) != 0)
+        return -1;
+    unlink(stage_path);
+    return 0;
+}
+
+static int chunk_open(const char *username, const char *filename, store_file_t *f)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+    memset(f, 0, sizeof(*f));
+
+    pthread_mutex_t *stripe = stripe_of(username, filename);
+    pthread_mutex_lock(stripe);
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        pthread_mutex_unlock(stripe);
+        return -1;
+    }
+
+    manifest_t m;
+    int rc = manifest_read(fd, &m);
+    if (rc == 0)
+    {
+        // plain file from before the chunk store
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            pthread_mutex_unlock(stripe);
+            return -1;
+        }
+        pthread_mutex_unlock(stripe);
+        f->size = (size_t)st.st_size;
+        return store_file_add(f, fd, 0, f->size);
+    }
+    close(fd);
+    if (rc == 1 && !manifest_known(&m))
+    {
+        fprintf(stderr, "chunk store: %s names chunks it doesn't hold, not opening it\n", full_path);
+        manifest_free(&m);
+        rc = -1;
+    }
+    if (rc < 0)
+    {
+        pthread_mutex_unlock(stripe);
+        return -1;
+    }
+
+    // the chunk fds, and the references held for chunks not opened yet, pin
+    // this version once the stripe is released. Only the first
+    // CHUNK_OPEN_AHEAD chunks are opened here, IO_RING_DEPTH at a time rather
+    // than one path lookup after another; the sender opens the rest as it
+    // reaches them, so a download holds a bounded number of fds.
+    uint32_t ahead = m.count < CHUNK_OPEN_AHEAD ? m.count : CHUNK_OPEN_AHEAD;
+    for (uint32_t base = 0; base < ahead && rc > 0; base += IO_RING_DEPTH)
+    {
+        int fds[IO_RING_DEPTH];
+        uint32_t n = ahead - base < IO_RING_DEPTH ? ahead - base : IO_RING_DEPTH;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            char path[512];
+            chunk_path(m.ents[base + i].hash, path, sizeof(path));
+            io_ring_openat(AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0, &fds[i]);
+        }
+        io_ring_wait();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (fds[i] < 0)
+                rc = -1;
+            else if (rc < 0)
+                close(fds[i]);
+            else if (store_file_add(f, fds[i], 0, m.ents[base + i].len) != 0)
+                rc = -1;
+        }
+    }
+    for (uint32_t i = ahead; i < m.count && rc > 0; i++)
+        if (chunk_pin(m.ents[i].hash, m.ents[i].len) != 0 ||
+            store_file_add_pinned(f, m.ents[i].hash, m.ents[i].len) != 0)
+            rc = -1;
+    pthread_mutex_unlock(stripe);
+
+    f->size = m.size;
+    manifest_free(&m);
+    if (rc < 0)
+    {
+        store_file_close(f);
+        return -1;
+    }
+    return 0;
+}
+
+static int chunk_remove(const char *username, const char *filename)
+{
+    char full_path[512];
+    snprintf(full_path, sizeof(full_path), FULL_PATH_FORMAT, username, filename);
+
+    pthread_mutex_t *stripe = stripe_of(username, filename);
+    manifest_t m;
+    pthread_mutex_lock(stripe);
+    int is_manifest = manifest_load(full_path, &m) == 1;
+    int rc = unlink(full_path);
+    int err = errno;
+    pthread_mutex_unlock(stripe);
+
+    if (is_manifest)
+    {
+        if (rc == 0)
+            manifest_unref(&m);
+        manifest_free(&m);
+    }
+    errno = err; // callers report ENOENT
+    return rc;
+}
+
+// Only a file whose size fits a manifest (header plus whole entries) is
+// opened to look at its header; any other size is a plain file's, so the
+// cold-start index sizes almost every file from its statx() alone
+static long long chunk_stored_size(int dir_fd, const char *name, size_t disk_size)
+{
+    if (disk_size < MANIFEST_HDR || (disk_size - MANIFEST_HDR) % MANIFEST_ENT != 0)
+        return (long long)disk_size;
+
+    unsigned char hdr[MANIFEST_HDR];
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, hdr, sizeof(hdr), 0);
+    close(fd);
+    uint32_t count;
+    memcpy(&count, hdr + 16, sizeof(count));
+    if (n == (ssize_t)sizeof(hdr) && memcmp(hdr, MANIFEST_MAGIC, 8) == 0 &&
+        count == (disk_size - MANIFEST_HDR) / MANIFEST_ENT)
+    {
+        uint64_t size;
+        memcpy(&size, hdr + 8, sizeof(size));
+        return (long long)size;
+    }
+    return (long long)disk_size;
+}
+
+// ---- startup: reference counts from the manifests, then garbage ----
+
+static void count_user_dir(const char *username, size_t *files)
+{
+    char dir_path[512];
+    snprintf(dir_path, sizeof(dir_path), USER_DIR_FORMAT, username);
+    DIR *d = opendir(dir_path);
+    if (!d)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        if (e->d_name[0] == '.' && (!e->d_name[1] || !strcmp(e->d_name, "..")))
+            continue;
+        if (strncmp(e->d_name, STAGE_PREFIX, strlen(STAGE_PREFIX)) == 0)
+            continue;
+
+        manifest_t m;
+        int fd = openat(dirfd(d), e->d_name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (manifest_read(fd, &m) == 1)
+        {
+            for (uint32_t i = 0; i < m.count; i++)
+            {
+                chunk_shard_t *sh = shard_of(m.ents[i].hash);
+                chunk_ent_t *c = shard_find(sh, m.ents[i].hash, NULL);
+                if (!c)
+                    c = shard_insert(sh, m.ents[i].hash, m.ents[i].len);
+                if (c)
+                {
+                    c->refs++;
+                    c->synced = 1; // a published manifest names it
+                }
+            }
+            manifest_free(&m);
+            (*files)++;
+        }
+        close(fd);
+    }
+    closedir(d);
+}
+
+static size_t collect_garbage(void)
+{
+    size_t removed = 0;
+    for (int b = 0; b < 256; b++)
+    {
+        char sub[512];
+        snprintf(sub, sizeof(sub), CHUNK_DIR "/%02x", b);
+        DIR *d = opendir(sub);
+        if (!d)
+            continue;
+        int res[IO_RING_DEPTH], queued = 0;
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL)
+        {
+            if (e->d_name[0] == '.')
+                continue;
+            unsigned char hash[SHA256_DIGEST_SIZE];
+            int valid = strlen(e->d_name) == 2 * SHA256_DIGEST_SIZE;
+            for (int i = 0; valid && i < SHA256_DIGEST_SIZE; i++)
+            {
+                unsigned int byte;
+                valid = sscanf(e->d_name + 2 * i, "%2x", &byte) == 1;
+                hash[i] = (unsigned char)byte;
+            }
+            // half-written (.tmp) or no manifest points at it
+            if (!valid || !shard_find(shard_of(hash), hash, NULL))
+            {
+                if (queued == IO_RING_DEPTH)
+                {
+                    io_ring_wait();
+                    queued = 0;
+                }
+                io_ring_unlinkat(dirfd(d), e->d_name, 0, &res[queued++]);
+                removed++;
+            }
+        }
+        io_ring_wait(); // before the directory fd goes away
+        closedir(d);
+    }
+    return removed;
+}
+
+static int chunk_init(void)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (int i = 0; i < CHUNK_SHARDS; i++)
+        pthread_mutex_init(&shards[i].lock, NULL);
+    for (int i = 0; i < CHUNK_FILE_STRIPES; i++)
+        pthread_mutex_init(&stripes[i], NULL);
+
+    // directories made here are synced into their parents
+    sync_set_t sync = {0};
+    int err = 0, made_sub = 0;
+    if (mkdir(CHUNK_DIR, 0700) == 0)
+        err = sync_set_add_path(&sync, STORAGE_DIR);
+    else if (errno != EEXIST)
+        err = -1;
+    for (int b = 0; b < 256 && !err; b++)
+    {
+        char sub[512];
+        snprintf(sub, sizeof(sub), CHUNK_DIR "/%02x", b);
+        if (mkdir(sub, 0700) == 0)
+        {
+            if (!made_sub++)
+                err = sync_set_add_path(&sync, CHUNK_DIR);
+        }
+        else if (errno != EEXIST)
+            err = -1;
+    }
+    if (err || storage_sync(&sync) != 0)
+    {
+        perror("mkdir chunks");
+        sync_set_release(&sync);
+        return -1;
+    }
+
+    size_t files = 0;
+    DIR *d = opendir(STORAGE_DIR);
+    if (d)
+    {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL)
+            if (storage_name_valid(e->d_name)) // not ".", "..", .chunks, .packs
+                count_user_dir(e->d_name, &files);
+        closedir(d);
+    }
+    size_t removed = collect_garbage();
+
+    chunk_stats_t st;
+    store_chunk_stats(&st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Chunk store: %zu chunks (%zu bytes stored, %zu logical) for %zu files, %zu orphans removed in %.1f ms\n",
+           st.chunks, st.stored_bytes, st.logical_bytes, files, removed,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    fflush(stdout);
+    return 0;
+}
+
+static void chunk_shutdown(void)
+{
+    chunk_stats_t st;
+    store_chunk_stats(&st);
+    printf("Chunk store: %zu chunks, %zu bytes stored for %zu logical bytes\n",
+           st.chunks, st.stored_bytes, st.logical_bytes);
+
+    for (int i = 0; i < CHUNK_SHARDS; i++)
+    {
+        chunk_shard_t *sh = &shards[i];
+        for (unsigned int b = 0; b < sh->cap; b++)
+        {
+            chunk_ent_t *e = sh->buckets[b];
+            while (e)
+            {
+                chunk_ent_t *next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+        free(sh->buckets);
+        sh->buckets = NULL;
+        sh->cap = sh->count = 0;
+        pthread_mutex_destroy(&sh->lock);
+    }
+    for (int i = 0; i < CHUNK_FILE_STRIPES; i++)
+        pthread_mutex_destroy(&stripes[i]);
+}
+
+void store_chunk_stats(chunk_stats_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < CHUNK_SHARDS; i++)
+    {
+        chunk_shard_t *sh = &shards[i];
+        pthread_mutex_lock(&sh->lock);
+        for (unsigned int b = 0; b < sh->cap; b++)
+        {
+            for (chunk_ent_t *e = sh->buckets[b]; e; e = e->next)
+            {
+                st->chunks++;
+                st->stored_bytes += e->len;
+                st->logical_bytes += (size_t)e->len * e->refs;
+            }
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+const store_ops_t store_chunk_ops = {
+    "chunk", chunk_init, chunk_shutdown, chunk_commit, chunk_open, chunk_remove, chunk_stored_size,
+    chunk_list_chunks, chunk_commit_delta, NULL, 0, NULL,
+};
@@ -0,0 +1,55 @@
+// src/store_chunk.h
+
+// ---------------------------------------------------------------------------
+// Content-addressed store backend (store_chunk_ops, see store.h).
+// A committed body is cut into content-defined chunks (cdc.h) named by their
+// SHA-256 and kept once under STORAGE_DIR/.chunks/<2 hex>/<64 hex>, however
+// many files of however many users contain them. Because cut points follow
+// the content, an edited file shares every chunk away from the edit with its
+// previous version, which is what delta uploads (protocol.h) build on.
+// The user's file becomes a manifest:
+//   "DBCM0001" | u64 size | u32 count | u32 0 | count x (32-byte hash, u32 len)
+// Chunk reference counts live in memory, sharded by hash; they are rebuilt
+// from the manifests at startup, which also deletes chunks nobody references
+// (left by a crash between writing chunks and publishing the manifest).
+// Commit order: chunks + manifest written, sync, manifest renamed over the
+// old one, sync, only then the old version's chunks are released.
+// Files from the plain backend (no manifest header) are still readable.
+// Quota is unaffected: it counts logical sizes per user.
+// ---------------------------------------------------------------------------
+
+#ifndef STORE_CHUNK_H
+#define STORE_CHUNK_H
+
+#include "store.h"
+#include "file_io.h"
+#include "sha256.h"
+#include "cdc.h"
+#include "io_ring.h"
+#include <stdint.h>
+
+#define CHUNK_DIR STORAGE_DIR "/.chunks"
+#define CHUNK_SHARDS 64       // index shards (own mutex each)
+#define CHUNK_FILE_STRIPES 64 // per user/file serialization of commit, open, remove
+#define MANIFEST_MAGIC "DBCM0001"
+#ifndef CHUNK_OPEN_AHEAD
+#define CHUNK_OPEN_AHEAD IO_RING_DEPTH // chunks opened by open(), the rest are pinned
+#endif
+#define CHUNK_BATCH_BYTES (4 * CDC_MAX_SIZE) // commit read window, its new chunks written as one batch
+
+typedef struct
+{
+    size_t chunks;        // distinct chunks on disk
+    size_t stored_bytes;  // their total size
+    size_t logical_bytes; // sum over all references
+} chunk_stats_t;
+
+void store_chunk_stats(chunk_stats_t *st);
+
+// Segments open() leaves unopened (store.h) pin their chunk on disk:
+// open_pinned trades the pin for an fd (fd or -1, the pin kept on failure),
+// unpin drops it
+int store_chunk_open_pinned(const unsigned char *hash);
+void store_chunk_unpin(const unsigned char *hash);
+
+#endif
@@ -0,0 +1,1049 @@
+// src/store_pack.c
+
+#include "store_pack.h"
+#include "store_chunk.h"
+#include "crc32.h"
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define REC_HDR 24
+#define REC_PUT 1
+#define REC_DEL 2
+#define REC_SUPERSEDES 3
+
+typedef struct pack_seg
+{
+    struct pack_seg *next;
+    int fd;
+    unsigned int no;
+    off_t size;
+} pack_seg_t;
+
+typedef struct pack_ent
+{
+    struct pack_ent *next;
+    unsigned int hash;
+    pack_seg_t *seg;
+    off_t off;        // record start
+    uint32_t rec_len; // whole record
+    uint32_t len;     // data
+    uint64_t seq;
+    int deleted;      // replay only: tombstone still shadowing older records
+    uint16_t ulen, flen;
+    char key[];       // user NUL file NUL
+} pack_ent_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pack_seg_t *segs; // oldest first
+    pack_seg_t *active;
+    unsigned int next_no;
+    pack_ent_t **buckets;
+    unsigned int cap, count;
+    size_t live_bytes, disk_bytes;
+} pack_shard_t;
+
+static pack_shard_t shards[PACK_SHARDS];
+static pthread_mutex_t stripes[PACK_FILE_STRIPES];
+static _Atomic uint64_t next_seq;
+static _Atomic unsigned long compactions;
+
+static pthread_t compactor;
+static pthread_mutex_t compact_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compact_cond = PTHREAD_COND_INITIALIZER;
+static int compact_pending, compact_stop;
+static pthread_mutex_t compacting = PTHREAD_MUTEX_INITIALIZER; // one compaction at a time
+
+// ========================================================
+// Index
+// ========================================================
+static unsigned int key_hash(const char *username, const char *filename)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    h = (h ^ '/') * 16777619u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+static pack_shard_t *shard_of(unsigned int h)
+{
+    return &shards[h % PACK_SHARDS];
+}
+
+static pthread_mutex_t *stripe_of(unsigned int h)
+{
+    return &stripes[(h / PACK_SHARDS) % PACK_FILE_STRIPES];
+}
+
+// Caller holds the shard lock
+static pack_ent_t **ent_link(pack_shard_t *sh, unsigned int h, const char *username, const char *filename)
+{
+    if (!sh->cap)
+        return NULL;
+    pack_ent_t **pp = &sh->buckets[h & (sh->cap - 1)];
+    for (; *pp; pp = &(*pp)->next)
+    {
+        pack_ent_t *e = *pp;
+        if (e->hash == h && !strcmp(e->key, username) && !strcmp(e->key + e->ulen + 1, filename))
+            return pp;
+    }
+    return pp;
+}
+
+static pack_ent_t *ent_find(pack_shard_t *sh, unsigned int h, const char *username, const char *filename)
+{
+    pack_ent_t **pp = ent_link(sh, h, username, filename);
+    return pp ? *pp : NULL;
+}
+
+static pack_ent_t *ent_insert(pack_shard_t *sh, unsigned int h, const char *username, const char *filename)
+{
+    if (sh->count >= sh->cap)
+    {
+        unsigned int cap = sh->cap ? sh->cap * 2 : 256;
+        pack_ent_t **buckets = calloc(cap, sizeof(pack_ent_t *));
+        if (!buckets)
+            return NULL;
+        for (unsigned int i = 0; i < sh->cap; i++)
+        {
+            pack_ent_t *e = sh->buckets[i];
+            while (e)
+            {
+                pack_ent_t *next = e->next;
+                pack_ent_t **b = &buckets[e->hash & (cap - 1)];
+                e->next = *b;
+                *b = e;
+                e = next;
+            }
+        }
+        free(sh->buckets);
+        sh->buckets = buckets;
+        sh->cap = cap;
+    }
+
+    size_t ulen = strlen(username), flen = strlen(filename);
+    pack_ent_t *e = calloc(1, sizeof(pack_ent_t) + ulen + flen + 2);
+    if (!e)
+        return NULL;
+    e->hash = h;
+    e->ulen = (uint16_t)ulen;
+    e->flen = (uint16_t)flen;
+    memcpy(e->key, username, ulen + 1);
+    memcpy(e->key + ulen + 1, filename, flen + 1);
+    pack_ent_t **b = &sh->buckets[h & (sh->cap - 1)];
+    e->next = *b;
+    *b = e;
+    sh->count++;
+    return e;
+}
+
+static void ent_unlink(pack_shard_t *sh, pack_ent_t **link)
+{
+    pack_ent_t *e = *link;
+    *link = e->next;
+    sh->count--;
+    free(e);
+}
+
+// ========================================================
+// Segments and records
+// ========================================================
+static void seg_path(int shard, unsigned int no, char *out, size_t size)
+{
+    snprintf(out, size, PACK_DIR "/%02d-%08u.pack", shard, no);
+}
+
+// Open (creating) segment 'no' of the shard and append it to its list
+static pack_seg_t *seg_open(pack_shard_t *sh, unsigned int no)
+{
+    char path[512];
+    seg_path((int)(sh - shards), no, path, sizeof(path));
+    pack_seg_t *s = calloc(1, sizeof(pack_seg_t));
+    if (!s)
+        return NULL;
+    s->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st;
+    if (s->fd < 0 || fstat(s->fd, &st) != 0)
+    {
+        perror("pack segment");
+        if (s->fd >= 0)
+            close(s->fd);
+        free(s);
+        return NULL;
+    }
+    s->no = no;
+    s->size = st.st_size;
+    if (no >= sh->next_no)
+        sh->next_no = no + 1;
+
+    pack_seg_t **pp = &sh->segs;
+    while (*pp)
+        pp = &(*pp)->next;
+    *pp = s;
+    return s;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, off_t off)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Header + names of a record; the caller appends 'len' data bytes and the
+// crc is finished over them by rec_seal()
+static size_t rec_build(unsigned char *rec, int type, uint64_t seq, const char *username, const char *filename,
+                        uint32_t len)
+{
+    uint16_t ulen = (uint16_t)strlen(username), flen = (uint16_t)strlen(filename);
+    memset(rec, 0, REC_HDR);
+    memcpy(rec + 4, &len, 4);
+    memcpy(rec + 8, &seq, 8);
+    memcpy(rec + 16, &ulen, 2);
+    memcpy(rec + 18, &flen, 2);
+    rec[20] = (unsigned char)type;
+    memcpy(rec + REC_HDR, username, ulen);
+    memcpy(rec + REC_HDR + ulen, filename, flen);
+    return REC_HDR + ulen + flen;
+}
+
+static void rec_seal(unsigned char *rec, size_t rec_len)
+{
+    uint32_t crc = crc32_update(0, rec + 4, rec_len - 4);
+    memcpy(rec, &crc, 4);
+}
+
+static int needs_compaction(const pack_shard_t *sh)
+{
+    size_t dead = sh->disk_bytes - sh->live_bytes;
+    return dead >= PACK_COMPACT_MIN_DEAD && dead >= sh->live_bytes;
+}
+
+static void wake_compactor(void)
+{
+    pthread_mutex_lock(&compact_lock);
+    compact_pending = 1;
+    pthread_cond_signal(&compact_cond);
+    pthread_mutex_unlock(&compact_lock);
+}
+
+// Append a sealed record to the active segment and point the index at it
+// (PUT) or drop the key (DEL). Written under the shard lock so records land
+// in the file in the order they were numbered and a crash can only tear the
+// last one. The segment written (and .packs, if that segment is new) goes
+// into 'sync' when the caller is going to sync the record. Returns -1 on
+// I/O failure.
+static int append_record(pack_shard_t *sh, unsigned int h, const char *username, const char *filename,
+                         int type, const unsigned char *data, uint32_t len, sync_set_t *sync)
+{
+    size_t name_len = strlen(username) + strlen(filename);
+    size_t rec_len = REC_HDR + name_len + len;
+    unsigned char *rec = malloc(rec_len);
+    if (!rec)
+        return -1;
+
+    pthread_mutex_lock(&sh->lock);
+    pack_ent_t **link = ent_link(sh, h, username, filename);
+    pack_ent_t *e = link ? *link : NULL;
+    if (type == REC_DEL && !e)
+    {
+        pthread_mutex_unlock(&sh->lock);
+        free(rec);
+        errno = ENOENT;
+        return -1;
+    }
+
+    int fresh = 0;
+    if (sh->active->size + (off_t)rec_len > PACK_SEGMENT_MAX && sh->active->size > 0)
+    {
+        pack_seg_t *s = seg_open(sh, sh->next_no);
+        if (s)
+            sh->active = s;
+        fresh = s != NULL;
+    }
+    if (sync && (sync_set_add_dup(sync, sh->active->fd) != 0 || (fresh && sync_set_add_path(sync, PACK_DIR) != 0)))
+    {
+        pthread_mutex_unlock(&sh->lock);
+        free(rec);
+        return -1;
+    }
+
+    uint64_t seq = atomic_fetch_add(&next_seq, 1) + 1;
+    size_t hdr_len = rec_build(rec, type, seq, username, filename, len);
+    if (len)
+        memcpy(rec + hdr_len, data, len);
+    rec_seal(rec, rec_len);
+
+    off_t off = sh->active->size;
+    if (pwrite_all(sh->active->fd, rec, rec_len, off) != 0)
+    {
+        perror("pack append");
+        pthread_mutex_unlock(&sh->lock);
+        free(rec);
+        return -1;
+    }
+    sh->active->size += rec_len;
+    sh->disk_bytes += rec_len;
+    free(rec);
+
+    if (e)
+        sh->live_bytes -= e->rec_len;
+    if (type == REC_DEL)
+        ent_unlink(sh, link);
+    else
+    {
+        if (!e && !(e = ent_insert(sh, h, username, filename)))
+        {
+            pthread_mutex_unlock(&sh->lock);
+            return -1; // the record is on disk; only a restart would see it
+        }
+        e->seg = sh->active;
+        e->off = off;
+        e->rec_len = (uint32_t)rec_len;
+        e->len = len;
+        e->seq = seq;
+        sh->live_bytes += rec_len;
+    }
+    int compact = needs_compaction(sh);
+    pthread_mutex_unlock(&sh->lock);
+
+    if (compact)
+        wake_compactor();
+    return 0;
+}
+
+static int packed(pack_shard_t *sh, unsigned int h, const char *username, const char *filename)
+{
+    pthread_mutex_lock(&sh->lock);
+    int found = ent_find(sh, h, username, filename) != NULL;
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+// The file was just published by the chunk store: a packed version would
+// shadow it, so its tombstone is part of the commit and synced with it
+static int retire_packed(pack_shard_t *sh, unsigned int h, const char *username, const char *filename)
+{
+    if (!packed(sh, h, username, filename))
+        return 0;
+    sync_set_t sync = {0};
+    if (append_record(sh, h, username, filename, REC_DEL, NULL, 0, &sync) != 0)
+    {
+        sync_set_release(&sync);
+        return -1;
+    }
+    return storage_sync(&sync);
+}
+
+// ========================================================
+// Compaction
+// ========================================================
+typedef struct
+{
+    pack_seg_t *seg;
+    off_t off;
+    uint32_t rec_len;
+    unsigned int hash;
+    char *username, *filename;
+} move_t;
+
+static void compact_shard_locked(pack_shard_t *sh)
+{
+    int shard = (int)(sh - shards);
+
+    // seal everything there is now; writers move on to a fresh segment
+    pthread_mutex_lock(&sh->lock);
+    pack_seg_t *victims = sh->segs;
+    size_t victim_bytes = 0;
+    int nvictims = 0;
+    for (pack_seg_t *s = victims; s; s = s->next, nvictims++)
+        victim_bytes += s->size;
+    sh->segs = NULL;
+    pack_seg_t *out = seg_open(sh, sh->next_no);
+    pack_seg_t *active = out ? seg_open(sh, sh->next_no) : NULL;
+    size_t nmoves = 0;
+    move_t *moves = active ? malloc((sh->count ? sh->count : 1) * sizeof(move_t)) : NULL;
+    if (!moves)
+    {
+        // put things back as they were
+        pack_seg_t *made[2] = {out, active};
+        for (int i = 0; i < 2; i++)
+        {
+            if (!made[i])
+                continue;
+            char path[512];
+            seg_path(shard, made[i]->no, path, sizeof(path));
+            close(made[i]->fd);
+            unlink(path);
+            free(made[i]);
+        }
+        sh->segs = victims;
+        pthread_mutex_unlock(&sh->lock);
+        return;
+    }
+    sh->active = active;
+
+    // every live record is in a victim: collect them
+    for (unsigned int b = 0; b < sh->cap; b++)
+    {
+        for (pack_ent_t *e = sh->buckets[b]; e; e = e->next)
+        {
+            move_t *mv = &moves[nmoves++];
+            mv->seg = e->seg;
+            mv->off = e->off;
+            mv->rec_len = e->rec_len;
+            mv->hash = e->hash;
+            mv->username = strdup(e->key);
+            mv->filename = strdup(e->key + e->ulen + 1);
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    // copies go after a zeroed slot for the SUPERSEDES record, which is only
+    // written once they are durable: until then a restart sees a corrupt
+    // first record, drops the output and keeps the victims
+    size_t sup_len = REC_HDR + (size_t)nvictims * 4;
+    unsigned char *sup = calloc(1, sup_len);
+    unsigned char *buf = malloc(REC_HDR + 2 * PROTO_MAX_NAME + PACK_MAX_OBJECT);
+    int err = !sup || !buf || pwrite_all(out->fd, sup, sup_len, 0) != 0;
+    off_t out_size = (off_t)sup_len;
+    for (size_t i = 0; !err && i < nmoves; i++)
+    {
+        move_t *mv = &moves[i];
+        if (!mv->username || !mv->filename || pread(mv->seg->fd, buf, mv->rec_len, mv->off) != (ssize_t)mv->rec_len ||
+            pwrite_all(out->fd, buf, mv->rec_len, out_size) != 0)
+        {
+            err = 1;
+            break;
+        }
+        out_size += mv->rec_len;
+    }
+    free(buf);
+
+    // the output and the new active segment are new entries in .packs
+    sync_set_t sync = {0};
+    if (!err && sync_set_add_dup(&sync, out->fd) == 0 && sync_set_add_path(&sync, PACK_DIR) == 0 &&
+        storage_sync(&sync) == 0)
+    {
+        rec_build(sup, REC_SUPERSEDES, 0, "", "", (uint32_t)nvictims * 4);
+        int i = 0;
+        for (pack_seg_t *s = victims; s; s = s->next, i++)
+            memcpy(sup + REC_HDR + i * 4, &s->no, 4);
+        rec_seal(sup, sup_len);
+        err = pwrite_all(out->fd, sup, sup_len, 0) != 0 || sync_set_add_dup(&sync, out->fd) != 0 ||
+              storage_sync(&sync) != 0;
+    }
+    else
+        err = 1;
+    sync_set_release(&sync);
+    free(sup);
+
+    if (!err)
+    {
+        // repoint what wasn't rewritten or deleted meanwhile
+        pthread_mutex_lock(&sh->lock);
+        off_t off = (off_t)sup_len;
+        for (size_t i = 0; i < nmoves; i++)
+        {
+            move_t *mv = &moves[i];
+            pack_ent_t *e = ent_find(sh, mv->hash, mv->username, mv->filename);
+            if (e && e->seg == mv->seg && e->off == mv->off)
+            {
+                e->seg = out;
+                e->off = off;
+            }
+            off += mv->rec_len;
+        }
+        out->size = out_size;
+        sh->disk_bytes = sh->disk_bytes + out_size - victim_bytes;
+        pthread_mutex_unlock(&sh->lock);
+
+        // readers that opened a victim hold their own fd
+        while (victims)
+        {
+            pack_seg_t *next = victims->next;
+            char path[512];
+            seg_path(shard, victims->no, path, sizeof(path));
+            unlink(path);
+            close(victims->fd);
+            free(victims);
+            victims = next;
+        }
+        atomic_fetch_add(&compactions, 1);
+    }
+    else
+    {
+        fprintf(stderr, "pack: compaction of shard %d failed\n", shard);
+        pthread_mutex_lock(&sh->lock);
+        pack_seg_t **pp = &victims;
+        while (*pp)
+            pp = &(*pp)->next;
+        *pp = sh->segs;
+        sh->segs = victims;
+        // nothing points into the output: leave it empty for the next run
+        if (ftruncate(out->fd, 0) != 0)
+            perror("pack: truncate");
+        pthread_mutex_unlock(&sh->lock);
+    }
+
+    for (size_t i = 0; i < nmoves; i++)
+    {
+        free(moves[i].username);
+        free(moves[i].filename);
+    }
+    free(moves);
+}
+
+static void compact_shard(pack_shard_t *sh)
+{
+    pthread_mutex_lock(&compacting);
+    compact_shard_locked(sh);
+    pthread_mutex_unlock(&compacting);
+}
+
+static void *compactor_thread(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&compact_lock);
+    while (!compact_stop)
+    {
+        if (!compact_pending)
+        {
+            pthread_cond_wait(&compact_cond, &compact_lock);
+            continue;
+        }
+        compact_pending = 0;
+        pthread_mutex_unlock(&compact_lock);
+
+        for (int i = 0; i < PACK_SHARDS; i++)
+        {
+            pthread_mutex_lock(&shards[i].lock);
+            int due = needs_compaction(&shards[i]);
+            pthread_mutex_unlock(&shards[i].lock);
+            if (due)
+                compact_shard(&shards[i]);
+        }
+        pthread_mutex_lock(&compact_lock);
+    }
+    pthread_mutex_unlock(&compact_lock);
+    return NULL;
+}
+
+void store_pack_compact_all(void)
+{
+    for (int i = 0; i < PACK_SHARDS; i++)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        int due = shards[i].disk_bytes > shards[i].live_bytes;
+        pthread_mutex_unlock(&shards[i].lock);
+        if (due)
+            compact_shard(&shards[i]);
+    }
+}
+
+// ========================================================
+// Backend ops
+// ========================================================
+// Store a small file as a PUT record, durably, and drop a big predecessor.
+// The caller holds the file's stripe.
+static int put_packed(pack_shard_t *sh, unsigned int h, const char *username, const char *filename,
+                      const unsigned char *data, uint32_t len)
+{
+    sync_set_t sync = {0};
+    if (append_record(sh, h, username, filename, REC_PUT, data, len, &sync) != 0)
+    {
+        sync_set_release(&sync);
+        return -1;
+    }
+    if (storage_sync(&sync) != 0)
+        return -1;
+    // a big predecessor lives in the user dir
+    if (store_chunk_ops.remove(username, filename) != 0 && errno != ENOENT)
+        perror("pack: remove replaced file");
+    return 0;
+}
+
+static int pack_commit(const char *stage_path, const char *username, const char *filename)
+{
+    unsigned int h = key_hash(username, filename);
+    pack_shard_t *sh = shard_of(h);
+    pthread_mutex_t *stripe = stripe_of(h);
+
+    struct stat st;
+    if (stat(stage_path, &st) != 0)
+        return -1;
+
+    pthread_mutex_lock(stripe);
+    if (st.st_size > PACK_MAX_OBJECT)
+    {
+        // big: chunk store, then retire a packed predecessor
+        int rc = store_chunk_ops.commit(stage_path, username, filename);
+        if (rc == 0)
+            rc = retire_packed(sh, h, username, filename);
+        pthread_mutex_unlock(stripe);
+        return rc;
+    }
+
+    // small uploads normally arrive in memory (commit_buffer); this is a
+    // staged one all the same
+    unsigned char *data = malloc(st.st_size ? st.st_size : 1);
+    int fd = open(stage_path, O_RDONLY | O_CLOEXEC);
+    int rc = data && fd >= 0 && pread(fd, data, st.st_size, 0) == st.st_size ? 0 : -1;
+    if (fd >= 0)
+        close(fd);
+    if (rc == 0)
+        rc = put_packed(sh, h, username, filename, data, (uint32_t)st.st_size);
+    free(data);
+    if (rc == 0)
+        unlink(stage_path);
+    pthread_mutex_unlock(stripe);
+    return rc;
+}
+
+// A small body straight from memory: one append, one sync
+static int pack_commit_buffer(const unsigned char *data, size_t len, const char *username, const char *filename)
+{
+    if (len > PACK_MAX_OBJECT)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    unsigned int h = key_hash(username, filename);
+    pthread_mutex_t *stripe = stripe_of(h);
+    pthread_mutex_lock(stripe);
+    int rc = put_packed(shard_of(h), h, username, filename, data, (uint32_t)len);
+    pthread_mutex_unlock(stripe);
+    return rc;
+}
+
+static int pack_open(const char *username, const char *filename, store_file_t *f)
+{
+    unsigned int h = key_hash(username, filename);
+    pack_shard_t *sh = shard_of(h);
+
+    memset(f, 0, sizeof(*f));
+    pthread_mutex_lock(&sh->lock);
+    pack_ent_t *e = ent_find(sh, h, username, filename);
+    if (!e)
+    {
+        pthread_mutex_unlock(&sh->lock);
+        return store_chunk_ops.open(username, filename, f);
+    }
+    // a private fd keeps the record readable if compaction drops the segment
+    int fd = fcntl(e->seg->fd, F_DUPFD_CLOEXEC, 0);
+    off_t off = e->off + REC_HDR + e->ulen + e->flen;
+    size_t len = e->len;
+    pthread_mutex_unlock(&sh->lock);
+    if (fd < 0)
+        return -1;
+
+    f->size = len;
+    return store_file_add(f, fd, off, len);
+}
+
+static int pack_remove(const char *username, const char *filename)
+{
+    unsigned int h = key_hash(username, filename);
+    pack_shard_t *sh = shard_of(h);
+    pthread_mutex_t *stripe = stripe_of(h);
+
+    pthread_mutex_lock(stripe);
+    int rc = packed(sh, h, username, filename)
+                 ? append_record(sh, h, username, filename, REC_DEL, NULL, 0, NULL)
+                 : store_chunk_ops.remove(username, filename);
+    int err = errno;
+    pthread_mutex_unlock(stripe);
+    errno = err;
+    return rc;
+}
+
+static long long pack_stored_size(int dir_fd, const char *name, size_t disk_size)
+{
+    return store_chunk_ops.stored_size(dir_fd, name, disk_size);
+}
+
+static int pack_list_chunks(const char *username, const char *filename, store_chunk_ref_t **refs, uint32_t *count)
+{
+    unsigned int h = key_hash(username, filename);
+    if (packed(shard_of(h), h, username, filename))
+    {
+        // small enough to resend whole
+        *refs = NULL;
+        *count = 0;
+        return 0;
+    }
+    return store_chunk_ops.list_chunks(username, filename, refs, count);
+}
+
+// Deltas are applied by the chunk store (a delta against a packed file
+// carries all of its chunks, see pack_list_chunks)
+static int pack_commit_delta(const char *stage_path, const char *username, const char *filename)
+{
+    unsigned int h = key_hash(username, filename);
+    pack_shard_t *sh = shard_of(h);
+    pthread_mutex_t *stripe = stripe_of(h);
+
+    pthread_mutex_lock(stripe);
+    int rc = store_chunk_ops.commit_delta(stage_path, username, filename);
+    int err = errno;
+    if (rc == 0)
+        rc = retire_packed(sh, h, username, filename);
+    pthread_mutex_unlock(stripe);
+    errno = err;
+    return rc;
+}
+
+static void pack_scan(void (*fn)(const char *username, const char *filename, size_t size, void *arg), void *arg)
+{
+    for (int i = 0; i < PACK_SHARDS; i++)
+    {
+        pack_shard_t *sh = &shards[i];
+        pthread_mutex_lock(&sh->lock);
+        for (unsigned int b = 0; b < sh->cap; b++)
+            for (pack_ent_t *e = sh->buckets[b]; e; e = e->next)
+                fn(e->key, e->key + e->ulen + 1, e->len, arg);
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+// ---- startup: replay the segments ----
+
+// Apply one record read from 'seg' at 'off' to the index
+static void replay_record(pack_shard_t *sh, pack_seg_t *seg, off_t off, const unsigned char *rec, size_t rec_len)
+{
+    uint32_t len;
+    uint64_t seq;
+    uint16_t ulen, flen;
+    memcpy(&len, rec + 4, 4);
+    memcpy(&seq, rec + 8, 8);
+    memcpy(&ulen, rec + 16, 2);
+    memcpy(&flen, rec + 18, 2);
+    int type = rec[20];
+    if (type == REC_SUPERSEDES)
+        return;
+
+    char username[PROTO_MAX_NAME + 1], filename[PROTO_MAX_NAME + 1];
+    memcpy(username, rec + REC_HDR, ulen);
+    username[ulen] = '\0';
+    memcpy(filename, rec + REC_HDR + ulen, flen);
+    filename[flen] = '\0';
+
+    if (seq > atomic_load(&next_seq))
+        atomic_store(&next_seq, seq);
+
+    unsigned int h = key_hash(username, filename);
+    pack_ent_t *e = ent_find(sh, h, username, filename);
+    if (e && e->seq > seq)
+        return; // shadowed by a newer record read earlier
+    if (!e && !(e = ent_insert(sh, h, username, filename)))
+        return;
+    if (!e->deleted && e->seg)
+        sh->live_bytes -= e->rec_len;
+    e->seg = seg;
+    e->off = off;
+    e->rec_len = (uint32_t)rec_len;
+    e->len = len;
+    e->seq = seq;
+    e->deleted = type == REC_DEL;
+    if (!e->deleted)
+        sh->live_bytes += rec_len;
+}
+
+// Read a segment record by record; a torn or corrupt tail is cut off
+static void replay_segment(pack_shard_t *sh, pack_seg_t *seg, unsigned char *buf, size_t cap)
+{
+    off_t off = 0;
+    while (off < seg->size)
+    {
+        unsigned char hdr[REC_HDR];
+        uint32_t crc, len;
+        uint16_t ulen, flen;
+        size_t rec_len = 0;
+        int ok = seg->size - off >= REC_HDR && pread(seg->fd, hdr, REC_HDR, off) == REC_HDR;
+        if (ok)
+        {
+            memcpy(&crc, hdr, 4);
+            memcpy(&len, hdr + 4, 4);
+            memcpy(&ulen, hdr + 16, 2);
+            memcpy(&flen, hdr + 18, 2);
+            rec_len = REC_HDR + (size_t)ulen + flen + len;
+            ok = rec_len <= cap && ulen <= PROTO_MAX_NAME && flen <= PROTO_MAX_NAME &&
+                 rec_len <= (size_t)(seg->size - off) && pread(seg->fd, buf, rec_len, off) == (ssize_t)rec_len &&
+                 crc32_update(0, buf + 4, rec_len - 4) == crc;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "pack: dropping %lld torn bytes at the end of segment %02d-%08u\n",
+                    (long long)(seg->size - off), (int)(sh - shards), seg->no);
+            if (ftruncate(seg->fd, off) != 0)
+                perror("pack: truncate");
+            seg->size = off;
+            break;
+        }
+        replay_record(sh, seg, off, buf, rec_len);
+        off += rec_len;
+    }
+    sh->disk_bytes += seg->size;
+}
+
+// Segment numbers listed by a valid SUPERSEDES record at the start of the
+// segment (malloc'd, *n of them), NULL if it doesn't start with one
+static unsigned int *read_supersedes(int shard, unsigned int no, uint32_t *n)
+{
+    char path[512];
+    seg_path(shard, no, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    unsigned char hdr[REC_HDR];
+    unsigned char *rec = NULL;
+    uint32_t crc, len = 0;
+    if (pread(fd, hdr, REC_HDR, 0) == REC_HDR && hdr[20] == REC_SUPERSEDES)
+    {
+        memcpy(&crc, hdr, 4);
+        memcpy(&len, hdr + 4, 4);
+        rec = len <= PACK_MAX_OBJECT ? malloc(REC_HDR + len) : NULL;
+        if (rec && (pread(fd, rec, REC_HDR + len, 0) != (ssize_t)(REC_HDR + len) ||
+                    crc32_update(0, rec + 4, REC_HDR + len - 4) != crc))
+        {
+            free(rec);
+            rec = NULL;
+        }
+    }
+    close(fd);
+    if (!rec)
+        return NULL;
+
+    memmove(rec, rec + REC_HDR, len);
+    *n = len / 4;
+    return (unsigned int *)rec;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int pack_init(void)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (store_chunk_ops.init() != 0)
+        return -1;
+
+    for (int i = 0; i < PACK_SHARDS; i++)
+        pthread_mutex_init(&shards[i].lock, NULL);
+    for (int i = 0; i < PACK_FILE_STRIPES; i++)
+        pthread_mutex_init(&stripes[i], NULL);
+    atomic_store(&next_seq, 0);
+    compact_stop = compact_pending = 0;
+
+    if (mkdir(PACK_DIR, 0700) == 0)
+    {
+        sync_set_t sync = {0};
+        if (sync_set_add_path(&sync, STORAGE_DIR) != 0 || storage_sync(&sync) != 0)
+        {
+            perror("sync packs");
+            return -1;
+        }
+    }
+    else if (errno != EEXIST)
+    {
+        perror("mkdir packs");
+        return -1;
+    }
+
+    // segment numbers per shard, oldest first
+    unsigned int *nos[PACK_SHARDS] = {0};
+    size_t counts[PACK_SHARDS] = {0}, caps[PACK_SHARDS] = {0};
+    DIR *d = opendir(PACK_DIR);
+    if (!d)
+        return -1;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        int shard;
+        unsigned int no;
+        char tail[8];
+        if (sscanf(de->d_name, "%d-%u.%7s", &shard, &no, tail) != 3 || strcmp(tail, "pack") != 0 ||
+            shard < 0 || shard >= PACK_SHARDS)
+            continue;
+        if (counts[shard] == caps[shard])
+        {
+            caps[shard] = caps[shard] ? caps[shard] * 2 : 16;
+            nos[shard] = realloc(nos[shard], caps[shard] * sizeof(unsigned int));
+        }
+        nos[shard][counts[shard]++] = no;
+    }
+    closedir(d);
+
+    size_t cap = REC_HDR + 2 * PROTO_MAX_NAME + PACK_MAX_OBJECT;
+    unsigned char *buf = malloc(cap);
+    size_t segments = 0;
+    for (int i = 0; i < PACK_SHARDS; i++)
+    {
+        pack_shard_t *sh = &shards[i];
+        if (counts[i])
+            qsort(nos[i], counts[i], sizeof(unsigned int), cmp_uint);
+
+        // a compaction output: whatever it replaces is gone for good
+        for (size_t k = 0; k < counts[i]; k++)
+        {
+            uint32_t n = 0;
+            unsigned int *old = read_supersedes(i, nos[i][k], &n);
+            for (uint32_t j = 0; old && j < n; j++)
+            {
+                for (size_t m = 0; m < counts[i]; m++)
+                {
+                    if (nos[i][m] != old[j] || m == k)
+                        continue;
+                    char path[512];
+                    seg_path(i, old[j], path, sizeof(path));
+                    unlink(path);
+                    nos[i][m] = UINT32_MAX;
+                }
+            }
+            free(old);
+        }
+
+        for (size_t k = 0; k < counts[i]; k++)
+        {
+            pack_seg_t *seg = nos[i][k] == UINT32_MAX ? NULL : seg_open(sh, nos[i][k]);
+            if (seg && buf)
+                replay_segment(sh, seg, buf, cap);
+            segments += seg != NULL;
+        }
+
+        // tombstones have done their job
+        for (unsigned int b = 0; b < sh->cap; b++)
+        {
+            pack_ent_t **link = &sh->buckets[b];
+            while (*link)
+            {
+                if ((*link)->deleted)
+                    ent_unlink(sh, link);
+                else
+                    link = &(*link)->next;
+            }
+        }
+
+        // append to the newest segment unless it is full
+        pack_seg_t *last = sh->segs;
+        while (last && last->next)
+            last = last->next;
+        sh->active = last && last->size < PACK_SEGMENT_MAX ? last : seg_open(sh, sh->next_no);
+        free(nos[i]);
+        if (!sh->active)
+        {
+            free(buf);
+            return -1;
+        }
+    }
+    free(buf);
+
+    pthread_create(&compactor, NULL, compactor_thread, NULL);
+
+    pack_stats_t st;
+    store_pack_stats(&st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Pack store: %zu files (%zu live of %zu bytes) in %zu segments, replayed in %.1f ms\n",
+           st.objects, st.live_bytes, st.disk_bytes, segments,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    fflush(stdout);
+    wake_compactor(); // in case the last run left enough garbage behind
+    return 0;
+}
+
+static void pack_shutdown(void)
+{
+    pthread_mutex_lock(&compact_lock);
+    compact_stop = 1;
+    pthread_cond_signal(&compact_cond);
+    pthread_mutex_unlock(&compact_lock);
+    pthread_join(compactor, NULL);
+
+    pack_stats_t st;
+    store_pack_stats(&st);
+    printf("Pack store: %zu files, %zu live of %zu bytes in %zu segments, %lu compactions\n",
+           st.objects, st.live_bytes, st.disk_bytes, st.segments, st.compactions);
+
+    for (int i = 0; i < PACK_SHARDS; i++)
+    {
+        pack_shard_t *sh = &shards[i];
+        for (unsigned int b = 0; b < sh->cap; b++)
+        {
+            pack_ent_t *e = sh->buckets[b];
+            while (e)
+            {
+                pack_ent_t *next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+        free(sh->buckets);
+        while (sh->segs)
+        {
+            pack_seg_t *next = sh->segs->next;
+            close(sh->segs->fd);
+            free(sh->segs);
+            sh->segs = next;
+        }
+        pthread_mutex_destroy(&sh->lock);
+        memset(sh, 0, sizeof(*sh));
+    }
+    for (int i = 0; i < PACK_FILE_STRIPES; i++)
+        pthread_mutex_destroy(&stripes[i]);
+
+    store_chunk_ops.shutdown();
+}
+
+void store_pack_stats(pack_stats_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < PACK_SHARDS; i++)
+    {
+        pack_shard_t *sh = &shards[i];
+        pthread_mutex_lock(&sh->lock);
+        st->objects += sh->count;
+        st->live_bytes += sh->live_bytes;
+        st->disk_bytes += sh->disk_bytes;
+        for (pack_seg_t *s = sh->segs; s; s = s->next)
+            st->segments++;
+        pthread_mutex_unlock(&sh->lock);
+    }
+    st->compactions = atomic_load(&compactions);
+}
+
+const store_ops_t store_pack_ops = {
+    "pack", pack_init, pack_shutdown, pack_commit, pack_open, pack_remove, pack_stored_size,
+    pack_list_chunks, pack_commit_delta, pack_scan, PACK_MAX_OBJECT, pack_commit_buffer,
+};
@@ -0,0 +1,55 @@
+// src/store_pack.h
+
+// ---------------------------------------------------------------------------
+// Packed small-file backend (store_pack_ops, STORE_BACKEND=pack; see store.h).
+// Files up to PACK_MAX_OBJECT bytes don't get a file of their own: they are
+// appended as records to per-shard segment files, STORAGE_DIR/.packs/
+// <shard>-<n>.pack, and found through an in-memory index (user/file ->
+// segment, offset). A small upload never touches a staging file: its body is
+// held in memory (inline_max) and committed as one sequential append plus
+// the shared group-committed sync; a download is a pread/sendfile from an
+// open segment.
+// Larger files go to the chunk store (store_chunk.h) unchanged.
+//
+// Record: u32 crc | u32 len | u64 seq | u16 user_len | u16 file_len | u8 type
+//         | 3 pad | user | file | len bytes of data       (crc covers the rest)
+//   PUT: the file's content, DEL: tombstone, SUPERSEDES: first record of a
+//   compaction output, data = u32 numbers of the segments it replaces.
+// Startup replays every segment, highest seq per key wins; a torn tail is cut
+// off. A background thread compacts a shard once at least half of its bytes
+// (and PACK_COMPACT_MIN_DEAD) are dead: the live records of all its sealed
+// segments are copied into one new segment, synced, and the old ones deleted.
+// ---------------------------------------------------------------------------
+
+#ifndef STORE_PACK_H
+#define STORE_PACK_H
+
+#include "store.h"
+#include "file_io.h"
+
+#define PACK_DIR STORAGE_DIR "/.packs"
+#define PACK_SHARDS 8
+#define PACK_MAX_OBJECT (64 * 1024) // bigger files go to the chunk store
+#define PACK_FILE_STRIPES 64        // per user/file: small <-> big transitions
+#ifndef PACK_SEGMENT_MAX
+#define PACK_SEGMENT_MAX (64 * 1024 * 1024) // active segment is sealed past this
+#endif
+#ifndef PACK_COMPACT_MIN_DEAD
+#define PACK_COMPACT_MIN_DEAD (4 * 1024 * 1024)
+#endif
+
+typedef struct
+{
+    size_t objects;    // packed files
+    size_t live_bytes; // their records
+    size_t disk_bytes; // all segments
+    size_t segments;
+    unsigned long compactions;
+} pack_stats_t;
+
+void store_pack_stats(pack_stats_t *st);
+// Compact every shard holding dead records now (tests, admin); the
+// background thread does the same on its own once the thresholds are met
+void store_pack_compact_all(void);
+
+#endif
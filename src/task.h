@@ -9,6 +9,7 @@
 
 #include <stddef.h>
 #include <pthread.h>   // Added for mutex + cond var
+#include "store.h"     // store_file_t
 
 typedef enum {
     UPLOAD, 
@@ -16,28 +17,49 @@ typedef enum {
     DELETE,
     LIST,
     SIGNUP,
-    LOGIN
+    LOGIN,
+    CHUNKS,       // binary only: chunk list of a stored file
+    UPLOAD_DELTA  // binary only: streamed delta recipe (protocol.h)
 } cmd_t;
 
-typedef struct {
+typedef struct task {
     cmd_t cmd; 
     char username[64]; 
     char filename[256];
+    char password[64];    // SIGNUP / LOGIN (username is the account's), wiped once used
     size_t file_size;     // e.g 1024 bytes (0 if no upload)
     int sock_fd;          // Client socket for results
-    char data[8192];      // For file content (base64 encoded)
+    int raw;              // DOWNLOAD: length header + raw bytes instead of base64
+    int binary;           // reply as one protocol.h frame
+    unsigned int req_id;  // binary: echoed in the reply frame
+    char stage_path[512]; // UPLOAD: body already on disk here
+    unsigned char *body;  // UPLOAD: or held in memory (store inline_max), freed by the worker
+    size_t quota_reserved; // UPLOAD: bytes reserved while the body came in, the worker commits or releases them
     
-
     // --- Phase 2 additions (for proper synchronization) ---
     // Completion Signaling 
-    pthread_mutex_t lock;       // Protects access to 'done' and 'result'
-    pthread_cond_t  completed;  // Signals client thread when done
     int done;                   // 1 = task complete
     int result;                 // 0 = success, -1 = fail
 
     // BONUS ---- Priority System Implementation ----
     int priority; // (0=low, 1=normal, 2=high, 3=admin)
-    
+
+    // --- Reactor completion ---
+    // When on_complete is set the worker buffers its reply in 'reply' and
+    // hands the task back through on_complete instead of signaling 'completed'.
+    void (*on_complete)(struct task *task);
+    void *owner;                // conn_t that submitted the task
+    size_t reply_len;
+    store_file_t send_file;     // binary DOWNLOAD: segments sent after reply (nsegs 0 = none)
+    struct task *next_done;     // link in the reactor's completion list
+    struct task *queue_next;    // intrusive link: queue.c bucket, or task_pool free list
+
+    // --- Kept across task_pool recycling (task_alloc clears everything above) ---
+    pthread_mutex_t lock;       // Protects access to 'done' and 'result'
+    pthread_cond_t  completed;  // Signals client thread when done
+    char *reply;                // reply buffer, reused by the next owner of the task
+    size_t reply_cap;
+
 } task_t; 
 
 #endif
@@ -0,0 +1,73 @@
+// src/task_pool.c
+
+#include "task_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+static __thread task_t *free_tasks; // linked through queue_next
+static __thread int free_count;
+
+static void task_destroy(task_t *task)
+{
+    pthread_mutex_destroy(&task->lock);
+    pthread_cond_destroy(&task->completed);
+    free(task->reply);
+    free(task);
+}
+
+task_t *task_alloc(void)
+{
+    task_t *task = free_tasks;
+    if (task)
+    {
+        free_tasks = task->queue_next;
+        free_count--;
+    }
+    else
+    {
+        task = malloc(sizeof(task_t));
+        if (!task)
+            return NULL;
+        pthread_mutex_init(&task->lock, NULL);
+        pthread_cond_init(&task->completed, NULL);
+        task->reply = NULL;
+        task->reply_cap = 0;
+    }
+
+    // header only: sync objects and buffers survive
+    memset(task, 0, offsetof(task_t, lock));
+    task->result = -1;
+    return task;
+}
+
+void task_free(task_t *task)
+{
+    if (!task)
+        return;
+    if (free_count >= TASK_POOL_MAX_CACHED)
+    {
+        task_destroy(task);
+        return;
+    }
+    if (task->reply_cap > TASK_REPLY_KEEP)
+    {
+        free(task->reply);
+        task->reply = NULL;
+        task->reply_cap = 0;
+    }
+    task->queue_next = free_tasks;
+    free_tasks = task;
+    free_count++;
+}
+
+void task_pool_release(void)
+{
+    while (free_tasks)
+    {
+        task_t *next = free_tasks->queue_next;
+        task_destroy(free_tasks);
+        free_tasks = next;
+    }
+    free_count = 0;
+}
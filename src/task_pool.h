@@ -0,0 +1,23 @@
+// src/task_pool.h
+
+// ---------------------------------------------------------------------------
+// Per-thread cache of task_t objects. A task is created once (mutex and
+// condvar initialized, reply buffer allocated on first use) and then recycled:
+// task_alloc() only clears the header, task_free() puts it back on the
+// calling thread's free list. Tasks are allocated and freed on the same
+// reactor thread, so the lists need no locking.
+// ---------------------------------------------------------------------------
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "task.h"
+
+#define TASK_POOL_MAX_CACHED 128  // per thread; beyond this task_free really frees
+#define TASK_REPLY_KEEP (16 * 1024) // larger reply buffers are not kept for reuse
+
+task_t *task_alloc(void);            // NULL on out of memory
+void task_free(task_t *task);
+void task_pool_release(void);        // free this thread's cache (thread exit)
+
+#endif
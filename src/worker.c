@@ -8,76 +8,139 @@
 #include "worker.h"
 #include "task.h"
 #include "file_io.h"
+#include "store.h"
+#include "file_cache.h"
+#include "protocol.h"
+#include "base64.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/sendfile.h>
 
 // Global shutdown flag
 // volatile int shutdown_flag = 0;
 
-// ================= BASE64 DECODE =================
-static int base64_decode(const char *in, unsigned char *out, int out_size)
+// Reactor-owned tasks buffer their reply for the event loop; tasks submitted
+// directly (tests) still write to the socket themselves. -1 if the reply
+// buffer can't grow (the data is dropped).
+static int task_reply(task_t *task, const char *data, size_t len)
 {
-    static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    int decode_table[256];
-    memset(decode_table, -1, sizeof(decode_table));
-    for (int i = 0; i < 64; i++)
-        decode_table[(unsigned char)b64_table[i]] = i;
+    if (!task->on_complete)
+    {
+        write(task->sock_fd, data, len);
+        return 0;
+    }
+    if (task->reply_len + len > task->reply_cap)
+    {
+        size_t cap = task->reply_cap ? task->reply_cap : 256;
+        while (cap < task->reply_len + len)
+            cap *= 2;
+        char *nb = realloc(task->reply, cap);
+        if (!nb)
+            return -1;
+        task->reply = nb;
+        task->reply_cap = cap;
+    }
+    memcpy(task->reply + task->reply_len, data, len);
+    task->reply_len += len;
+    return 0;
+}
 
-    int len = strlen(in);
-    int val = 0, valb = -8, out_len = 0;
+static void reply_msg(task_t *task, const char *msg)
+{
+    task_reply(task, msg, strlen(msg));
+}
 
-    for (int i = 0; i < len; i++)
+// Queue an opened file to follow the reply; the reactor sendfile()s its
+// segments so this worker is free as soon as the task completes. Takes
+// ownership of the file.
+static void task_reply_file(task_t *task, store_file_t *f)
+{
+    if (task->on_complete)
     {
-        unsigned char c = in[i];
-        if (decode_table[c] == -1)
-            continue;
-        val = (val << 6) + decode_table[c];
-        valb += 6;
-        if (valb >= 0)
+        task->send_file = *f;
+        *f = (store_file_t){0};
+        return;
+    }
+    for (int i = 0; i < f->nsegs; i++)
+    {
+        if (store_seg_open(&f->segs[i]) != 0)
+            break;
+        off_t off = f->segs[i].off;
+        off_t end = off + f->segs[i].len;
+        while (off < end)
         {
-            if (out_len >= out_size)
+            ssize_t n = sendfile(task->sock_fd, f->segs[i].fd, &off, end - off);
+            if (n <= 0)
                 break;
-            out[out_len++] = (val >> valb) & 0xFF;
-            valb -= 8;
         }
     }
-    return out_len;
+    store_file_close(f);
 }
 
-// ================= BASE64 ENCODE =================
-static const char base64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// Legacy DOWNLOAD body: the whole file as base64 text, encoded a block at
+// a time into the reply. Blocks are whole 3-byte groups, so padding can only
+// come at the very end. On failure (short read, no memory) the caller drops
+// what was encoded: better an error than a truncated file.
+#define B64_BLOCK 3072
 
-static int base64_encode(const unsigned char *in, int len, char *out, int out_size)
+static int reply_base64(task_t *task, const unsigned char *data, size_t len)
 {
-    int out_len = 0;
-    for (int i = 0; i < len; i += 3)
+    char out[BASE64_ENCODED_LEN(B64_BLOCK) + 1];
+    while (len > 0)
     {
-        int val = (in[i] << 16) + ((i + 1 < len ? in[i + 1] : 0) << 8) + (i + 2 < len ? in[i + 2] : 0);
-        if (out_len + 4 >= out_size)
-            break;
-        out[out_len++] = base64_table[(val >> 18) & 63];
-        out[out_len++] = base64_table[(val >> 12) & 63];
-        out[out_len++] = (i + 1 < len) ? base64_table[(val >> 6) & 63] : '=';
-        out[out_len++] = (i + 2 < len) ? base64_table[val & 63] : '=';
+        size_t n = len < B64_BLOCK ? len : B64_BLOCK;
+        if (task_reply(task, out, base64_encode(data, n, out, sizeof(out))) != 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int reply_base64_file(task_t *task, store_file_t *f)
+{
+    unsigned char block[4 * B64_BLOCK + 2]; // read size plus an unfinished group
+    size_t carry = 0;
+    for (int i = 0; i < f->nsegs; i++)
+    {
+        store_seg_t *seg = &f->segs[i];
+        if (store_seg_open(seg) != 0)
+            return -1;
+        for (size_t off = 0; off < seg->len;)
+        {
+            size_t want = seg->len - off < 4 * B64_BLOCK ? seg->len - off : 4 * B64_BLOCK;
+            ssize_t n = pread(seg->fd, block + carry, want, seg->off + off);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return -1; // truncated underneath us
+            off += n;
+            size_t have = carry + n, whole = have / 3 * 3;
+            if (reply_base64(task, block, whole) != 0)
+                return -1;
+            memmove(block, block + whole, have - whole);
+            carry = have - whole;
+        }
     }
-    out[out_len] = '\0';
-    return out_len;
+    return reply_base64(task, block, carry);
 }
 
 void *worker_func(void *args)
 {
     worker_args_t *wargs = (worker_args_t *)args;
-    queue_t *q = wargs->task_queue;
+    scheduler_t *sched = wargs->sched;
     metadata_t *meta = wargs->metadata;
+    file_cache_t *cache = wargs->cache;
 
     printf("Worker %d started\n", wargs->id);
 
     while (1) {
         task_t *task = NULL;
 
-        if (queue_dequeue(q, &task, &shutdown_flag) != 0) {
+        if (scheduler_next(sched, wargs->id - 1, &task, &shutdown_flag) != 0) {
             printf("Worker %d shutting down\n", wargs->id);
             break;
         }
@@ -87,95 +150,247 @@ void *worker_func(void *args)
         printf("  Worker %d: Processing %s for %s (priority=%d)\n", wargs->id, 
        (task->cmd == UPLOAD ? "UPLOAD" : 
         task->cmd == DOWNLOAD ? "DOWNLOAD" : 
-        task->cmd == DELETE ? "DELETE" : "LIST"), 
+        task->cmd == DELETE ? "DELETE" :
+        task->cmd == CHUNKS ? "CHUNKS" :
+        task->cmd == UPLOAD_DELTA ? "UPLOAD_DELTA" :
+        task->cmd == SIGNUP ? "SIGNUP" :
+        task->cmd == LOGIN ? "LOGIN" : "LIST"), 
        task->username, task->priority);
 
         task->result = -1;  // Assume fail
 
-        if (task->cmd == UPLOAD) {
-            // Decode base64 (no lock needed)
-            unsigned char dec_data[8192];
-            size_t dec_size = base64_decode(task->data, dec_data, sizeof(dec_data));
-            if (dec_size == 0 || dec_size != task->file_size) {
-                write(task->sock_fd, "*** Error: Invalid data\n", 24);
+        if (task->cmd == SIGNUP) {
+            // Hashing the password and waiting for the log to make the
+            // account durable both happen here, off the event loop; the
+            // loop opens the session when the task comes back
+            int ret = metadata_add_user(meta, task->username, task->password);
+            memset(task->password, 0, sizeof(task->password));
+            if (ret != 0) {
+                reply_msg(task, ret == -2 ? "*** Error: User already exists\n" : "*** Error: Signup failed\n");
                 goto done;
             }
-
-            // Get user & initial quota check (atomic under user_lock)
-            user_t *u;
-            if (metadata_get_user(meta, task->username, &u) != 0) {
-                write(task->sock_fd, "*** Error: User not found\n", 26);
+            create_user_dir(task->username);
+            reply_msg(task, "Signup successful. You are now logged in.\n");
+            task->result = 0;
+        }
+        else if (task->cmd == LOGIN) {
+            int ok = metadata_authenticate(meta, task->username, task->password);
+            memset(task->password, 0, sizeof(task->password));
+            if (!ok) {
+                reply_msg(task, "*** Error: Invalid credentials\n");
                 goto done;
             }
-            pthread_mutex_lock(&u->user_lock);
-            if (u->quota_used + dec_size > u->quota_max) {
-                pthread_mutex_unlock(&u->user_lock);
-                write(task->sock_fd, "*** Error: Quota exceeded\n", 26);
+            reply_msg(task, "Login successful\n");
+            task->result = 0;
+        }
+        else if (task->cmd == UPLOAD) {
+            // Streamed body is already on disk (or, small, in memory):
+            // account for it, then publish it under the real name
+            // Its size was reserved before (announced) or while (base64) the
+            // body was accepted, so the file goes to disk (durably) before
+            // metadata records it
+            size_t size = task->file_size;
+            int rc = task->body ? commit_upload_buffer(task->body, size, task->username, task->filename)
+                                : commit_upload_stage(task->stage_path, task->username, task->filename);
+            free(task->body);
+            task->body = NULL;
+            if (rc != 0) {
+                discard_upload_stage(task->stage_path);
+                metadata_release_quota(meta, task->username, task->quota_reserved);
+                reply_msg(task, "*** Error: Save failed\n");
                 goto done;
             }
-            pthread_mutex_unlock(&u->user_lock);  // Unlock for I/O (non-blocking)
-
-            // I/O: Save to disk
-            create_user_dir(task->username);
-            if (save_file(task->username, task->filename, dec_data, dec_size) != 0) {
-                write(task->sock_fd, "*** Error: Save failed\n", 23);
+            file_cache_invalidate(cache, task->username, task->filename);
+            int add_ret = metadata_commit_file(meta, task->username, task->filename, size, task->quota_reserved);
+            if (add_ret != 0) {
+                // The rename already replaced the old version: the published
+                // file is the only copy left, so it stays and only the
+                // failure is reported (-3: recorded, but not durably)
+                if (add_ret != -3)
+                    metadata_release_quota(meta, task->username, task->quota_reserved);
+                fprintf(stderr, "Metadata commit failed for %s/%s, keeping the published file\n",
+                        task->username, task->filename);
+                reply_msg(task, add_ret == -2 ? "*** Error: Quota exceeded\n"
+                                              : "*** Error: Metadata update failed\n");
                 goto done;
             }
 
-            // Re-lock for atomic metadata (recheck quota TOCTOU-safe)
-            pthread_mutex_lock(&u->user_lock);
-            if (u->quota_used + dec_size > u->quota_max) {  // Rare, but concurrent quota change?
-                pthread_mutex_unlock(&u->user_lock);
-                delete_file(task->username, task->filename);  // Rollback I/O
-                write(task->sock_fd, "*** Error: Quota exceeded after save\n", 37);
+            reply_msg(task, "UPLOAD_SUCCESS\n");
+            printf("  SUCCESS: UPLOAD %s for %s (%zu bytes, streamed)\n", task->filename, task->username, size);
+            task->result = 0;
+        }
+        else if (task->cmd == UPLOAD_DELTA) {
+            // The staged body is a recipe: its size is the file's, not the
+            // body's. Reserve any growth over the stored version before
+            // publishing, so the commit below can't fail on quota.
+            size_t size = 0, reserved = task->quota_reserved, old_size = 0;
+            if (store_delta_size(task->stage_path, &size) != 0) {
+                discard_upload_stage(task->stage_path);
+                metadata_release_quota(meta, task->username, reserved);
+                reply_msg(task, "*** Error: Invalid delta\n");
                 goto done;
             }
-            int add_ret = metadata_add_file(meta, task->username, task->filename, dec_size);
-            pthread_mutex_unlock(&u->user_lock);
+            file_t *old = metadata_get_and_lock_file(meta, task->username, task->filename);
+            if (old) {
+                old_size = old->size;
+                metadata_unlock_file(old);
+            }
+            size_t growth = size > old_size + reserved ? size - old_size - reserved : 0;
+            if (growth && metadata_reserve_quota(meta, task->username, growth) != 0) {
+                discard_upload_stage(task->stage_path);
+                metadata_release_quota(meta, task->username, reserved);
+                reply_msg(task, "*** Error: Quota exceeded\n");
+                goto done;
+            }
+            reserved += growth;
+
+            if (store->commit_delta(task->stage_path, task->username, task->filename) != 0) {
+                int err = errno;
+                discard_upload_stage(task->stage_path);
+                metadata_release_quota(meta, task->username, reserved);
+                reply_msg(task, err == EINVAL ? "*** Error: Invalid delta\n" :
+                                err == ENOTSUP ? "*** Error: Delta uploads not supported\n" :
+                                                 "*** Error: Save failed\n");
+                goto done;
+            }
+            file_cache_invalidate(cache, task->username, task->filename);
+            int add_ret = metadata_commit_file(meta, task->username, task->filename, size, reserved);
             if (add_ret != 0) {
-                delete_file(task->username, task->filename);  // Rollback I/O on metadata fail
-                write(task->sock_fd, "*** Error: Metadata update failed\n", 32);
+                if (add_ret != -3)
+                    metadata_release_quota(meta, task->username, reserved);
+                fprintf(stderr, "Metadata commit failed for %s/%s, keeping the published file\n",
+                        task->username, task->filename); // the only copy, see UPLOAD
+                reply_msg(task, add_ret == -2 ? "*** Error: Quota exceeded\n"
+                                              : "*** Error: Metadata update failed\n");
                 goto done;
             }
 
-            write(task->sock_fd, "UPLOAD_SUCCESS\n", 15);
-            printf("  SUCCESS: UPLOAD %s for %s (%zu bytes)\n", task->filename, task->username, dec_size);
+            reply_msg(task, "UPLOAD_SUCCESS\n");
+            printf("  SUCCESS: UPLOAD_DELTA %s for %s (%zu bytes, %zu sent)\n", task->filename, task->username,
+                   size, task->file_size);
             task->result = 0;
         }
-        else if (task->cmd == DOWNLOAD)
+        else if (task->cmd == DOWNLOAD && task->raw)
         {
+            // Hot file: straight from memory, no metadata lock, no open()
+            file_cache_entry_t *hot = file_cache_get(cache, task->username, task->filename);
+            if (hot) {
+                if (!task->binary) {
+                    char header[64];
+                    snprintf(header, sizeof(header), "FILE %zu\n", hot->size);
+                    reply_msg(task, header);
+                }
+                task_reply(task, (const char *)hot->data, hot->size);
+                printf("  SUCCESS: DOWNLOAD %s for %s (%zu bytes, cached)\n", task->filename, task->username, hot->size);
+                file_cache_release(hot);
+                task->result = 0;
+                goto done;
+            }
+
+            unsigned long ticket = file_cache_ticket(cache, task->username, task->filename);
             file_t *file = metadata_get_and_lock_file(meta, task->username, task->filename);
 
             if (!file)
             {
-                write(task->sock_fd, "*** Error: File not found\n", 27);
+                reply_msg(task, "*** Error: File not found\n");
                 goto done;
             }
 
-            size_t file_size = get_file_size(task->username, task->filename);
-            if (file_size == 0) {
-                metadata_unlock_file(file);
-                write(task->sock_fd, "*** Error: Empty file\n", 22);
+            store_file_t body;
+            int rc = store->open(task->username, task->filename, &body);
+            metadata_unlock_file(file);  // the open segments pin this version from here on
+            if (rc != 0) {
+                reply_msg(task, "*** Error: Load failed\n");
                 goto done;
             }
+            size_t file_size = body.size;
 
-            unsigned char data[8192];
-            if (load_file(task->username, task->filename, data, (size_t*)&file_size, sizeof(data)) != 0) {
-                metadata_unlock_file(file);
-                write(task->sock_fd, "*** Error: Load failed\n", 23);
+            if (!task->binary) {
+                // Binary frames already carry the length
+                char header[64];
+                snprintf(header, sizeof(header), "FILE %zu\n", file_size);
+                reply_msg(task, header);
+            }
+
+            // Small enough to cache: read it once, reply from the copy
+            unsigned char *buf = file_size <= FILE_CACHE_MAX_ENTRY ? malloc(file_size ? file_size : 1) : NULL;
+            if (buf && store_file_read(&body, buf, file_size) == (ssize_t)file_size) {
+                store_file_close(&body);
+                task_reply(task, (const char *)buf, file_size);
+                file_cache_insert(cache, task->username, task->filename, buf, file_size, ticket);
+                free(buf);
+                printf("  SUCCESS: DOWNLOAD %s for %s (%zu bytes)\n", task->filename, task->username, file_size);
+                task->result = 0;
                 goto done;
             }
+            free(buf);
 
-            metadata_unlock_file(file);  // Unlock before encode/send
+            if (file_size > 0)
+                task_reply_file(task, &body);
+            else
+                store_file_close(&body);
 
-            char encoded_data[10922];  // 4/3 overhead + null
-            int encoded_len = base64_encode(data, file_size, encoded_data, sizeof(encoded_data));
-            if (encoded_len <= 0) {
-                write(task->sock_fd, "*** Error: Failed to encode\n", 29);
+            printf("  SUCCESS: DOWNLOAD %s for %s (%zu bytes, zero-copy)\n", task->filename, task->username, file_size);
+            task->result = 0;
+        }
+        else if (task->cmd == DOWNLOAD)
+        {
+            // Legacy: base64 text of the whole file (any size)
+            size_t start = task->reply_len;
+            file_cache_entry_t *hot = file_cache_get(cache, task->username, task->filename);
+            if (hot) {
+                size_t file_size = hot->size;
+                int rc = reply_base64(task, hot->data, file_size);
+                file_cache_release(hot);
+                if (file_size == 0 || rc != 0) {
+                    task->reply_len = start;
+                    reply_msg(task, file_size == 0 ? "*** Error: Empty file\n" : "*** Error: Failed to encode\n");
+                    goto done;
+                }
+                printf("  SUCCESS: DOWNLOAD %s for %s (%zu bytes, cached)\n", task->filename, task->username, file_size);
+                task->result = 0;
+                goto done;
+            }
+
+            unsigned long ticket = file_cache_ticket(cache, task->username, task->filename);
+            file_t *file = metadata_get_and_lock_file(meta, task->username, task->filename);
+
+            if (!file)
+            {
+                reply_msg(task, "*** Error: File not found\n");
+                goto done;
+            }
+
+            store_file_t body;
+            int rc = store->open(task->username, task->filename, &body);
+            metadata_unlock_file(file);  // the open segments pin this version from here on
+            if (rc != 0) {
+                reply_msg(task, "*** Error: Load failed\n");
+                goto done;
+            }
+            size_t file_size = body.size;
+            if (file_size == 0) {
+                store_file_close(&body);
+                reply_msg(task, "*** Error: Empty file\n");
+                goto done;
+            }
+
+            // Small enough to cache: read it once, encode from the copy
+            unsigned char *buf = file_size <= FILE_CACHE_MAX_ENTRY ? malloc(file_size) : NULL;
+            if (buf && store_file_read(&body, buf, file_size) == (ssize_t)file_size) {
+                rc = reply_base64(task, buf, file_size);
+                file_cache_insert(cache, task->username, task->filename, buf, file_size, ticket);
+            } else {
+                rc = reply_base64_file(task, &body);
+            }
+            free(buf);
+            store_file_close(&body);
+            if (rc != 0) {
+                task->reply_len = start;
+                reply_msg(task, "*** Error: Failed to encode\n");
                 goto done;
             }
 
-            write(task->sock_fd, encoded_data, encoded_len);
             printf("  SUCCESS: DOWNLOAD %s for %s (%zu bytes)\n", task->filename, task->username, file_size);
             task->result = 0;
         }
@@ -187,7 +402,7 @@ void *worker_func(void *args)
 
             if (!file)
             {
-                write(task->sock_fd, "*** Error: File not found\n", 27);
+                reply_msg(task, "*** Error: File not found\n");
                 goto done;
             }
 
@@ -195,36 +410,79 @@ void *worker_func(void *args)
             if (delete_file(task->username, task->filename) != 0)
             {
                 metadata_unlock_file(file); // ⬅️ Unlock on error
-                write(task->sock_fd, "*** Error: Failed to delete file\n", 34);
+                reply_msg(task, "*** Error: Failed to delete file\n");
                 goto done;
             }
-            // Unlock BEFORE removing(metadata_remove will destroy the lock)
+            file_cache_invalidate(cache, task->username, task->filename);
+            // Unlock BEFORE removing (metadata_remove_file takes user_lock)
             metadata_unlock_file(file);
-            //remove from metadata (this detroys the lock)
+            //remove from metadata (the record's slot is recycled, its lock kept)
             int remove_ret = metadata_remove_file(meta, task->username, task->filename);
             if (remove_ret != 0) {
                 // Rare rollback: But I/O already gone—log error, quota safe (idempotent)
-                write(task->sock_fd, "*** Error: Metadata cleanup failed\n", 35);
+                reply_msg(task, "*** Error: Metadata cleanup failed\n");
                 goto done;
             }
-            write(task->sock_fd, "DELETE_SUCCESS\n", 15);
+            reply_msg(task, "DELETE_SUCCESS\n");
             printf("  SUCCESS: DELETE %s for %s\n", task->filename, task->username);
             task->result = 0;
         }
+        else if (task->cmd == CHUNKS)
+        {
+            file_t *file = metadata_get_and_lock_file(meta, task->username, task->filename);
+            if (!file)
+            {
+                reply_msg(task, "*** Error: File not found\n");
+                goto done;
+            }
+            store_chunk_ref_t *refs = NULL;
+            uint32_t count = 0;
+            int rc = store->list_chunks(task->username, task->filename, &refs, &count);
+            int err = errno;
+            metadata_unlock_file(file);
+            if (rc != 0)
+            {
+                reply_msg(task, err == ENOTSUP ? "*** Error: Delta uploads not supported\n"
+                                               : "*** Error: Load failed\n");
+                goto done;
+            }
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                unsigned char ent[PROTO_CHUNK_ENT_SIZE];
+                memcpy(ent, refs[i].hash, SHA256_DIGEST_SIZE);
+                proto_put_be(ent + SHA256_DIGEST_SIZE, refs[i].len, 4);
+                task_reply(task, (const char *)ent, sizeof(ent));
+            }
+            free(refs);
+            printf("  SUCCESS: CHUNKS %s for %s (%u chunks)\n", task->filename, task->username, count);
+            task->result = 0;
+        }
         else if (task->cmd == LIST)
         {
             create_user_dir(task->username);
 
-            char list_output[2048];
-            metadata_list_files(meta, task->username, list_output, sizeof(list_output));
+            size_t list_len = 0;
+            char *list_output = metadata_list_files(meta, task->username, &list_len);
+            if (!list_output) {
+                reply_msg(task, "ERROR: User not found\n");
+                goto done;
+            }
 
-            write(task->sock_fd, list_output, strlen(list_output));
+            task_reply(task, list_output, list_len);
+            free(list_output);
             printf("  SUCCESS: LIST for %s\n", task->username);
             task->result = 0;
         }
 
         // --- Signal task completion ---
         done:
+        if (task->on_complete) {
+            // Reactor owns the task from here on (it may free it)
+            task->done = 1;
+            task->on_complete(task);
+            continue;
+        }
         pthread_mutex_lock(&task->lock);
         if (task->result != -1)
             task->result = 0;
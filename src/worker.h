@@ -2,23 +2,25 @@
 
 // ---------------------------------------------------------------------------
 // Defines args for worker threads and the entry function (worker_func).
-// Workers consume from task_queue, execute commands, and loop until shutdown.
-// Each gets unique ID for debug; passes queue + metadata.
+// Workers take tasks from the work-stealing scheduler, execute commands, and
+// loop until shutdown. Each gets unique ID (its scheduler slot is id - 1).
 // Usage: Create pool in main: pthread_create(..., worker_func, &wargs).
 // ---------------------------------------------------------------------------
 
 #ifndef WORKER_H
 #define WORKER_H
 
-#include "queue.h"
+#include "scheduler.h"
 #include "metadata.h"
+#include "file_cache.h"
 #include <pthread.h>
 #include <stdatomic.h>
 // #include <signal.h>  // For sig_atomic_t
 
 typedef struct {
-    queue_t* task_queue;
+    scheduler_t* sched;
     metadata_t* metadata;
+    file_cache_t* cache; // DOWNLOAD contents, shared by all workers
     int id;  // Worker #1, #2, ...
 } worker_args_t;
 
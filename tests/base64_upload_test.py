@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Legacy Base64 Upload Test Client for Dropbox Clone Server
+The one-line base64 body of "UPLOAD <filename>" is decoded into the staging
+file while it streams in (src/reactor.c), so it is no longer bounded by the
+input buffer: large bodies, bodies split at any byte, line-wrapped bodies,
+quota running out mid-body and the old error replies. Legacy DOWNLOAD
+returns such a file whole.
+"""
+
+import base64
+import os
+import socket
+import sys
+import time
+
+from binary_protocol_test import check
+from input_framing_test import TextClient
+
+
+def upload(t, name, body, pieces=1, tail=b'\n'):
+    t.sock.sendall(b'UPLOAD ' + name + b'\n')
+    ready = t.line()
+    step = max(1, len(body) // pieces)
+    for i in range(0, len(body), step):
+        t.sock.sendall(body[i:i + step])
+    t.sock.sendall(tail)
+    return ready, t.line()
+
+
+def download(t, name):
+    t.sock.sendall(b'DOWNLOAD ' + name + b' BINARY\n')
+    header = t.line()
+    if not header.startswith(b'FILE '):
+        return None
+    return t.exact(int(header.split()[1]))
+
+
+def main():
+    ok = True
+    user = f"b64_{os.getpid()}".encode()
+    t = TextClient()
+    t.sock.sendall(b'signup ' + user + b' pw\n')
+    ok &= check('signup', t.line().startswith(b'Signup successful'))
+
+    # far larger than the 16 KB input ring, in one write and in odd pieces
+    data = os.urandom(600 * 1024)
+    ready, result = upload(t, b'big.bin', base64.b64encode(data))
+    ok &= check('600 KB body in one line', ready == b'READY_TO_RECEIVE\n' and result == b'UPLOAD_SUCCESS\n'
+                and download(t, b'big.bin') == data)
+    # and back through the legacy DOWNLOAD: base64 of the whole file, no
+    # terminator, so read exactly its encoded length
+    t.sock.sendall(b'DOWNLOAD big.bin\n')
+    ok &= check('600 KB legacy download intact', base64.b64decode(t.exact(4 * ((len(data) + 2) // 3))) == data)
+    small = os.urandom(5001)
+    ready, result = upload(t, b'odd.bin', base64.b64encode(small), pieces=37, tail=b'\r\n')
+    ok &= check('body split at odd offsets, CRLF', result == b'UPLOAD_SUCCESS\n' and download(t, b'odd.bin') == small)
+    t.sock.sendall(b'DOWNLOAD odd.bin\nDOWNLOAD odd.bin\n')  # the second one from the file cache
+    enc = base64.b64encode(small)
+    ok &= check('legacy download, read and cached', t.exact(len(enc)) == enc and t.exact(len(enc)) == enc)
+
+    # MIME-style wrapping: line breaks inside the body are skipped
+    wrapped = base64.encodebytes(small).replace(b'\n', b'\r\n').rstrip()
+    t.sock.sendall(b'UPLOAD wrapped.bin\n')
+    t.line()
+    t.sock.sendall(wrapped.replace(b'\r\n', b'\r') + b'\n')
+    ok &= check('body wrapped with CRs', t.line() == b'UPLOAD_SUCCESS\n' and download(t, b'wrapped.bin') == small)
+
+    # body and the next command in one write
+    t.sock.sendall(b'UPLOAD glued.bin\n')
+    t.line()
+    t.sock.sendall(base64.b64encode(b'glued') + b'\nLIST\n')
+    ok &= check('command after the body', t.line() == b'UPLOAD_SUCCESS\n' and t.line().startswith(b'big.bin'))
+    while t.line() != b'glued.bin 5\n':
+        pass
+
+    # a pause inside the body line doesn't end it
+    t.sock.sendall(b'UPLOAD paused.bin\n')
+    t.line()
+    encoded = base64.b64encode(b'sent in two halves')
+    t.sock.sendall(encoded[:8])
+    time.sleep(0.3)
+    t.sock.sendall(encoded[8:] + b'\n')
+    ok &= check('body split by a pause', t.line() == b'UPLOAD_SUCCESS\n' and
+                download(t, b'paused.bin') == b'sent in two halves')
+
+    # errors: nothing decodable, empty line, quota running out mid-body
+    _, result = upload(t, b'bad.bin', b'!!!!====')
+    ok &= check('invalid data', result == b'*** Error: Invalid data\n')
+    _, result = upload(t, b'empty.bin', b'')
+    ok &= check('empty body', result == b'*** Error: Failed to receive file data\n')
+    _, result = upload(t, b'over.bin', base64.b64encode(os.urandom(600 * 1024)), pieces=9)
+    ok &= check('quota exceeded mid-body', result == b'*** Error: Quota exceeded\n')
+    t.sock.sendall(b'LIST\n')
+    time.sleep(0.3)
+    listing = t.sock.recv(65536)
+    ok &= check('failed uploads leave nothing behind', b'over.bin' not in listing and b'bad.bin' not in listing
+                and b'big.bin' in listing)
+    _, result = upload(t, b'after.bin', base64.b64encode(b'quota released'))
+    ok &= check('quota released after the failure', result == b'UPLOAD_SUCCESS\n')
+    t.sock.close()
+
+    # a body line without '\n' ends when the client shuts its side
+    h = TextClient()
+    h.sock.sendall(b'login ' + user + b' pw\nUPLOAD last.bin\n' + base64.b64encode(b'no newline here'))
+    h.sock.shutdown(socket.SHUT_WR)
+    ok &= check('unterminated body at half-close', h.line() == b'Login successful\n' and
+                h.line() == b'READY_TO_RECEIVE\n' and h.line() == b'UPLOAD_SUCCESS\n')
+    h.sock.close()
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,122 @@
+// tests/bench_base64.c
+
+// -------------------------------------------------------------------------
+// Base64 microbenchmark: encode and decode throughput (GB/s of raw bytes)
+// of each kernel this CPU has, on 8 KB bodies (the legacy UPLOAD/DOWNLOAD
+// size) and 16 MB buffers, next to the per-call-table decoder the server
+// used before (reimplemented here as a reference).
+// Usage: ./bench_base64
+// -------------------------------------------------------------------------
+
+#include "../src/base64.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BIG (16u << 20)
+#define SMALL 8192
+#define MIN_SECONDS 0.3
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- Reference: the old decoder, table rebuilt on every call ----
+static size_t ref_decode(const char *in, size_t len, unsigned char *out, size_t out_size)
+{
+    static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int decode_table[256];
+    memset(decode_table, -1, sizeof(decode_table));
+    for (int i = 0; i < 64; i++)
+        decode_table[(unsigned char)b64_table[i]] = i;
+
+    int val = 0, valb = -8;
+    size_t out_len = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = in[i];
+        if (decode_table[c] == -1)
+            continue;
+        val = (val << 6) + decode_table[c];
+        valb += 6;
+        if (valb >= 0)
+        {
+            if (out_len >= out_size)
+                break;
+            out[out_len++] = (val >> valb) & 0xFF;
+            valb -= 8;
+        }
+    }
+    return out_len;
+}
+
+static unsigned char *data, *dec;
+static char *enc;
+
+// Repeats until MIN_SECONDS have passed; returns GB/s of raw bytes
+static double run(int decode, int reference, size_t len)
+{
+    size_t enc_len = BASE64_ENCODED_LEN(len);
+    size_t bytes = 0;
+    volatile size_t sink = 0;
+    double start = now_sec(), elapsed;
+    do {
+        for (int rep = 0; rep < 16; rep++) {
+            if (reference)
+                sink += ref_decode(enc, enc_len, dec, len);
+            else if (decode)
+                sink += base64_decode(enc, enc_len, dec, len);
+            else
+                sink += base64_encode(data, len, enc, enc_len + 1);
+            bytes += len;
+        }
+        elapsed = now_sec() - start;
+    } while (elapsed < MIN_SECONDS);
+    (void)sink;
+    return bytes / elapsed / 1e9;
+}
+
+int main(void)
+{
+    data = malloc(BIG);
+    dec = malloc(BIG);
+    enc = malloc(BASE64_ENCODED_LEN(BIG) + 1);
+    if (!data || !dec || !enc)
+        return 1;
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < BIG; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        data[i] = (unsigned char)x;
+    }
+    base64_encode(data, BIG, enc, BASE64_ENCODED_LEN(BIG) + 1);
+
+    printf("Default kernel: %s\n\n", base64_kernel());
+    printf("%-22s %12s %12s %12s %12s\n", "kernel", "enc 8KB", "dec 8KB", "enc 16MB", "dec 16MB");
+    printf("%-22s %12s %7.2f GB/s %12s %7.2f GB/s\n", "reference (old)", "-", run(1, 1, SMALL), "-",
+           run(1, 1, BIG));
+
+    static const char *names[] = {"scalar", "ssse3", "avx2"};
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        if (base64_use_kernel(names[k]) != 0) {
+            printf("%-22s %12s\n", names[k], "n/a");
+            continue;
+        }
+        double e_small = run(0, 0, SMALL), d_small = run(1, 0, SMALL);
+        double e_big = run(0, 0, BIG), d_big = run(1, 0, BIG);
+        if (base64_decode(enc, BASE64_ENCODED_LEN(BIG), dec, BIG) != BIG || memcmp(dec, data, BIG) != 0) {
+            fprintf(stderr, "%s: round trip mismatch\n", names[k]);
+            return 1;
+        }
+        printf("%-22s %7.2f GB/s %7.2f GB/s %7.2f GB/s %7.2f GB/s\n", names[k], e_small, d_small, e_big, d_big);
+    }
+
+    free(data);
+    free(dec);
+    free(enc);
+    return 0;
+}
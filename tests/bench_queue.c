@@ -0,0 +1,198 @@
+// tests/bench_queue.c
+
+// -------------------------------------------------------------------------
+// Queue microbenchmark: throughput of queue_enqueue/queue_dequeue while the
+// backlog holds 1k..100k tasks, next to the previous sorted-linked-list
+// insertion (reimplemented here as a reference) and a threaded run with
+// several producers and consumers. Build with QUEUE_BACKEND=ring to measure
+// the lock-free backend instead of the mutex one.
+// Usage: ./bench_queue
+// -------------------------------------------------------------------------
+
+#include "../src/queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+
+#define OPS 200000
+#define MAX_DEPTH 100000 // queued tasks must be distinct: links live inside task_t
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- Reference: the old O(n) sorted insertion ----
+typedef struct ref_node {
+    task_t *task;
+    struct ref_node *next;
+} ref_node_t;
+
+typedef struct {
+    ref_node_t *head, *tail;
+    int size;
+} sorted_list_t;
+
+static void sorted_enqueue(sorted_list_t *q, task_t *task)
+{
+    ref_node_t *n = malloc(sizeof(ref_node_t));
+    n->task = task;
+    n->next = NULL;
+    if (!q->head)
+        q->head = q->tail = n;
+    else if (task->priority > q->head->task->priority)
+    {
+        n->next = q->head;
+        q->head = n;
+    }
+    else
+    {
+        ref_node_t *prev = q->head, *curr = q->head->next;
+        while (curr && curr->task->priority >= task->priority)
+        {
+            prev = curr;
+            curr = curr->next;
+        }
+        prev->next = n;
+        n->next = curr;
+        if (!curr)
+            q->tail = n;
+    }
+    q->size++;
+}
+
+static task_t *sorted_dequeue(sorted_list_t *q)
+{
+    ref_node_t *n = q->head;
+    task_t *t = n->task;
+    q->head = n->next;
+    if (!q->head)
+        q->tail = NULL;
+    q->size--;
+    free(n);
+    return t;
+}
+
+// ---- Steady state: keep 'depth' tasks queued, then do OPS enqueue+dequeue pairs ----
+static void bench_depth(task_t *tasks, int depth)
+{
+    _Atomic int stop = 0;
+    task_t *t;
+
+    queue_t *q = queue_init();
+    for (int i = 0; i < depth; i++)
+        if (queue_enqueue(q, &tasks[i]) != 0)
+        {
+            // bounded backend (QUEUE_BACKEND=ring): this depth does not fit
+            printf("  depth %7d : queue full after %d tasks, skipped\n", depth, i);
+            queue_destroy(q);
+            return;
+        }
+    double start = now_sec();
+    for (int i = 0; i < OPS; i++)
+    {
+        queue_dequeue(q, &t, &stop);
+        queue_enqueue(q, t);
+    }
+    double bucket = now_sec() - start;
+    queue_destroy(q);
+
+    sorted_list_t s = {0};
+    for (int i = 0; i < depth; i++)
+        sorted_enqueue(&s, &tasks[i]);
+    int ops = depth > 1000 ? OPS / (depth / 1000) / 10 : OPS; // O(n) per op: keep runtime sane
+    start = now_sec();
+    for (int i = 0; i < ops; i++)
+        sorted_enqueue(&s, sorted_dequeue(&s));
+    double sorted = (now_sec() - start) * OPS / ops;
+    while (s.size)
+        sorted_dequeue(&s);
+
+    printf("  depth %7d : queue %8.2f Mops/s | sorted list %8.3f Mops/s\n",
+           depth, 2.0 * OPS / bucket / 1e6, 2.0 * OPS / sorted / 1e6);
+}
+
+// ---- Threaded: producers and consumers hammering one queue ----
+#define PRODUCERS 4
+#define CONSUMERS 3
+#define PER_PRODUCER (MAX_DEPTH / PRODUCERS)
+
+static queue_t *shared_q;
+static task_t *shared_tasks;
+static _Atomic int consumed;
+static _Atomic int stop_consumers;
+
+static void *producer(void *arg)
+{
+    long id = (long)arg;
+    for (int i = 0; i < PER_PRODUCER; i++)
+        while (queue_enqueue(shared_q, &shared_tasks[id * PER_PRODUCER + i]) != 0)
+            sched_yield(); // bounded backend full: let consumers catch up
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    (void)arg;
+    task_t *t;
+    while (queue_dequeue(shared_q, &t, &stop_consumers) == 0)
+        atomic_fetch_add(&consumed, 1);
+    return NULL;
+}
+
+static void bench_threads(task_t *tasks)
+{
+    pthread_t prod[PRODUCERS], cons[CONSUMERS];
+    shared_q = queue_init();
+    shared_tasks = tasks;
+    consumed = 0;
+    stop_consumers = 0;
+
+    double start = now_sec();
+    for (long i = 0; i < CONSUMERS; i++)
+        pthread_create(&cons[i], NULL, consumer, NULL);
+    for (long i = 0; i < PRODUCERS; i++)
+        pthread_create(&prod[i], NULL, producer, (void *)i);
+    for (int i = 0; i < PRODUCERS; i++)
+        pthread_join(prod[i], NULL);
+    while (consumed < PRODUCERS * PER_PRODUCER)
+        nanosleep(&(struct timespec){0, 1000000}, NULL);
+    double elapsed = now_sec() - start;
+
+    stop_consumers = 1;
+    queue_wake_all(shared_q);
+    for (int i = 0; i < CONSUMERS; i++)
+        pthread_join(cons[i], NULL);
+    queue_destroy(shared_q);
+
+    printf("  %d producers / %d consumers : %.2f M tasks/s\n",
+           PRODUCERS, CONSUMERS, PRODUCERS * PER_PRODUCER / elapsed / 1e6);
+}
+
+int main(void)
+{
+    task_t *tasks = calloc(MAX_DEPTH, sizeof(task_t));
+    if (!tasks)
+    {
+        perror("calloc");
+        return 1;
+    }
+    srand(42);
+    for (int i = 0; i < MAX_DEPTH; i++)
+        tasks[i].priority = rand() % QUEUE_PRIORITY_LEVELS;
+
+    printf("=== Queue benchmark (%d enqueue+dequeue pairs) ===\n", OPS);
+    int depths[] = {1000, 10000, 100000};
+    for (int i = 0; i < 3; i++)
+        bench_depth(tasks, depths[i]);
+    bench_threads(tasks);
+
+    free(tasks);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+Binary Protocol Test Client for Dropbox Clone Server
+Switches a connection to framed mode and runs signup/upload/list/download/delete
+with raw (non-base64) payloads. Frame layout is documented in src/protocol.h.
+"""
+
+import os
+import socket
+import struct
+import sys
+
+SERVER_HOST = '127.0.0.1'
+SERVER_PORT = 8080
+
+MAGIC = 0xDB
+HDR = struct.Struct('>BBHIIQ')  # magic, opcode, status, req_id, name_len, body_len
+
+OP_SIGNUP, OP_LOGIN, OP_LOGOUT, OP_UPLOAD, OP_DOWNLOAD, OP_DELETE, OP_LIST = range(1, 8)
+OK, ERR = 0, 1
+
+
+class BinaryClient:
+    def __init__(self):
+        self.sock = socket.create_connection((SERVER_HOST, SERVER_PORT))
+        self.sock.settimeout(10)
+        self.next_id = 1
+        self.sock.sendall(b'BINARY\n')
+        line = self._recv_line()
+        assert line == b'BINARY_OK\n', line
+
+    def _recv_exact(self, n):
+        buf = b''
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise ConnectionError('server closed connection')
+            buf += chunk
+        return buf
+
+    def _recv_line(self):
+        buf = b''
+        while not buf.endswith(b'\n'):
+            buf += self._recv_exact(1)
+        return buf
+
+    def request(self, opcode, name=b'', body=b''):
+        req_id = self.next_id
+        self.next_id += 1
+        self.sock.sendall(HDR.pack(MAGIC, opcode, 0, req_id, len(name), len(body)) + name + body)
+        magic, op, status, rid, name_len, body_len = HDR.unpack(self._recv_exact(HDR.size))
+        assert magic == MAGIC and op == opcode and rid == req_id, (magic, op, rid)
+        self._recv_exact(name_len)
+        return status, self._recv_exact(body_len)
+
+
+def check(label, cond):
+    print(f"[{'PASS' if cond else 'FAIL'}] {label}")
+    return cond
+
+
+def main():
+    c = BinaryClient()
+    user = f"bin_{os.getpid()}".encode()
+    payload = os.urandom(200 * 1024)
+    ok = True
+
+    status, _ = c.request(OP_SIGNUP, user, b'secret')
+    ok &= check('signup', status == OK)
+
+    status, body = c.request(OP_UPLOAD, b'blob.bin', payload)
+    ok &= check('upload 200 KB raw', status == OK)
+
+    status, body = c.request(OP_LIST)
+    ok &= check('list shows file', status == OK and b'blob.bin 204800' in body)
+
+    status, body = c.request(OP_DOWNLOAD, b'blob.bin')
+    ok &= check('download matches', status == OK and body == payload)
+
+    status, body = c.request(OP_DOWNLOAD, b'missing.bin')
+    ok &= check('missing file is an error', status == ERR and body.startswith(b'***'))
+
+    status, _ = c.request(OP_DELETE, b'blob.bin')
+    ok &= check('delete', status == OK)
+
+    status, _ = c.request(OP_UPLOAD, b'too_big.bin', b'x' * (2 * 1024 * 1024))
+    ok &= check('over-quota upload rejected, body drained', status == ERR)
+
+    # names are path components under the storage dir; dot names are the server's
+    for name in (b'../escape', b'a/b', b'.upload-x'):
+        status, _ = c.request(OP_UPLOAD, name, b'x')
+        ok &= check(f'upload as {name.decode()} refused', status == ERR)
+    status, _ = c.request(OP_DOWNLOAD, b'../' + user + b'/blob.bin')
+    ok &= check('download outside the user dir refused', status == ERR)
+
+    status, _ = c.request(OP_LOGOUT)
+    ok &= check('logout', status == OK)
+
+    for name in (b'.metadata', b'.chunks', b'.packs', b'a/b'):
+        status, body = c.request(OP_SIGNUP, name, b'pw')
+        ok &= check(f'signup as {name.decode()} refused', status == ERR and b"start with '.'" in body)
+
+    # a name longer than a session holds is refused, never truncated onto
+    # an existing account
+    victim = (user + b'v' * 49)[:49]
+    status, _ = c.request(OP_SIGNUP, victim, b'secret')
+    ok &= check('signup with a 49-character name', status == OK)
+    c.request(OP_UPLOAD, b'secret.txt', b'SECRET')
+    c.request(OP_LOGOUT)
+    for op, label in ((OP_SIGNUP, 'signup'), (OP_LOGIN, 'login')):
+        status, body = c.request(op, victim + b'Z', b'pw')
+        ok &= check(f'{label} with a 50-character name refused', status == ERR and b'49 characters' in body)
+    status, body = c.request(OP_LIST)
+    ok &= check('still logged out', status == ERR and b'login first' in body)
+
+    c.sock.close()
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include "../src/base64.h"
 
 // ====== Config ======
 #define SERVER_IP "127.0.0.1"
@@ -13,9 +14,6 @@
 #define BUFFER_SIZE 8192
 
 // ====== Base64 Encoding ======
-static const char b64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
 char *encode_base64_file(const char *filename) {
     FILE *fp = fopen(filename, "rb");
     if (!fp) {
@@ -31,45 +29,14 @@ char *encode_base64_file(const char *filename) {
     fread(buffer, 1, fsize, fp);
     fclose(fp);
 
-    size_t out_len = 4 * ((fsize + 2) / 3);
-    char *encoded = malloc(out_len + 1);
-    char *p = encoded;
-
-    for (long i = 0; i < fsize; i += 3) {
-        int val = (buffer[i] << 16) + ((i + 1 < fsize ? buffer[i + 1] : 0) << 8)
-                  + (i + 2 < fsize ? buffer[i + 2] : 0);
-        *p++ = b64_table[(val >> 18) & 0x3F];
-        *p++ = b64_table[(val >> 12) & 0x3F];
-        *p++ = (i + 1 < fsize) ? b64_table[(val >> 6) & 0x3F] : '=';
-        *p++ = (i + 2 < fsize) ? b64_table[val & 0x3F] : '=';
-    }
-    *p = '\0';
+    size_t out_size = BASE64_ENCODED_LEN(fsize) + 1;
+    char *encoded = malloc(out_size);
+    base64_encode(buffer, fsize, encoded, out_size);
 
     free(buffer);
     return encoded;
 }
 
-int base64_decode(const char *in, unsigned char *out, int out_size) {
-    int decode_table[256];
-    memset(decode_table, -1, sizeof(decode_table));
-    for (int i = 0; i < 64; i++)
-        decode_table[(unsigned char)b64_table[i]] = i;
-
-    int val = 0, valb = -8, out_len = 0;
-    for (int i = 0; in[i]; i++) {
-        unsigned char c = in[i];
-        if (decode_table[c] == -1) continue;
-        val = (val << 6) + decode_table[c];
-        valb += 6;
-        if (valb >= 0) {
-            if (out_len >= out_size) break;
-            out[out_len++] = (val >> valb) & 0xFF;
-            valb -= 8;
-        }
-    }
-    return out_len;
-}
-
 // ====== Networking Helpers ======
 int connect_to_server() {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -98,6 +65,7 @@ int connect_to_server() {
 
 void send_command(int sock, const char *cmd) {
     send(sock, cmd, strlen(cmd), 0);
+    send(sock, "\n", 1, 0); // the server frames commands by their '\n'
 }
 
 void read_response(int sock) {
@@ -125,6 +93,7 @@ void upload_file(int sock, const char *filename) {
     }
 
     send(sock, encoded, strlen(encoded), 0);
+    send(sock, "\n", 1, 0);
     free(encoded);
 
     read_response(sock); // Expect UPLOAD_SUCCESS
@@ -152,7 +121,7 @@ void download_file(int sock, const char *filename) {
 
     // Decode entire Base64 at once
     unsigned char dec_buf[49152];
-    int dec_len = base64_decode(enc_buf, dec_buf, sizeof(dec_buf));
+    int dec_len = base64_decode(enc_buf, total, dec_buf, sizeof(dec_buf));
     if (dec_len <= 0) {
         fprintf(stderr, "Failed to decode Base64\n");
         return;
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Delta Upload Test Client for Dropbox Clone Server
+Uploads a file, edits it, then re-sends it as a delta: CHUNKS fetches the
+stored version's chunk list, the new version is cut with the same
+content-defined chunker as the server (src/cdc.h) and only the chunks the
+server lacks travel in the UPLOAD_DELTA recipe (src/protocol.h).
+"""
+
+import hashlib
+import os
+import struct
+import sys
+
+from binary_protocol_test import BinaryClient, check, OK, ERR, OP_SIGNUP, OP_UPLOAD, OP_DOWNLOAD
+
+OP_CHUNKS, OP_UPLOAD_DELTA = 8, 9
+
+CDC_MIN_SIZE = 16 * 1024
+CDC_AVG_SIZE = 64 * 1024
+CDC_MAX_SIZE = 256 * 1024
+CDC_MASK_S = 0xFFFFC00000000000
+CDC_MASK_L = 0xFFFC000000000000
+CDC_GEAR_SEED = 0x44425F4344435F31
+M64 = (1 << 64) - 1
+
+
+def gear_table():
+    x, table = CDC_GEAR_SEED, []
+    for _ in range(256):
+        x = (x + 0x9E3779B97F4A7C15) & M64
+        z = x
+        z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & M64
+        z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & M64
+        table.append(z ^ (z >> 31))
+    return table
+
+
+GEAR = gear_table()
+
+
+def cdc_cut(data, start):
+    n = len(data) - start
+    if n <= CDC_MIN_SIZE:
+        return n
+    end = min(n, CDC_MAX_SIZE)
+    normal = min(CDC_AVG_SIZE, end)
+    h = 0
+    for i in range(CDC_MIN_SIZE, end):
+        h = ((h << 1) + GEAR[data[start + i]]) & M64
+        if not h & (CDC_MASK_S if i < normal else CDC_MASK_L):
+            return i + 1
+    return end
+
+
+def chunks(data):
+    out, off = [], 0
+    while off < len(data):
+        n = cdc_cut(data, off)
+        out.append((hashlib.sha256(data[off:off + n]).digest(), off, n))
+        off += n
+    return out
+
+
+def delta_body(data, have):
+    ents, carried = b'', b''
+    cuts = chunks(data)
+    for digest, off, n in cuts:
+        send = (digest, n) not in have
+        ents += digest + struct.pack('>IB', n, send)
+        if send:
+            carried += data[off:off + n]
+    return b'DBDR0001' + struct.pack('>QI', len(data), len(cuts)) + ents + carried, len(carried)
+
+
+def main():
+    c = BinaryClient()
+    user = f"delta_{os.getpid()}".encode()
+    data = bytearray(os.urandom(400 * 1024))
+    ok = True
+
+    status, _ = c.request(OP_SIGNUP, user, b'secret')
+    ok &= check('signup', status == OK)
+    status, _ = c.request(OP_UPLOAD, b'doc.bin', bytes(data))
+    ok &= check('upload 400 KB', status == OK)
+
+    status, body = c.request(OP_CHUNKS, b'doc.bin')
+    if status == ERR and b'not supported' in body:
+        print('[SKIP] server built with STORE_BACKEND=plain')
+        sys.exit(0)
+    have = {(body[i:i + 32], struct.unpack('>I', body[i + 32:i + 36])[0]) for i in range(0, len(body), 36)}
+    ok &= check('server cuts match the client chunker',
+                status == OK and have == {(d, n) for d, _, n in chunks(bytes(data))})
+
+    data[200 * 1024:200 * 1024] = b'inserted in the middle'
+    body, carried = delta_body(bytes(data), have)
+    status, _ = c.request(OP_UPLOAD_DELTA, b'doc.bin', body)
+    ok &= check(f'delta upload sends {carried} of {len(data)} bytes',
+                status == OK and carried <= 2 * CDC_MAX_SIZE and carried < len(data))
+
+    status, body = c.request(OP_DOWNLOAD, b'doc.bin')
+    ok &= check('download matches the edited file', status == OK and body == bytes(data))
+
+    # a chunk that is neither sent nor part of the stored file is refused
+    forged = b'DBDR0001' + struct.pack('>QI', 10, 1) + os.urandom(32) + struct.pack('>IB', 10, 0)
+    status, body = c.request(OP_UPLOAD_DELTA, b'doc.bin', forged)
+    ok &= check('forged chunk reference refused', status == ERR and b'Invalid delta' in body)
+    status, body = c.request(OP_DOWNLOAD, b'doc.bin')
+    ok &= check('file unchanged after refusal', status == OK and body == bytes(data))
+
+    status, _ = c.request(OP_CHUNKS, b'missing.bin')
+    ok &= check('chunks of a missing file is an error', status == ERR)
+
+    c.sock.close()
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
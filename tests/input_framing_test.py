@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Input Framing Test Client for Dropbox Clone Server
+Feeds commands, upload bodies and binary frames split at arbitrary byte
+boundaries, glued together in one write, and wrapped around the end of the
+server's input ring (src/reactor.c), and checks each is parsed exactly once.
+"""
+
+import os
+import socket
+import sys
+import time
+
+from binary_protocol_test import BinaryClient, check, HDR, MAGIC, OK, OP_LOGIN, OP_UPLOAD, OP_DOWNLOAD, \
+    SERVER_HOST, SERVER_PORT
+
+
+class TextClient:
+    def __init__(self):
+        self.sock = socket.create_connection((SERVER_HOST, SERVER_PORT))
+        self.sock.settimeout(10)
+        self.buf = b''
+
+    def line(self):
+        while b'\n' not in self.buf:
+            chunk = self.sock.recv(65536)
+            if not chunk:
+                raise ConnectionError('server closed connection')
+            self.buf += chunk
+        line, self.buf = self.buf.split(b'\n', 1)
+        return line + b'\n'
+
+    def exact(self, n):
+        while len(self.buf) < n:
+            self.buf += self.sock.recv(65536)
+        out, self.buf = self.buf[:n], self.buf[n:]
+        return out
+
+    def trickle(self, data, delay=0.003):
+        for i in range(len(data)):
+            self.sock.sendall(data[i:i + 1])
+            time.sleep(delay)
+
+
+def main():
+    ok = True
+    user = f"frame_{os.getpid()}".encode()
+    t = TextClient()
+
+    # one byte per write, with a pause after each
+    t.trickle(b'signup ' + user + b' pw\n')
+    ok &= check('command sent byte by byte', t.line() == b'Signup successful. You are now logged in.\n')
+
+    # command, its body and the next command in one write
+    body = os.urandom(5000)
+    t.sock.sendall(b'UPLOAD one.bin %d\n' % len(body))
+    t.line()  # ready
+    t.sock.sendall(body + b'DOWNLOAD one.bin BINARY\n')
+    result = t.line()
+    ok &= check('upload body followed by a command', b'SUCCESS' in result.upper() and
+                t.line() == b'FILE %d\n' % len(body) and t.exact(len(body)) == body)
+
+    # command split in the middle of a word, then of the line ending
+    t.sock.sendall(b'DOWN')
+    time.sleep(0.005)
+    t.sock.sendall(b'LOAD one.bin BIN')
+    time.sleep(0.005)
+    t.sock.sendall(b'ARY\r')
+    time.sleep(0.005)
+    t.sock.sendall(b'\n')
+    ok &= check('command split mid-word', t.line() == b'FILE %d\n' % len(body) and t.exact(len(body)) == body)
+
+    # a pause inside a line is just the rest still in flight
+    t.sock.sendall(b'LI')
+    time.sleep(0.3)
+    t.sock.sendall(b'ST\n')
+    ok &= check('command split by a pause', t.line() == b'one.bin %d\n' % len(body))
+
+    # over-long argument refused without touching anything
+    t.sock.sendall(b'DELETE ' + b'x' * 60 + b'\n')
+    ok &= check('over-long name refused', t.line().startswith(b'*** Invalid format'))
+
+    # many commands at once: the ring fills, drains and wraps around
+    t.sock.sendall(b'LIST\n' * 5000)
+    lines = [t.line() for _ in range(5000)]
+    ok &= check('5000 commands in one write', all(l == b'one.bin %d\n' % len(body) for l in lines))
+
+    # a line without '\n' that fills the whole ring
+    t.sock.sendall(b'x' * 20000 + b'\nLIST\n')
+    ok &= check('command too long', t.line() == b'*** Error: Command too long\n')
+    t.sock.close()
+
+    # binary frames split into small pieces, two of them in one stream
+    c = BinaryClient()
+    status, _ = c.request(OP_LOGIN, user, b'pw')
+    ok &= check('binary login', status == OK)
+    payload = os.urandom(3000)
+    frame = HDR.pack(MAGIC, OP_UPLOAD, 0, 900, 7, len(payload)) + b'two.bin' + payload
+    frame += HDR.pack(MAGIC, OP_DOWNLOAD, 0, 901, 7, 0) + b'two.bin'
+    for i in range(0, len(frame), 7):
+        c.sock.sendall(frame[i:i + 7])
+        time.sleep(0.0005)
+    r1 = HDR.unpack(c._recv_exact(HDR.size))
+    c._recv_exact(r1[5])
+    r2 = HDR.unpack(c._recv_exact(HDR.size))
+    ok &= check('binary frames split in 7-byte pieces',
+                r1[2] == OK and r1[3] == 900 and r2[3] == 901 and c._recv_exact(r2[5]) == payload)
+    c.sock.close()
+
+    # half-close: commands sent before shutdown(SHUT_WR) are all answered,
+    # an unterminated last line included, before the server closes
+    answered = 0
+    for i in range(50):
+        h = TextClient()
+        h.sock.sendall(b'login ' + user + b' pw\nLIST\nDOWNLOAD one.bin BINARY\nLIST')
+        h.sock.shutdown(socket.SHUT_WR)
+        data = b''
+        while True:
+            chunk = h.sock.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        h.sock.close()
+        answered += data.startswith(b'Login successful\n') and data.count(b'one.bin %d\n' % len(body)) == 2 \
+            and body in data
+    ok &= check('replies flushed after the client half-closes (50 runs)', answered == 50)
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
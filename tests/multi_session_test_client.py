@@ -56,7 +56,7 @@ class ClientSession:
         
         response = self.send_command(f"UPLOAD {filename}")
         if "READY_TO_RECEIVE" in response:
-            self.sock.sendall(encoded.encode())
+            self.sock.sendall((encoded + '\n').encode())
             result = self.sock.recv(4096).decode()
             print(f"[Session {self.session_id}] Upload response: {result.strip()}")
             return result
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Pipelining Test Client for Dropbox Clone Server
+Sends many requests in one write without waiting for replies: reads run
+concurrently on the server but their replies must come back in request
+order, and a mutation in the middle of the pipeline must be seen by the
+reads behind it (src/reactor.h).
+"""
+
+import os
+import socket
+import sys
+
+from binary_protocol_test import (BinaryClient, check, HDR, MAGIC, OK, ERR, OP_SIGNUP, OP_LOGIN, OP_UPLOAD,
+                                  OP_DOWNLOAD, OP_DELETE, OP_LIST, SERVER_HOST, SERVER_PORT)
+
+OP_CHUNKS = 8
+
+
+def pipeline(c, requests):
+    """Send (opcode, name, body) requests in one write, return [(op, status, req_id, body)]"""
+    out, ids = b'', []
+    for op, name, body in requests:
+        ids.append(c.next_id)
+        out += HDR.pack(MAGIC, op, 0, c.next_id, len(name), len(body)) + name + body
+        c.next_id += 1
+    c.sock.sendall(out)
+    replies = []
+    for _ in requests:
+        magic, op, status, rid, name_len, body_len = HDR.unpack(c._recv_exact(HDR.size))
+        c._recv_exact(name_len)
+        replies.append((op, status, rid, c._recv_exact(body_len)))
+    return ids, replies
+
+
+def main():
+    c = BinaryClient()
+    user = f"pipe_{os.getpid()}".encode()
+    files = {b'a.bin': os.urandom(100 * 1024), b'b.txt': b'small file\n', b'c.bin': os.urandom(300 * 1024)}
+    ok = True
+
+    status, _ = c.request(OP_SIGNUP, user, b'secret')
+    ok &= check('signup', status == OK)
+    for name, data in files.items():
+        status, _ = c.request(OP_UPLOAD, name, data)
+        ok &= check(f'upload {name.decode()}', status == OK)
+
+    # reads only: all in flight at once, replies in order
+    reqs = [(OP_DOWNLOAD, b'a.bin', b''), (OP_LIST, b'', b''), (OP_DOWNLOAD, b'missing', b''),
+            (OP_DOWNLOAD, b'b.txt', b''), (OP_DOWNLOAD, b'c.bin', b''), (OP_CHUNKS, b'a.bin', b'')]
+    ids, replies = pipeline(c, reqs)
+    ok &= check('replies come back in request order',
+                [r[2] for r in replies] == ids and [r[0] for r in replies] == [q[0] for q in reqs])
+    ok &= check('pipelined downloads match',
+                replies[0][3] == files[b'a.bin'] and replies[3][3] == files[b'b.txt'] and
+                replies[4][3] == files[b'c.bin'])
+    ok &= check('pipelined list and error', replies[1][1] == OK and b'c.bin 307200' in replies[1][3]
+                and replies[2][1] == ERR)
+
+    # mutations are barriers: reads behind them see their effect
+    new_b = b'rewritten while pipelined\n'
+    ids, replies = pipeline(c, [(OP_DOWNLOAD, b'b.txt', b''), (OP_UPLOAD, b'b.txt', new_b),
+                                (OP_DOWNLOAD, b'b.txt', b''), (OP_DELETE, b'a.bin', b''),
+                                (OP_DOWNLOAD, b'a.bin', b''), (OP_LIST, b'', b'')])
+    ok &= check('mixed pipeline stays in order', [r[2] for r in replies] == ids)
+    ok &= check('read before the upload sees the old version', replies[0][3] == files[b'b.txt'])
+    ok &= check('read after the upload sees the new version', replies[1][1] == OK and replies[2][3] == new_b)
+    ok &= check('read after the delete misses', replies[3][1] == OK and replies[4][1] == ERR)
+    ok &= check('list after the delete', b'a.bin' not in replies[5][3] and b'b.txt' in replies[5][3])
+
+    # deeper than the per-connection limit
+    ids, replies = pipeline(c, [(OP_DOWNLOAD, b'b.txt', b'')] * 100)
+    ok &= check('100 pipelined downloads', [r[2] for r in replies] == ids and
+                all(r[1] == OK and r[3] == new_b for r in replies))
+
+    # text protocol: the same ordering
+    s = socket.create_connection((SERVER_HOST, SERVER_PORT))
+    s.settimeout(10)
+    s.sendall(b'login ' + user + b' secret\nDOWNLOAD c.bin BINARY\nDOWNLOAD b.txt BINARY\nLIST\n')
+    buf = b''
+    want = b'Login successful\n' + b'FILE %d\n' % len(files[b'c.bin']) + files[b'c.bin'] + \
+        b'FILE %d\n' % len(new_b) + new_b + b'b.txt'
+    while len(buf) < len(want):
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        buf += chunk
+    ok &= check('text pipeline in order', buf[:len(want)] == want)
+    s.close()
+
+    c.sock.close()
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,172 @@
+#include "../src/base64.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Base64 checks, run once per kernel this CPU has: the RFC 4648 vectors,
+// round trips at every length across the vector block sizes, decoding with
+// characters outside the alphabet scattered through the input, and short
+// output buffers, each compared against the one-character-at-a-time coder
+// the server used before (reimplemented here as the reference).
+
+#define CHECK(cond, msg)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL [%s]: %s (line %d)\n", base64_kernel(), msg, __LINE__); \
+            return 1;                                      \
+        }                                                  \
+    } while (0)
+
+#define MAX_LEN 4096
+
+static const char ref_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t ref_encode(const unsigned char *in, size_t len, char *out, size_t out_size)
+{
+    size_t out_len = 0;
+    for (size_t i = 0; i < len; i += 3)
+    {
+        int val = (in[i] << 16) + ((i + 1 < len ? in[i + 1] : 0) << 8) + (i + 2 < len ? in[i + 2] : 0);
+        if (out_len + 4 >= out_size)
+            break;
+        out[out_len++] = ref_table[(val >> 18) & 63];
+        out[out_len++] = ref_table[(val >> 12) & 63];
+        out[out_len++] = (i + 1 < len) ? ref_table[(val >> 6) & 63] : '=';
+        out[out_len++] = (i + 2 < len) ? ref_table[val & 63] : '=';
+    }
+    out[out_len] = '\0';
+    return out_len;
+}
+
+static size_t ref_decode(const char *in, size_t len, unsigned char *out, size_t out_size)
+{
+    int val = 0, valb = -8;
+    size_t out_len = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const char *d = in[i] ? strchr(ref_table, in[i]) : NULL;
+        if (!d)
+            continue;
+        val = (val << 6) + (int)(d - ref_table);
+        valb += 6;
+        if (valb >= 0)
+        {
+            if (out_len >= out_size)
+                break;
+            out[out_len++] = (val >> valb) & 0xFF;
+            valb -= 8;
+        }
+    }
+    return out_len;
+}
+
+static void fill(unsigned char *buf, size_t size, unsigned int seed)
+{
+    uint64_t x = 88172645463325252ULL + seed;
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        buf[i] = (unsigned char)x;
+    }
+}
+
+static int run_kernel(void)
+{
+    static unsigned char data[MAX_LEN], dec[MAX_LEN + 64], ref[MAX_LEN + 64];
+    static char enc[BASE64_ENCODED_LEN(MAX_LEN) + 64], want[BASE64_ENCODED_LEN(MAX_LEN) + 64];
+    static char noisy[2 * BASE64_ENCODED_LEN(MAX_LEN)];
+
+    // ---- RFC 4648 vectors ----
+    static const char *vectors[][2] = {{"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"},
+                                       {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}};
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        size_t n = strlen(vectors[v][0]);
+        CHECK(base64_encode(vectors[v][0], n, enc, sizeof(enc)) == strlen(vectors[v][1]) &&
+              !strcmp(enc, vectors[v][1]), "encode vector");
+        CHECK(base64_decode(vectors[v][1], strlen(vectors[v][1]), dec, sizeof(dec)) == n &&
+              !memcmp(dec, vectors[v][0], n), "decode vector");
+    }
+
+    // ---- every length up to 300, then a few big ones; all 256 byte values ----
+    for (size_t len = 0; len <= MAX_LEN; len = len < 300 ? len + 1 : len * 2 + 7) {
+        fill(data, len, (unsigned int)len);
+        size_t n = base64_encode(data, len, enc, sizeof(enc));
+        CHECK(n == BASE64_ENCODED_LEN(len) && n == ref_encode(data, len, want, sizeof(want)) && !strcmp(enc, want),
+              "encode matches reference");
+        CHECK(base64_decode(enc, n, dec, sizeof(dec)) == len && !memcmp(dec, data, len), "round trip");
+    }
+    for (int i = 0; i < 256; i++)
+        data[i] = (unsigned char)i;
+    size_t n = base64_encode(data, 256, enc, sizeof(enc));
+    CHECK(base64_decode(enc, n, dec, sizeof(dec)) == 256 && !memcmp(dec, data, 256), "all byte values");
+
+    // ---- characters outside the alphabet are skipped wherever they are ----
+    static const char junk[] = "\r\n =\t*-_\x80\xff";
+    for (unsigned int seed = 0; seed < 200; seed++) {
+        size_t len = 100 + seed * 17 % 2000;
+        fill(data, len, seed);
+        n = base64_encode(data, len, enc, sizeof(enc));
+        size_t m = 0;
+        unsigned int x = seed * 2654435761u;
+        for (size_t i = 0; i < n; i++) {
+            x = x * 1103515245u + 12345u;
+            if ((x >> 16) % (seed % 7 + 2) == 0)
+                noisy[m++] = junk[(x >> 8) % (sizeof(junk) - 1)];
+            noisy[m++] = enc[i];
+        }
+        size_t got = base64_decode(noisy, m, dec, sizeof(dec));
+        CHECK(got == len && got == ref_decode(noisy, m, ref, sizeof(ref)) && !memcmp(dec, data, len),
+              "noisy input matches reference");
+    }
+
+    // ---- line-wrapped (MIME style) ----
+    fill(data, 3000, 9);
+    n = base64_encode(data, 3000, enc, sizeof(enc));
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        noisy[m++] = enc[i];
+        if (i % 76 == 75) {
+            noisy[m++] = '\r';
+            noisy[m++] = '\n';
+        }
+    }
+    CHECK(base64_decode(noisy, m, dec, sizeof(dec)) == 3000 && !memcmp(dec, data, 3000), "wrapped lines");
+
+    // ---- short output buffers: same truncation as the reference ----
+    for (size_t size = 0; size < 200; size++) {
+        memset(dec, 0xAA, sizeof(dec));
+        size_t got = base64_decode(enc, n, dec, size);
+        CHECK(got == size && !memcmp(dec, data, got) && dec[got] == 0xAA, "decode stops at out_size");
+    }
+    for (size_t size = 0; size < 200; size++) {
+        if (size == 0) {
+            CHECK(base64_encode(data, 120, enc, 0) == 0, "encode into nothing");
+            continue;
+        }
+        size_t want_n = ref_encode(data, 120, want, size);
+        CHECK(base64_encode(data, 120, enc, size) == want_n && !strcmp(enc, want), "encode truncates");
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const char *names[] = {"scalar", "ssse3", "avx2"};
+    int ran = 0;
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        if (base64_use_kernel(names[k]) != 0) {
+            printf("  %s: not available, skipped\n", names[k]);
+            continue;
+        }
+        if (run_kernel() != 0)
+            return 1;
+        printf("  %s: ok\n", names[k]);
+        ran++;
+    }
+    if (ran == 0) {
+        fprintf(stderr, "FAIL: no kernel ran\n");
+        return 1;
+    }
+    printf("All base64 tests passed\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "../src/file_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// File cache checks: hits/misses, LRU eviction within a shard's budget,
+// invalidation (including a stale insert racing with it), entries outliving
+// their eviction while referenced, and readers vs writers on a hot key.
+
+#define CHECK(cond, msg)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+            return 1;                                      \
+        }                                                  \
+    } while (0)
+
+#define ENTRY 1000
+
+static file_cache_t *shared;
+static _Atomic int writer_done;
+
+// Every hit on "hot" must be a whole version: ENTRY copies of one byte
+static void *hot_reader(void *arg)
+{
+    (void)arg;
+    long hits = 0;
+    while (!writer_done) {
+        file_cache_entry_t *e = file_cache_get(shared, "u", "hot");
+        if (!e) {
+            unsigned long t = file_cache_ticket(shared, "u", "hot");
+            unsigned char buf[ENTRY];
+            memset(buf, 'r', sizeof(buf));
+            file_cache_insert(shared, "u", "hot", buf, sizeof(buf), t);
+            continue;
+        }
+        for (size_t i = 0; i < e->size; i++)
+            if (e->data[i] != e->data[0] || e->size != ENTRY) {
+                file_cache_release(e);
+                return (void *)-1L;
+            }
+        file_cache_release(e);
+        hits++;
+    }
+    return (void *)hits;
+}
+
+int main(void)
+{
+    unsigned char buf[ENTRY];
+    char name[32];
+
+    // ---- hit / miss / invalidate ----
+    file_cache_t *c = file_cache_init(FILE_CACHE_SHARDS * 10 * ENTRY); // 10 entries per shard
+    CHECK(c, "file_cache_init");
+    CHECK(!file_cache_get(c, "alice", "a.txt"), "cold miss");
+    memset(buf, 'a', sizeof(buf));
+    file_cache_insert(c, "alice", "a.txt", buf, 5, file_cache_ticket(c, "alice", "a.txt"));
+    file_cache_entry_t *e = file_cache_get(c, "alice", "a.txt");
+    CHECK(e && e->size == 5 && memcmp(e->data, "aaaaa", 5) == 0, "hit after insert");
+    CHECK(!file_cache_get(c, "alice", "b.txt") && !file_cache_get(c, "bob", "a.txt"), "keyed by user and file");
+
+    // an entry handed out stays valid after it leaves the cache
+    file_cache_invalidate(c, "alice", "a.txt");
+    CHECK(!file_cache_get(c, "alice", "a.txt"), "gone after invalidate");
+    CHECK(memcmp(e->data, "aaaaa", 5) == 0, "reader keeps its copy");
+    file_cache_release(e);
+
+    // a read that started before an invalidation must not be inserted
+    unsigned long t = file_cache_ticket(c, "alice", "a.txt");
+    file_cache_invalidate(c, "alice", "a.txt");
+    file_cache_insert(c, "alice", "a.txt", buf, 5, t);
+    CHECK(!file_cache_get(c, "alice", "a.txt"), "stale insert dropped");
+
+    file_cache_insert(c, "alice", "big", buf, FILE_CACHE_MAX_ENTRY + 1, file_cache_ticket(c, "alice", "big"));
+    CHECK(!file_cache_get(c, "alice", "big"), "oversized file not cached");
+
+    // ---- LRU eviction: keep touching f0 while filling far past the budget ----
+    file_cache_insert(c, "u", "f0", buf, ENTRY, file_cache_ticket(c, "u", "f0"));
+    for (int i = 1; i < 2000; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        file_cache_insert(c, "u", name, buf, ENTRY, file_cache_ticket(c, "u", name));
+        file_cache_release(file_cache_get(c, "u", "f0"));
+    }
+    e = file_cache_get(c, "u", "f0");
+    CHECK(e, "recently used entry survives");
+    file_cache_release(e);
+    int cached = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < 2000; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        if ((e = file_cache_get(c, "u", name))) {
+            cached++;
+            file_cache_release(e);
+        }
+    }
+    for (int s = 0; s < FILE_CACHE_SHARDS; s++) {
+        CHECK(c->shards[s].bytes <= c->shards[s].capacity, "shard within budget");
+        bytes += c->shards[s].bytes;
+    }
+    CHECK(cached > 0 && cached <= FILE_CACHE_SHARDS * 10, "bounded entry count");
+    CHECK(atomic_load(&c->evictions) > 0, "evictions counted");
+    CHECK(atomic_load(&c->hits) > 0 && atomic_load(&c->misses) > 0, "hit/miss counted");
+    file_cache_destroy(c);
+
+    // ---- readers vs invalidating writer on one key ----
+    shared = file_cache_init(FILE_CACHE_BYTES);
+    pthread_t readers[2];
+    for (int i = 0; i < 2; i++)
+        pthread_create(&readers[i], NULL, hot_reader, NULL);
+    for (int i = 0; i < 20000; i++) {
+        unsigned long tk = file_cache_ticket(shared, "u", "hot");
+        memset(buf, 'A' + i % 26, sizeof(buf));
+        file_cache_invalidate(shared, "u", "hot"); // new version on disk
+        file_cache_insert(shared, "u", "hot", buf, sizeof(buf), tk); // stale ticket: dropped
+        if (i % 3 == 0)
+            file_cache_insert(shared, "u", "hot", buf, sizeof(buf), file_cache_ticket(shared, "u", "hot"));
+    }
+    writer_done = 1;
+    for (int i = 0; i < 2; i++) {
+        void *ret;
+        pthread_join(readers[i], &ret);
+        CHECK((long)ret >= 0, "reader saw a torn entry");
+    }
+    file_cache_destroy(shared);
+
+    printf("File cache test passed.\n");
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "../src/io_ring.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+// Storage I/O ring checks: more files than the ring has entries are created,
+// written, synced, read back and unlinked in batches, results come back in
+// the kernel's convention (fd, bytes or -errno), long paths take the
+// blocking path, and threads get rings of their own. With io_uring each
+// batch costs a few io_uring_enter calls instead of one syscall per request.
+// Runs in a scratch directory.
+
+#define CHECK(cond, msg)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+            return 1;                                      \
+        }                                                  \
+    } while (0)
+
+#define NFILES (IO_RING_DEPTH * 3 + 5) // spills over the ring several times
+#define FILE_SIZE 6000
+
+static void fill(unsigned char *buf, size_t size, unsigned int seed)
+{
+    uint64_t x = 88172645463325252ULL + seed;
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        buf[i] = (unsigned char)x;
+    }
+}
+
+static unsigned char data[NFILES][FILE_SIZE];
+
+static int round_trip(int dirfd, const char *prefix)
+{
+    char name[64];
+    int fds[NFILES], res[NFILES];
+
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "%s%d", prefix, i);
+        io_ring_openat(dirfd, name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600, &fds[i]);
+    }
+    io_ring_wait();
+    for (int i = 0; i < NFILES; i++)
+        CHECK(fds[i] >= 0, "openat O_CREAT");
+
+    // two halves per file, so requests on one fd are in flight together
+    int res2[NFILES];
+    for (int i = 0; i < NFILES; i++) {
+        io_ring_write(fds[i], data[i], FILE_SIZE / 2, 0, &res[i]);
+        io_ring_write(fds[i], data[i] + FILE_SIZE / 2, FILE_SIZE / 2, FILE_SIZE / 2, &res2[i]);
+    }
+    io_ring_wait();
+    for (int i = 0; i < NFILES; i++)
+        CHECK(res[i] == FILE_SIZE / 2 && res2[i] == FILE_SIZE / 2, "write");
+
+    for (int i = 0; i < NFILES; i++)
+        io_ring_fsync(fds[i], &res[i]);
+    io_ring_wait();
+    for (int i = 0; i < NFILES; i++)
+        CHECK(res[i] == 0, "fsync");
+
+    unsigned char (*back)[FILE_SIZE] = calloc(NFILES, FILE_SIZE);
+    CHECK(back != NULL, "calloc");
+    for (int i = 0; i < NFILES; i++)
+        io_ring_read(fds[i], back[i], FILE_SIZE + 100, 0, &res[i]); // asks past the end
+    io_ring_wait();
+    for (int i = 0; i < NFILES; i++) {
+        CHECK(res[i] == FILE_SIZE, "read stops at end of file");
+        CHECK(memcmp(back[i], data[i], FILE_SIZE) == 0, "read back what was written");
+        close(fds[i]);
+    }
+
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "%s%d", prefix, i);
+        io_ring_unlinkat(dirfd, name, 0, &res[i]);
+    }
+    io_ring_wait();
+    for (int i = 0; i < NFILES; i++)
+        CHECK(res[i] == 0, "unlinkat");
+
+    // errors come back as -errno, each in its own result
+    snprintf(name, sizeof(name), "%s0", prefix);
+    io_ring_unlinkat(dirfd, name, 0, &res[0]);
+    io_ring_openat(dirfd, name, O_RDONLY, 0, &res[1]);
+    io_ring_read(-1, back[0], 10, 0, &res[2]);
+    io_ring_wait();
+    CHECK(res[0] == -ENOENT, "unlinkat of a removed file");
+    CHECK(res[1] == -ENOENT, "openat of a removed file");
+    CHECK(res[2] == -EBADF, "read from a bad fd");
+    free(back);
+    return 0;
+}
+
+static int dir_fd;
+
+static void *thread_main(void *arg)
+{
+    return (void *)(intptr_t)round_trip(dir_fd, (const char *)arg);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/io_ring_test_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    CHECK(dir_fd >= 0, "open scratch dir");
+    for (int i = 0; i < NFILES; i++)
+        fill(data[i], FILE_SIZE, i);
+    printf("Backend: %s\n", io_ring_backend());
+
+    unsigned long ops0, submits0, ops, submits;
+    io_ring_stats(&ops0, &submits0);
+    if (round_trip(dir_fd, "f") != 0)
+        return 1;
+    io_ring_stats(&ops, &submits);
+    printf("%lu requests, %lu ring submissions\n", ops - ops0, submits - submits0);
+    CHECK(ops - ops0 == NFILES * 6 + 3, "every request counted");
+    if (strcmp(io_ring_backend(), "io_uring") == 0)
+        CHECK(submits - submits0 < (ops - ops0) / 4, "requests batched into few submissions");
+    else
+        CHECK(submits == submits0, "blocking backend never enters a ring");
+
+    // paths too long for a slot run in place, same results
+    char longpath[600];
+    int len = snprintf(longpath, sizeof(longpath), "%s/", dir);
+    memset(longpath + len, 'x', 300);
+    longpath[len + 300] = '\0';
+    int res;
+    io_ring_openat(AT_FDCWD, longpath, O_RDONLY, 0, &res);
+    io_ring_wait();
+    CHECK(res == -ENAMETOOLONG, "long path opens in place");
+
+    // each thread has a ring of its own and runs its batches alongside the other
+    pthread_t t[2];
+    pthread_create(&t[0], NULL, thread_main, "a");
+    pthread_create(&t[1], NULL, thread_main, "b");
+    for (int i = 0; i < 2; i++) {
+        void *rc;
+        pthread_join(t[i], &rc);
+        CHECK(rc == NULL, "thread round trip");
+    }
+
+    close(dir_fd);
+    rmdir(dir);
+    printf("All I/O ring tests passed\n");
+    return 0;
+}
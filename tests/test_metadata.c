@@ -0,0 +1,383 @@
+#include "../src/metadata.h"
+#include "../src/meta_log.h"
+#include "../src/storage_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Metadata store checks: user index lookups (also while signups are running
+// concurrently), authentication, per-user files and quota, and reloading the
+// store from its log + snapshots (built with a tiny snapshot threshold so
+// log generations roll over many times), and the cold-start storage index.
+
+#define N_USERS 5000   // forces several user index resizes under the readers
+#define N_NAMES 4000   // churn name space
+#define N_FILES 20000  // files of one user
+
+#define CHECK(cond, msg)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+            return 1;                                      \
+        }                                                  \
+    } while (0)
+
+static metadata_t *shared;
+static _Atomic int writer_done;
+
+// Uploads to user "q": reserve, then commit (odd i) or give up (even i).
+// Reservations never overshoot the quota, however they interleave.
+static void *reserver(void *arg)
+{
+    long id = (long)arg, ok = 0;
+    char fname[32];
+    for (int i = 0; i < 20000; i++) {
+        if (metadata_reserve_quota(shared, "q", 4096) != 0)
+            continue;
+        user_t *u;
+        metadata_get_user(shared, "q", &u);
+        if (u->quota_used > u->quota_max)
+            return (void *)-1L;
+        snprintf(fname, sizeof(fname), "t%ld-%d", id, i % 16);
+        if (i & 1 && metadata_commit_file(shared, "q", fname, 4096, 4096) == 0)
+            ok++;
+        else
+            metadata_release_quota(shared, "q", 4096);
+    }
+    return (void *)ok;
+}
+
+// Spins over users 0..N while the main thread is still creating them:
+// a user is either not found or found complete, never half-built.
+static void *reader(void *arg)
+{
+    (void)arg;
+    char name[64];
+    long found = 0;
+    while (!writer_done) {
+        for (int i = 0; i < N_USERS; i += 7) {
+            snprintf(name, sizeof(name), "user%d", i);
+            user_t *u;
+            if (metadata_get_user(shared, name, &u) == 0) {
+                if (strcmp(u->username, name) != 0 || u->quota_max != DEFAULT_QUOTA)
+                    return (void *)-1L;
+                found++;
+            }
+        }
+    }
+    return (void *)found;
+}
+
+// LIST and file lookups on one user while the main thread adds/removes its
+// files: every listing must be well-formed, every lookup a complete record.
+static void *list_reader(void *arg)
+{
+    (void)arg;
+    long lists = 0;
+    while (!writer_done) {
+        size_t len;
+        char *out = metadata_list_files(shared, "rw", &len);
+        if (!out || len == 0 || out[len - 1] != '\n')
+            return (void *)-1L;
+        free(out);
+        file_t *f = metadata_get_and_lock_file(shared, "rw", "stable");
+        if (!f || strcmp(f->filename, "stable") != 0)
+            return (void *)-1L;
+        metadata_unlock_file(f);
+        lists++;
+    }
+    return (void *)lists;
+}
+
+int main(void) {
+    metadata_t *m = metadata_init();
+    CHECK(m, "metadata_init");
+
+    // ---- users ----
+    CHECK(metadata_add_user(m, "alice", "pw1") == 0, "add alice");
+    CHECK(metadata_add_user(m, "alice", "other") == -2, "duplicate alice");
+    CHECK(metadata_add_user(m, "admin_root", "pw2") == 0, "add admin");
+
+    user_t *u = NULL;
+    CHECK(metadata_get_user(m, "alice", &u) == 0 && strcmp(u->username, "alice") == 0, "get alice");
+    CHECK(metadata_get_user(m, "admin_root", &u) == 0 && u->priority == 3, "admin priority");
+    CHECK(metadata_get_user(m, "bob", &u) == -1, "unknown user");
+    CHECK(metadata_authenticate(m, "alice", "pw1") == 1, "auth ok");
+    CHECK(metadata_authenticate(m, "alice", "pw2") == 0, "auth wrong password");
+    CHECK(metadata_authenticate(m, "bob", "pw1") == 0, "auth unknown user");
+    CHECK(metadata_get_user(m, "alice", &u) == 0 && strlen(u->credential) == CREDENTIAL_LEN &&
+          !strstr(u->credential, "pw1"), "only a credential is kept");
+    user_t *carol = NULL;
+    CHECK(metadata_add_user(m, "carol", "pw1") == 0 && metadata_get_user(m, "carol", &carol) == 0 &&
+          strcmp(carol->credential, u->credential) != 0, "same password, different salt");
+    CHECK(metadata_add_user(m, ".metadata", "pw") == -1, "dot name refused");
+    CHECK(metadata_add_user(m, "a/b", "pw") == -1, "slash refused");
+    CHECK(metadata_add_user(m, "", "pw") == -1, "empty name refused");
+    CHECK(metadata_restore_user(m, "old", "plainpw") == 0 && m->legacy_passwords == 1,
+          "plaintext password from an old log");
+    CHECK(metadata_get_user(m, "old", &u) == 0 && strcmp(u->credential, "plainpw") != 0 &&
+          metadata_authenticate(m, "old", "plainpw"), "hashed on load");
+
+    // ---- files + quota ----
+    CHECK(metadata_add_file(m, "alice", "a.txt", 100) == 0, "add a.txt");
+    CHECK(metadata_add_file(m, "alice", "b.txt", 200) == 0, "add b.txt");
+    CHECK(metadata_add_file(m, "alice", "a.txt", 300) == 0, "overwrite a.txt");
+    CHECK(metadata_get_user(m, "alice", &u) == 0 && u->quota_used == 500, "quota after overwrite");
+    CHECK(metadata_add_file(m, "alice", "huge", DEFAULT_QUOTA) == -2, "over quota");
+    CHECK(metadata_remove_file(m, "alice", "a.txt") == 0, "remove a.txt");
+    CHECK(metadata_remove_file(m, "alice", "a.txt") == -1, "remove twice");
+    CHECK(u->quota_used == 200, "quota after remove");
+
+    // ---- reservations ----
+    CHECK(metadata_reserve_quota(m, "alice", DEFAULT_QUOTA - 200) == 0, "reserve the rest");
+    CHECK(metadata_reserve_quota(m, "alice", 1) == -2, "nothing left to reserve");
+    CHECK(metadata_reserve_quota(m, "bob", 1) == -1, "reserve for unknown user");
+    CHECK(metadata_commit_file(m, "alice", "r.bin", 1000, DEFAULT_QUOTA - 200) == 0, "commit smaller than reserved");
+    CHECK(u->quota_used == 1200, "unused reservation given back");
+    CHECK(metadata_reserve_quota(m, "alice", 1000) == 0, "reserve for overwrite");
+    CHECK(metadata_commit_file(m, "alice", "r.bin", 1000, 1000) == 0, "commit overwrite");
+    CHECK(u->quota_used == 1200, "overwrite charged once");
+    CHECK(metadata_remove_file(m, "alice", "r.bin") == 0, "remove r.bin");
+    size_t out_len;
+    char *out = metadata_list_files(m, "alice", &out_len);
+    CHECK(out && strcmp(out, "b.txt 200\n") == 0 && out_len == 10, "list");
+    free(out);
+    file_t *f = metadata_get_and_lock_file(m, "alice", "b.txt");
+    CHECK(f && f->size == 200, "get_and_lock b.txt");
+    metadata_unlock_file(f);
+
+    // ---- file index churn: random add/remove against a reference set ----
+    CHECK(metadata_add_user(m, "churn", "pw") == 0, "add churn");
+    static int present[N_NAMES];
+    int n_names = N_NAMES, n_present = 0;
+    srand(7);
+    for (int op = 0; op < 200000; op++) {
+        int k = rand() % n_names;
+        char fname[32];
+        snprintf(fname, sizeof(fname), "f%d", k);
+        if (present[k]) {
+            CHECK(metadata_remove_file(m, "churn", fname) == 0, "churn remove");
+            present[k] = 0;
+            n_present--;
+        } else {
+            CHECK(metadata_add_file(m, "churn", fname, 1) == 0, "churn add");
+            present[k] = 1;
+            n_present++;
+        }
+    }
+    CHECK(metadata_get_user(m, "churn", &u) == 0 && u->num_files == n_present &&
+          u->quota_used == (size_t)n_present, "churn counts");
+    for (int k = 0; k < n_names; k++) {
+        char fname[32];
+        snprintf(fname, sizeof(fname), "f%d", k);
+        f = metadata_get_and_lock_file(m, "churn", fname);
+        CHECK((f != NULL) == present[k], "churn lookup");
+        metadata_unlock_file(f);
+    }
+
+    // ---- no per-user cap, names interned across users ----
+    CHECK(metadata_add_user(m, "many", "pw") == 0, "add many");
+    for (int i = 0; i < N_FILES; i++) {
+        char fname[32];
+        snprintf(fname, sizeof(fname), "f%d", i);
+        CHECK(metadata_add_file(m, "many", fname, 0) == 0, "add past old 50-file cap");
+    }
+    CHECK(metadata_get_user(m, "many", &u) == 0 && u->num_files == N_FILES, "many count");
+    file_t *f1 = metadata_get_and_lock_file(m, "many", "f1");
+    file_t *f2 = metadata_get_and_lock_file(m, "churn", "f1");
+    CHECK(f1 && (!f2 || f1->filename == f2->filename), "shared name interned once");
+    metadata_unlock_file(f1);
+    metadata_unlock_file(f2);
+    out = metadata_list_files(m, "many", &out_len);
+    CHECK(out && out_len > (size_t)N_FILES * 5 && strncmp(out, "f0 0\nf1 0\n", 10) == 0, "big list in order");
+    free(out);
+    metadata_destroy(m);
+
+    // ---- lock-free lookups racing signups ----
+    shared = metadata_init();
+    pthread_t readers[2];
+    for (int i = 0; i < 2; i++)
+        pthread_create(&readers[i], NULL, reader, NULL);
+    char name[64];
+    for (int i = 0; i < N_USERS; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        CHECK(metadata_add_user(shared, name, "pw") == 0, "concurrent signup");
+    }
+    writer_done = 1;
+    for (int i = 0; i < 2; i++) {
+        void *ret;
+        pthread_join(readers[i], &ret);
+        CHECK((long)ret >= 0, "reader saw a half-built user");
+    }
+    for (int i = 0; i < N_USERS; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        CHECK(metadata_get_user(shared, name, &u) == 0, "every user indexed");
+    }
+    metadata_destroy(shared);
+
+    // ---- shared readers vs an exclusive writer on the same user ----
+    shared = metadata_init();
+    writer_done = 0;
+    CHECK(metadata_add_user(shared, "rw", "pw") == 0, "add rw");
+    CHECK(metadata_add_file(shared, "rw", "stable", 1) == 0, "add stable");
+    for (int i = 0; i < 2; i++)
+        pthread_create(&readers[i], NULL, list_reader, NULL);
+    for (int i = 0; i < 20000; i++) {
+        char fname[32];
+        snprintf(fname, sizeof(fname), "tmp%d", i % 64);
+        if (i % 128 < 64)
+            CHECK(metadata_add_file(shared, "rw", fname, 1) == 0, "rw add");
+        else
+            CHECK(metadata_remove_file(shared, "rw", fname) == 0, "rw remove");
+    }
+    writer_done = 1;
+    for (int i = 0; i < 2; i++) {
+        void *ret;
+        pthread_join(readers[i], &ret);
+        CHECK((long)ret >= 0, "reader saw a torn listing or record");
+    }
+    metadata_destroy(shared);
+
+    // ---- concurrent reservations against one quota ----
+    shared = metadata_init();
+    CHECK(metadata_add_user(shared, "q", "pw") == 0, "add q");
+    for (long i = 0; i < 2; i++)
+        pthread_create(&readers[i], NULL, reserver, (void *)i);
+    for (int i = 0; i < 2; i++) {
+        void *ret;
+        pthread_join(readers[i], &ret);
+        CHECK((long)ret > 0, "reservation overshot the quota");
+    }
+    CHECK(metadata_get_user(shared, "q", &u) == 0 && u->quota_used == (size_t)u->num_files * 4096,
+          "only committed files stay charged");
+    metadata_destroy(shared);
+
+    // ---- persistence: log, snapshot, restart, torn tail ----
+    char dir[] = "/tmp/meta_test_XXXXXX", crash[64], cmd[512];
+    CHECK(mkdtemp(dir), "mkdtemp");
+    snprintf(crash, sizeof(crash), "%s.crash", dir);
+
+    shared = metadata_init();
+    meta_log_t *log = meta_log_open(shared, dir);
+    CHECK(log, "meta_log_open on empty dir");
+    for (int i = 0; i < 50; i++) {
+        snprintf(name, sizeof(name), "p%d", i);
+        CHECK(metadata_add_user(shared, name, "secret") == 0, "logged signup");
+        for (int k = 0; k < 20; k++) {
+            char fname[32];
+            snprintf(fname, sizeof(fname), "f%d", k);
+            CHECK(metadata_add_file(shared, name, fname, i + k) == 0, "logged add");
+        }
+        CHECK(metadata_remove_file(shared, name, "f3") == 0, "logged remove");
+        CHECK(metadata_add_file(shared, name, "f5", 1000) == 0, "logged resize");
+    }
+    size_t len1, len2;
+    char *before = metadata_list_files(shared, "p7", &len1);
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    shared = metadata_init();
+    log = meta_log_open(shared, dir);
+    CHECK(log && shared->num_users == 50, "users reloaded");
+    CHECK(metadata_authenticate(shared, "p49", "secret"), "password reloaded");
+    snprintf(cmd, sizeof(cmd), "grep -rqa secret %s", dir);
+    CHECK(system(cmd) != 0, "no plaintext password in the log or snapshot");
+    char *after = metadata_list_files(shared, "p7", &len2);
+    CHECK(after && len1 == len2 && memcmp(before, after, len1) == 0, "same listing in the same order");
+    free(before);
+    free(after);
+    CHECK(metadata_get_user(shared, "p7", &u) == 0 && u->num_files == 19, "file count reloaded");
+    CHECK(u->quota_used == 18 * 7 + (190 - 3 - 5) + 1000, "quota recomputed");
+
+    // a crash image: the log as it is on disk right after a durable change,
+    // plus half a record that never finished
+    CHECK(metadata_add_user(shared, "late", "pw") == 0, "add late");
+    CHECK(metadata_add_file(shared, "late", "x", 5) == 0, "add late file");
+    snprintf(cmd, sizeof(cmd),
+             "cp -r %s %s && printf 'torn' >> $(ls -d %s/wal-* | sort -t- -k2 -n | tail -1)",
+             dir, crash, crash);
+    CHECK(system(cmd) == 0, "copy crash image");
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    shared = metadata_init();
+    log = meta_log_open(shared, crash);
+    CHECK(log && shared->num_users == 51, "recovered from crash image");
+    f = metadata_get_and_lock_file(shared, "late", "x");
+    CHECK(f && f->size == 5, "last durable change survived");
+    metadata_unlock_file(f);
+    CHECK(metadata_add_file(shared, "late", "y", 6) == 0, "append after the cut tail");
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    shared = metadata_init();
+    log = meta_log_open(shared, crash);
+    f = log ? metadata_get_and_lock_file(shared, "late", "y") : NULL;
+    CHECK(f && f->size == 6, "log usable after recovery");
+    metadata_unlock_file(f);
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    // ---- a failed log write: nothing from then on is reported durable ----
+    char broken[64];
+    snprintf(broken, sizeof(broken), "%s.broken", dir);
+    shared = metadata_init();
+    log = meta_log_open(shared, broken);
+    CHECK(log && metadata_add_user(shared, "kept", "pw") == 0, "durable signup");
+    int ro = open("/dev/null", O_RDONLY);
+    CHECK(ro >= 0 && dup2(ro, log->fd) == log->fd, "break the log");
+    close(ro);
+    CHECK(metadata_add_user(shared, "lost", "pw") == -3, "failed write reported");
+    CHECK(metadata_add_file(shared, "kept", "f", 1) == -3, "log stays failed");
+    CHECK(metadata_remove_file(shared, "kept", "f") == -3, "remove not durable either");
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    // ---- cold start: rebuild from a storage tree with no metadata ----
+    snprintf(cmd, sizeof(cmd),
+             "cd %s && mkdir -p tree/ann tree/ben tree/.metadata && "
+             "printf 12345 > tree/ann/a.txt && printf 123 > tree/ann/b.txt && "
+             "printf xx > tree/ann/.upload-c.txt.XXXX && printf 7 > tree/ben/big && "
+             "truncate -s 3000000 tree/ben/big && printf x > tree/stray",
+             dir);
+    CHECK(system(cmd) == 0, "build storage tree");
+    char tree[128];
+    snprintf(tree, sizeof(tree), "%s/tree", dir);
+    shared = metadata_init();
+    CHECK(storage_index_build(shared, tree) == 2, "two user dirs indexed");
+    CHECK(metadata_get_user(shared, "ann", &u) == 0 && u->num_files == 2 && u->quota_used == 8,
+          "files and sizes rebuilt, stage file skipped");
+    CHECK(metadata_get_user(shared, "ben", &u) == 0 && u->quota_used == 3000000, "over-quota dir kept as is");
+    CHECK(!metadata_authenticate(shared, "ann", ""), "unclaimed user can't log in");
+    CHECK(metadata_add_user(shared, "ann", "") == -2, "empty password does not claim");
+    CHECK(metadata_add_user(shared, "ann", "pw") == -2, "signup does not take over the directory");
+    CHECK(!metadata_authenticate(shared, "ann", "pw"), "still locked");
+
+    // only the operator unlocks it, and the reset is logged
+    char cold[64];
+    snprintf(cold, sizeof(cold), "%s.cold", dir);
+    log = meta_log_open(shared, cold);
+    CHECK(log, "log over the rebuilt store");
+    CHECK(metadata_reset_password(shared, "nobody", "pw") == -1, "reset needs an existing user");
+    CHECK(metadata_reset_password(shared, "ann", "pw") == 0, "operator reset");
+    CHECK(metadata_authenticate(shared, "ann", "pw"), "reset user logs in");
+    CHECK(metadata_get_user(shared, "ann", &u) == 0 && u->num_files == 2, "reset keeps the files");
+    meta_log_close(log);
+    metadata_destroy(shared);
+    shared = metadata_init();
+    log = meta_log_open(shared, cold);
+    CHECK(log && metadata_authenticate(shared, "ann", "pw"), "reset survives a restart");
+    CHECK(!metadata_authenticate(shared, "ben", ""), "others still locked");
+    meta_log_close(log);
+    metadata_destroy(shared);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s %s %s %s", dir, crash, broken, cold);
+    system(cmd);
+
+    printf("Metadata test passed.\n");
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "../src/store_pack.h"
+#include "../src/store_chunk.h"
+#include "../src/file_io.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Pack store checks: small files become segment records (no per-file
+// directory entries) and read back, overwrites and deletes turn into dead
+// bytes that compaction reclaims while an opened file stays readable, big
+// files go to the chunk store in both directions of a small <-> big
+// overwrite, and a restart rebuilds the index from the segments and cuts
+// off a torn tail. Built with small segments (see Makefile); runs in a
+// scratch directory.
+
+#define CHECK(cond, msg)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+            return 1;                                      \
+        }                                                  \
+    } while (0)
+
+#define NFILES 200
+
+static void fill(unsigned char *buf, size_t size, unsigned int seed)
+{
+    uint64_t x = 88172645463325252ULL + seed;
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        buf[i] = (unsigned char)x;
+    }
+}
+
+static int same(const char *user, const char *file, const unsigned char *data, size_t size)
+{
+    store_file_t f;
+    if (store->open(user, file, &f) != 0)
+        return 0;
+    unsigned char *buf = malloc(size + 1);
+    ssize_t n = store_file_read(&f, buf, size + 1);
+    int ok = f.size == size && n == (ssize_t)size && memcmp(buf, data, size) == 0;
+    free(buf);
+    store_file_close(&f);
+    return ok;
+}
+
+// Regular files in a directory, dot files aside
+static int count_files(const char *path)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+        n += e->d_name[0] != '.' && e->d_type == DT_REG;
+    closedir(d);
+    return n;
+}
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+typedef struct
+{
+    int files;
+    size_t bytes;
+} scan_t;
+
+static void count_scanned(const char *username, const char *filename, size_t size, void *arg)
+{
+    scan_t *s = arg;
+    (void)filename;
+    if (!strcmp(username, "alice")) {
+        s->files++;
+        s->bytes += size;
+    }
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/pack_store_test.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        perror("scratch dir");
+        return 1;
+    }
+    mkdir(STORAGE_DIR, 0700);
+    store = &store_pack_ops;
+    CHECK(store->init() == 0, "init");
+    CHECK(create_user_dir("alice") == 0, "user dir"); // as SIGNUP does: small saves never stage
+
+    // ---- small files: packed, no directory entries ----
+    static unsigned char small[NFILES][2048];
+    char name[64];
+    for (int i = 0; i < NFILES; i++) {
+        fill(small[i], 1024, i);
+        snprintf(name, sizeof(name), "f%03d", i);
+        CHECK(save_file("alice", name, small[i], 1024) == 0, "save small");
+    }
+    pack_stats_t st;
+    store_pack_stats(&st);
+    CHECK(st.objects == NFILES, "all small files packed");
+    CHECK(st.segments > PACK_SHARDS, "segments rotated");
+    CHECK(count_files(STORAGE_DIR "/alice") == 0, "no per-file entries");
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "f%03d", i);
+        CHECK(same("alice", name, small[i], 1024), "small reads back");
+    }
+    CHECK(get_file_size("alice", "f007") == 1024, "size of a packed file");
+    CHECK(same("alice", "f007", small[7], 1024) && !same("alice", "f007", small[8], 1024), "contents differ");
+
+    // ---- overwrite half, delete a quarter; a reader pins f000 ----
+    store_file_t pinned;
+    CHECK(store->open("alice", "f000", &pinned) == 0, "pin");
+    for (int i = 0; i < NFILES / 2; i++) {
+        fill(small[i], 2048, 1000 + i);
+        snprintf(name, sizeof(name), "f%03d", i);
+        CHECK(save_file("alice", name, small[i], 2048) == 0, "overwrite small");
+    }
+    for (int i = NFILES / 2; i < NFILES * 3 / 4; i++) {
+        snprintf(name, sizeof(name), "f%03d", i);
+        CHECK(delete_file("alice", name) == 0, "delete small");
+        CHECK(get_file_size("alice", name) == 0, "deleted file gone");
+    }
+    CHECK(delete_file("alice", "f100") != 0, "second delete fails");
+
+    pack_stats_t before;
+    store_pack_stats(&before);
+    CHECK(before.objects == NFILES * 3 / 4, "objects after deletes");
+    CHECK(before.disk_bytes > before.live_bytes, "dead bytes accounted");
+
+    store_pack_compact_all();
+    store_pack_stats(&st);
+    CHECK(st.compactions > 0, "compacted");
+    CHECK(st.live_bytes == before.live_bytes, "live bytes kept");
+    CHECK(st.disk_bytes < before.disk_bytes && st.disk_bytes - st.live_bytes < 1024, "dead bytes reclaimed");
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "f%03d", i);
+        size_t size = i < NFILES / 2 ? 2048 : 1024;
+        if (i >= NFILES / 2 && i < NFILES * 3 / 4)
+            CHECK(get_file_size("alice", name) == 0, "deleted stays deleted");
+        else
+            CHECK(same("alice", name, small[i], size), "reads after compaction");
+    }
+    unsigned char old[1024];
+    fill(old, sizeof(old), 0);
+    unsigned char buf[1025];
+    CHECK(pinned.size == 1024 && store_file_read(&pinned, buf, sizeof(buf)) == 1024 && !memcmp(buf, old, 1024),
+          "pinned version survives compaction");
+    store_file_close(&pinned);
+
+    // ---- big files: chunk store, both ways ----
+    size_t big_size = 3 * PACK_MAX_OBJECT;
+    unsigned char *big = malloc(big_size);
+    fill(big, big_size, 77);
+    CHECK(save_file("alice", "f001", big, big_size) == 0, "small -> big");
+    CHECK(count_files(STORAGE_DIR "/alice") == 1, "big file has an entry");
+    store_pack_stats(&st);
+    CHECK(st.objects == NFILES * 3 / 4 - 1, "packed version retired");
+    CHECK(same("alice", "f001", big, big_size), "big reads back");
+    CHECK(save_file("alice", "f001", small[1], 2048) == 0, "big -> small");
+    CHECK(count_files(STORAGE_DIR "/alice") == 0, "chunked version removed");
+    CHECK(same("alice", "f001", small[1], 2048), "small again");
+    CHECK(save_file("alice", "big.bin", big, big_size) == 0, "save big");
+
+    // ---- restart: replay, torn tail cut off ----
+    store->shutdown();
+    char seg[512] = "";
+    DIR *d = opendir(PACK_DIR);
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+        if (e->d_name[0] != '.')
+            snprintf(seg, sizeof(seg), PACK_DIR "/%s", e->d_name);
+    closedir(d);
+    size_t seg_size = file_size(seg);
+    int fd = open(seg, O_WRONLY | O_APPEND);
+    CHECK(fd >= 0 && write(fd, "torn record", 11) == 11, "tear a segment");
+    close(fd);
+
+    CHECK(store->init() == 0, "re-init");
+    CHECK(file_size(seg) == seg_size, "torn tail cut off");
+    store_pack_stats(&st);
+    CHECK(st.objects == NFILES * 3 / 4, "index rebuilt");
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "f%03d", i);
+        size_t size = i < NFILES / 2 ? 2048 : 1024;
+        if (i >= NFILES / 2 && i < NFILES * 3 / 4)
+            CHECK(get_file_size("alice", name) == 0, "deletes survive restart");
+        else
+            CHECK(same("alice", name, small[i], size), "reads after restart");
+    }
+    CHECK(same("alice", "big.bin", big, big_size), "big after restart");
+
+    scan_t sc = {0, 0};
+    store->scan(count_scanned, &sc);
+    CHECK(sc.files == NFILES * 3 / 4 && sc.bytes == (NFILES / 2) * 2048 + (NFILES / 4) * 1024,
+          "scan lists the packed files");
+
+    // ---- delete everything ----
+    for (int i = 0; i < NFILES; i++) {
+        snprintf(name, sizeof(name), "f%03d", i);
+        if (i < NFILES / 2 || i >= NFILES * 3 / 4)
+            CHECK(delete_file("alice", name) == 0, "final delete");
+    }
+    CHECK(delete_file("alice", "big.bin") == 0, "delete big");
+    store_pack_compact_all();
+    store_pack_stats(&st);
+    CHECK(st.objects == 0 && st.live_bytes == 0 && st.disk_bytes < 4096, "everything reclaimed");
+    chunk_stats_t cst;
+    store_chunk_stats(&cst);
+    CHECK(cst.chunks == 0, "chunks freed");
+    store->shutdown();
+
+    free(big);
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "cleanup failed\n");
+    printf("All pack store tests passed\n");
+    return 0;
+}
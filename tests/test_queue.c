@@ -3,8 +3,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
-// Simple test to validate enqueue/dequeue correctness
+// Simple test to validate enqueue/dequeue correctness:
+// higher priority first, FIFO within the same priority.
 int main(void) {
     queue_t *queue = queue_init();
     if (!queue) {
@@ -12,19 +14,23 @@ int main(void) {
         return 1;
     }
 
-    // Create and enqueue a few dummy tasks
-    for (int i = 0; i < 5; i++) {
+    // Create and enqueue a few dummy tasks with mixed priorities
+    int priorities[] = {1, 3, 0, 1, 2, 3, 0};
+    int n_tasks = sizeof(priorities) / sizeof(priorities[0]);
+    for (int i = 0; i < n_tasks; i++) {
         task_t *t = malloc(sizeof(task_t));
         if (!t) {
             perror("malloc");
             return 1;
         }
+        memset(t, 0, sizeof(*t));
 
         t->cmd = UPLOAD;
         snprintf(t->username, sizeof(t->username), "user%d", i);
         snprintf(t->filename, sizeof(t->filename), "file%d.txt", i);
         t->file_size = 1024 * (i + 1);
         t->sock_fd = i;
+        t->priority = priorities[i];
         pthread_mutex_init(&t->lock, NULL);
         pthread_cond_init(&t->completed, NULL);
         t->done = 0;
@@ -39,21 +45,35 @@ int main(void) {
     printf("All tasks enqueued successfully.\n");
 
     // Dequeue all and verify order
-    for (int i = 0; i < 5; i++) {
+    int expected[] = {1, 5, 4, 0, 3, 2, 6}; // sock_fd order
+    _Atomic int stop = 0;
+    for (int i = 0; i < n_tasks; i++) {
         task_t *t = NULL;
-        if (queue_dequeue(queue, &t) != 0 || !t) {
+        if (queue_dequeue(queue, &t, &stop) != 0 || !t) {
             fprintf(stderr, "dequeue_task failed at %d\n", i);
             return 1;
         }
 
-        printf("Dequeued task: username=%s, filename=%s, sock=%d, size=%zu\n",
-               t->username, t->filename, t->sock_fd, t->file_size);
+        printf("Dequeued task: username=%s, filename=%s, sock=%d, priority=%d\n",
+               t->username, t->filename, t->sock_fd, t->priority);
+        if (t->sock_fd != expected[i]) {
+            fprintf(stderr, "Wrong order: got sock=%d, expected %d\n", t->sock_fd, expected[i]);
+            return 1;
+        }
 
         pthread_mutex_destroy(&t->lock);
         pthread_cond_destroy(&t->completed);
         free(t);
     }
 
+    // Empty queue + stop flag must not block
+    stop = 1;
+    task_t *t = NULL;
+    if (queue_dequeue(queue, &t, &stop) != -1 || t != NULL) {
+        fprintf(stderr, "dequeue on stopped empty queue should fail\n");
+        return 1;
+    }
+
     queue_destroy(queue);
     printf("Queue destroyed successfully.\n");
     return 0;
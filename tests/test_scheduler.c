@@ -0,0 +1,121 @@
+#include "../src/scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Work-stealing scheduler checks:
+//  1. a single worker drains every peer's deque, highest priority first
+//  2. several worker threads run every submitted task exactly once
+
+#define WORKERS 3
+#define N_THREADED 3000
+
+static task_t *make_task(const char *user, int priority, int id)
+{
+    task_t *t = calloc(1, sizeof(task_t));
+    if (!t) {
+        perror("calloc");
+        exit(1);
+    }
+    t->cmd = LIST;
+    snprintf(t->username, sizeof(t->username), "%s", user);
+    t->priority = priority;
+    t->sock_fd = id;
+    return t;
+}
+
+static scheduler_t *shared;
+static _Atomic int stop;
+static _Atomic int seen[N_THREADED];
+
+static void *worker(void *arg)
+{
+    int id = (int)(long)arg;
+    task_t *t;
+    while (scheduler_next(shared, id, &t, &stop) == 0)
+        atomic_fetch_add(&seen[t->sock_fd], 1);
+    return NULL;
+}
+
+int main(void) {
+    queue_t *overflow = queue_init();
+    scheduler_t *s = scheduler_init(WORKERS, overflow);
+    if (!overflow || !s) {
+        fprintf(stderr, "Scheduler initialization failed.\n");
+        return 1;
+    }
+
+    // ---- 1. priorities across deques, all taken by worker 0 ----
+    const char *users[] = {"alice", "bob", "carol", "dave"};
+    int priorities[] = {0, 2, 1, 3, 0, 2, 3, 1};
+    int n_tasks = sizeof(priorities) / sizeof(priorities[0]);
+    for (int i = 0; i < n_tasks; i++) {
+        if (scheduler_submit(s, make_task(users[i % 4], priorities[i], i)) != 0) {
+            fprintf(stderr, "submit failed for %d\n", i);
+            return 1;
+        }
+    }
+
+    int last_priority = 3;
+    _Atomic int no_stop = 0;
+    for (int i = 0; i < n_tasks; i++) {
+        task_t *t = NULL;
+        if (scheduler_next(s, 0, &t, &no_stop) != 0 || !t) {
+            fprintf(stderr, "scheduler_next failed at %d\n", i);
+            return 1;
+        }
+        printf("Took task %d: user=%s priority=%d\n", t->sock_fd, t->username, t->priority);
+        if (t->priority > last_priority) {
+            fprintf(stderr, "Priority inversion: %d after %d\n", t->priority, last_priority);
+            return 1;
+        }
+        last_priority = t->priority;
+        free(t);
+    }
+
+    // Nothing queued + stop flag must not block
+    _Atomic int stopped = 1;
+    task_t *t = NULL;
+    if (scheduler_next(s, 1, &t, &stopped) != -1 || t != NULL) {
+        fprintf(stderr, "scheduler_next on stopped empty scheduler should fail\n");
+        return 1;
+    }
+    scheduler_destroy(s);
+
+    // ---- 2. threaded: every task runs exactly once ----
+    shared = scheduler_init(WORKERS, overflow);
+    pthread_t threads[WORKERS];
+    for (long i = 0; i < WORKERS; i++)
+        pthread_create(&threads[i], NULL, worker, (void *)i);
+
+    task_t **tasks = malloc(sizeof(task_t *) * N_THREADED);
+    for (int i = 0; i < N_THREADED; i++) {
+        char user[16];
+        snprintf(user, sizeof(user), "user%d", i % 7); // skewed: few home workers
+        tasks[i] = make_task(user, i % QUEUE_PRIORITY_LEVELS, i);
+        if (scheduler_submit(shared, tasks[i]) != 0) {
+            fprintf(stderr, "threaded submit failed for %d\n", i);
+            return 1;
+        }
+    }
+
+    stop = 1; // workers drain what is queued, then exit
+    scheduler_wake_all(shared);
+    for (int i = 0; i < WORKERS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < N_THREADED; i++) {
+        if (seen[i] != 1) {
+            fprintf(stderr, "Task %d ran %d times\n", i, seen[i]);
+            return 1;
+        }
+        free(tasks[i]);
+    }
+    free(tasks);
+    scheduler_destroy(shared);
+    queue_destroy(overflow);
+    printf("Scheduler test passed.\n");
+    return 0;
+}